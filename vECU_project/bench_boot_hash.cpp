@@ -0,0 +1,116 @@
+/**
+ * @file bench_boot_hash.cpp
+ * @brief Secure-boot image hash time: sequential SHA-256 vs. parallel Merkle root.
+ *
+ * Writes a pseudo-random image of <size_mb> MB, reads it once to warm the
+ * page cache, then times:
+ *
+ *   sha256         the stream digest calculate_file_hash() computes
+ *   merkle xN      MerkleHash::hash_file() on a ThreadPool of N threads,
+ *                  N = 1, 2, 4, ... up to <max_threads>
+ *
+ * Each line shows the best of <rounds> runs and the speedup over one
+ * thread. Every thread count must produce the same root, and so must
+ * MerkleBuilder fed in 4 KB pieces (the OTA path).
+ *
+ * Usage:
+ *   ./bench_boot_hash [size_mb=500] [max_threads=hardware threads] [rounds=3]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+
+#include "merkle_hash.hpp"
+#include "streaming_digest.hpp"
+#include "thread_pool.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static const std::string IMAGE_PATH = "bench_boot_image.bin";
+
+static std::string sha256_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    StreamingDigest digest;
+    char buf[4096];
+    while (file.read(buf, sizeof(buf)) || file.gcount() > 0)
+        digest.update(buf, file.gcount());
+    digest.finalize();
+    return digest.hex();
+}
+
+static std::string merkle_streamed(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    MerkleBuilder builder;
+    char buf[4096];
+    while (file.read(buf, sizeof(buf)) || file.gcount() > 0)
+        builder.update(reinterpret_cast<const uint8_t*>(buf), static_cast<size_t>(file.gcount()));
+    builder.finalize();
+    return builder.hex();
+}
+
+template <typename F>
+static double best_seconds(int rounds, F f) {
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        auto t0 = Clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    const long     size_mb     = argc > 1 ? std::atol(argv[1]) : 500;
+    const unsigned hw          = std::max(1u, std::thread::hardware_concurrency());
+    const unsigned max_threads = argc > 2 ? static_cast<unsigned>(std::max(1, std::atoi(argv[2]))) : hw;
+    const int      rounds      = argc > 3 ? std::max(1, std::atoi(argv[3])) : 3;
+
+    {
+        std::ofstream out(IMAGE_PATH, std::ios::binary | std::ios::trunc);
+        std::mt19937_64 rng(42);
+        std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+        for (long mb = 0; mb < size_mb; ++mb) {
+            for (auto& w : block) w = rng();
+            out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(uint64_t));
+        }
+    }
+    printf("[BENCH] %ld MB image, %u hardware thread(s), best of %d\n", size_mb, hw, rounds);
+    sha256_file(IMAGE_PATH);   // Warm the page cache
+
+    std::string sha;
+    double t = best_seconds(rounds, [&] { sha = sha256_file(IMAGE_PATH); });
+    printf("[BENCH] sha256       %8.1f ms  %7.1f MB/s\n", t * 1000.0, size_mb / t);
+
+    bool ok = true;
+    std::string reference;
+    double one_thread = 0.0;
+    std::vector<unsigned> counts;
+    for (unsigned n = 1; n < max_threads; n *= 2) counts.push_back(n);
+    counts.push_back(max_threads);
+    for (unsigned n : counts) {
+        // The calling thread hashes leaves too: n threads = caller + (n - 1) workers.
+        std::unique_ptr<ThreadPool> helpers = n > 1 ? std::make_unique<ThreadPool>(n - 1) : nullptr;
+        std::string root;
+        t = best_seconds(rounds, [&] { root = MerkleHash::hash_file(IMAGE_PATH, helpers.get()).value_or(""); });
+        if (n == 1) one_thread = t;
+        if (reference.empty()) reference = root;
+        ok = ok && !root.empty() && root == reference;
+        printf("[BENCH] merkle x%-3u  %8.1f ms  %7.1f MB/s  speedup %.2fx\n",
+               n, t * 1000.0, size_mb / t, one_thread / t);
+    }
+
+    ok = ok && merkle_streamed(IMAGE_PATH) == reference;
+    printf("[BENCH] sha256 %s\n[BENCH] merkle %s\n", sha.c_str(), reference.c_str());
+    printf("[BENCH] Consistency check: %s\n", ok ? "PASSED" : "FAILED");
+    std::remove(IMAGE_PATH.c_str());
+    return ok ? 0 : 1;
+}
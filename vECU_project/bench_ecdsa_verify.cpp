@@ -0,0 +1,197 @@
+/**
+ * @file bench_ecdsa_verify.cpp
+ * @brief Microbenchmark for ECDSAVerifier throughput and memory use.
+ *
+ * Generates a throwaway P-256 key pair and a random image, signs it, then
+ * times ECDSAVerifier::verify_file() (streaming) and verify_digest()
+ * (precomputed digest). Peak RSS is printed to show that verification
+ * memory stays flat as the image grows.
+ *
+ * Then compares the per-$37 cost once the digest is known: a fresh
+ * ECDSAVerifier (PEM parse + new context + verify), CryptoService (cached
+ * key, reused context) and the bare EVP_PKEY_verify() call it approaches.
+ *
+ * Usage:
+ *   ./bench_ecdsa_verify [image_size_mb=64] [iterations=5]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/resource.h>
+
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+
+#include "ecdsa_verifier.hpp"
+#include "crypto_service.hpp"
+#include "streaming_digest.hpp"
+
+static long peak_rss_kb() {
+    struct rusage ru {};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static EVP_PKEY* generate_p256_key() {
+    EVP_PKEY_CTX* kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY*     pkey = nullptr;
+    if (kctx
+        && EVP_PKEY_keygen_init(kctx) == 1
+        && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) == 1) {
+        EVP_PKEY_keygen(kctx, &pkey);
+    }
+    EVP_PKEY_CTX_free(kctx);
+    return pkey;
+}
+
+static bool write_random_image(const std::string& path, size_t size) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> block(64 * 1024 / sizeof(uint64_t));
+    size_t written = 0;
+    while (written < size) {
+        for (auto& w : block) w = rng();
+        size_t n = std::min(size - written, block.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(block.data()), n);
+        written += n;
+    }
+    return out.good();
+}
+
+static std::vector<uint8_t> sign_file(EVP_PKEY* pkey, const std::string& path,
+                                      std::vector<uint8_t>& digest_out) {
+    std::vector<uint8_t> sig;
+    std::ifstream in(path, std::ios::binary);
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    StreamingDigest digest;
+    if (!ctx || EVP_DigestSignInit(ctx, nullptr, EVP_sha256(), nullptr, pkey) != 1) {
+        EVP_MD_CTX_free(ctx);
+        return sig;
+    }
+    std::vector<char> buf(64 * 1024);
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+        EVP_DigestSignUpdate(ctx, buf.data(), in.gcount());
+        digest.update(buf.data(), in.gcount());
+    }
+    size_t sig_len = 0;
+    EVP_DigestSignFinal(ctx, nullptr, &sig_len);
+    sig.resize(sig_len);
+    if (EVP_DigestSignFinal(ctx, sig.data(), &sig_len) != 1) sig.clear();
+    else sig.resize(sig_len);
+    EVP_MD_CTX_free(ctx);
+    digest.finalize();
+    digest_out = digest.digest();
+    return sig;
+}
+
+int main(int argc, char* argv[]) {
+    size_t size_mb    = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    int    iterations = argc > 2 ? std::atoi(argv[2]) : 5;
+    if (size_mb == 0 || iterations <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [image_size_mb] [iterations]" << std::endl;
+        return 1;
+    }
+
+    const std::string image_path  = "bench_image.bin";
+    const std::string pubkey_path = "bench_pub.pem";
+    const size_t      image_size  = size_mb * 1024 * 1024;
+
+    EVP_PKEY* pkey = generate_p256_key();
+    if (!pkey || !write_random_image(image_path, image_size)) {
+        std::cerr << "[BENCH] Setup failed." << std::endl;
+        return 1;
+    }
+    FILE* fp = fopen(pubkey_path.c_str(), "w");
+    if (!fp || PEM_write_PUBKEY(fp, pkey) != 1) {
+        std::cerr << "[BENCH] Cannot write public key." << std::endl;
+        return 1;
+    }
+    fclose(fp);
+
+    std::vector<uint8_t> digest;
+    std::vector<uint8_t> signature = sign_file(pkey, image_path, digest);
+    EVP_PKEY_free(pkey);
+    if (signature.empty()) {
+        std::cerr << "[BENCH] Signing failed." << std::endl;
+        return 1;
+    }
+
+    ECDSAVerifier verifier;
+    if (!verifier.load_public_key(pubkey_path)) return 1;
+
+    long rss_before = peak_rss_kb();
+
+    using clock = std::chrono::steady_clock;
+    double best_file_s = 1e9;
+    for (int i = 0; i < iterations; ++i) {
+        auto t0 = clock::now();
+        bool ok = verifier.verify_file(image_path, signature);
+        double s = std::chrono::duration<double>(clock::now() - t0).count();
+        if (!ok) { std::cerr << "[BENCH] verify_file failed." << std::endl; return 1; }
+        best_file_s = std::min(best_file_s, s);
+    }
+
+    double best_digest_s = 1e9;
+    for (int i = 0; i < iterations; ++i) {
+        auto t0 = clock::now();
+        bool ok = verifier.verify_digest(digest, signature);
+        double s = std::chrono::duration<double>(clock::now() - t0).count();
+        if (!ok) { std::cerr << "[BENCH] verify_digest failed." << std::endl; return 1; }
+        best_digest_s = std::min(best_digest_s, s);
+    }
+
+    long rss_after = peak_rss_kb();
+
+    printf("\n[BENCH] Image size:            %zu MB\n", size_mb);
+    printf("[BENCH] verify_file (stream):  %.3f s  -> %.1f MB/s\n",
+           best_file_s, size_mb / best_file_s);
+    printf("[BENCH] verify_digest:         %.3f ms\n", best_digest_s * 1e3);
+    printf("[BENCH] Peak RSS before/after: %ld KB / %ld KB (growth %ld KB)\n",
+           rss_before, rss_after, rss_after - rss_before);
+
+    // --- Per-$37 overhead with the digest already known ---
+    Logger::instance().set_level(LogLevel::WARN);   // Both verifiers log every call
+    const int calls = 500;
+    auto mean_us = [&](auto&& verify) {
+        auto t0 = clock::now();
+        bool ok = true;
+        for (int i = 0; i < calls; ++i) ok = verify() && ok;
+        double us = std::chrono::duration<double, std::micro>(clock::now() - t0).count() / calls;
+        return ok ? us : -1.0;
+    };
+    double fresh_us = mean_us([&] {
+        ECDSAVerifier v;
+        return v.load_public_key(pubkey_path) && v.verify_digest(digest, signature);
+    });
+    CryptoService service;
+    if (!service.load_key(pubkey_path)) return 1;
+    double service_us = mean_us([&] { return service.verify_digest(digest, signature); });
+
+    FILE* kf = fopen(pubkey_path.c_str(), "r");
+    EVP_PKEY* pub = kf ? PEM_read_PUBKEY(kf, nullptr, nullptr, nullptr) : nullptr;
+    if (kf) fclose(kf);
+    EVP_PKEY_CTX* pctx = pub ? EVP_PKEY_CTX_new(pub, nullptr) : nullptr;
+    if (!pctx || EVP_PKEY_verify_init(pctx) != 1
+        || EVP_PKEY_CTX_set_signature_md(pctx, sha256_method()) != 1) return 1;
+    double math_us = mean_us([&] {
+        return EVP_PKEY_verify(pctx, signature.data(), signature.size(), digest.data(), digest.size()) == 1;
+    });
+    EVP_PKEY_CTX_free(pctx);
+    EVP_PKEY_free(pub);
+
+    printf("[BENCH] Per-$37 verify, fresh ECDSAVerifier: %8.1f us\n", fresh_us);
+    printf("[BENCH] Per-$37 verify, CryptoService:       %8.1f us\n", service_us);
+    printf("[BENCH] EVP_PKEY_verify alone:               %8.1f us\n", math_us);
+
+    std::remove(image_path.c_str());
+    std::remove(pubkey_path.c_str());
+    return fresh_us < 0 || service_us < 0 || math_us < 0 ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+# bench_ota.sh
+# Measures end-to-end OTA throughput (MB/s) for a range of $36 block sizes.
+#
+# For every block size a fresh TargetECU is started in a scratch directory
+# with a matching golden hash, put into programming mode and flashed with a
+# random image in legacy hash mode. The client's transfer stats are reported.
+#
+# Usage (from the build directory):
+#   ../bench_ota.sh [image_size_mb=64] [block sizes...]
+#
+# Example:
+#   ../bench_ota.sh 128 4096 16384 65536 262144 1048576
+#   WINDOW=8 ../bench_ota.sh 64          # keep 8 $36 blocks in flight
+
+set -euo pipefail
+
+BUILD_DIR="$(pwd)"
+SIZE_MB="${1:-64}"
+WINDOW="${WINDOW:-1}"
+shift || true
+BLOCK_SIZES=("$@")
+if [ ${#BLOCK_SIZES[@]} -eq 0 ]; then
+    BLOCK_SIZES=(4096 16384 65536 262144 1048576)
+fi
+
+for bin in TargetECU doip_client; do
+    if [ ! -x "$BUILD_DIR/$bin" ]; then
+        echo "[BENCH] $bin not found in $BUILD_DIR — run from the build directory." >&2
+        exit 1
+    fi
+done
+
+WORK_DIR="$(mktemp -d)"
+ECU_PID=""
+cleanup() {
+    if [ -n "$ECU_PID" ]; then kill "$ECU_PID" 2>/dev/null || true; fi
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+head -c "$((SIZE_MB * 1024 * 1024))" /dev/urandom > "$WORK_DIR/image.bin"
+
+echo "[BENCH] Image: ${SIZE_MB} MB, window: ${WINDOW}"
+printf "%12s  %10s\n" "block_bytes" "MB/s"
+
+for block in "${BLOCK_SIZES[@]}"; do
+    cd "$WORK_DIR"
+    rm -f nvram.dat nvram.dat.tmp nvram.dat.journal* nvram.dat.wear TargetECU.slot_b
+    cp "$BUILD_DIR/TargetECU" ./TargetECU
+    golden="$(openssl dgst -sha256 -r TargetECU | cut -d' ' -f1)"
+    printf "FIRMWARE_VERSION=1.0.0\nECU_SERIAL_NUMBER=VECU-BENCH\nFIRMWARE_HASH_GOLDEN=%s\nACTIVE_DTCS=NONE\n" \
+        "$golden" > nvram.dat
+
+    ./TargetECU --max-block-length "$block" > ecu.log 2>&1 &
+    ECU_PID=$!
+    sleep 1.5
+
+    "$BUILD_DIR/doip_client" --program > /dev/null
+    rate="$("$BUILD_DIR/doip_client" --update image.bin --block-size "$block" --window "$WINDOW" \
+            | sed -n 's/.*Transfer stats:.*(\([0-9.]*\) MB\/s.*/\1/p')"
+    printf "%12s  %10s\n" "$block" "${rate:-FAILED}"
+
+    wait "$ECU_PID" 2>/dev/null || true
+    ECU_PID=""
+done
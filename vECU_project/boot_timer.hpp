@@ -0,0 +1,93 @@
+#pragma once
+
+/**
+ * @file boot_timer.hpp
+ * @brief Wall-clock time of each boot phase, for cold vs. warm start tracking.
+ *
+ * run_boot_sequence() calls start(), then end_phase() as each phase
+ * completes and finish() once the ECU reaches the application. The last
+ * completed boot is kept for the log and for $22 BOOT_TIMING (0xF412).
+ *
+ * A boot is "warm" when secure boot trusted the cached verdict
+ * (boot_verdict.hpp) and "cold" when it hashed the whole image.
+ *
+ * All members are thread-safe.
+ */
+
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+enum class BootPhase : uint8_t {
+    NVRAM     = 0,   // NVRAM load + DTC restore
+    SLOT      = 1,   // A/B slot selection and trial bookkeeping
+    INTEGRITY = 2,   // Secure boot: full hash or cached verdict
+    INIT      = 3,   // Peripherals + POST
+    COUNT
+};
+
+class BootTimer {
+public:
+    static constexpr size_t PHASES = static_cast<size_t>(BootPhase::COUNT);
+
+    struct Report {
+        bool     valid    = false;   // False until a boot has completed
+        bool     warm     = false;
+        uint64_t total_us = 0;
+        std::array<uint64_t, PHASES> phase_us{};
+    };
+
+    static const char* phase_name(BootPhase p) {
+        switch (p) {
+            case BootPhase::NVRAM:     return "nvram";
+            case BootPhase::SLOT:      return "slot";
+            case BootPhase::INTEGRITY: return "integrity";
+            case BootPhase::INIT:      return "init";
+            default:                   return "?";
+        }
+    }
+
+    /// Begin timing a new boot.
+    void start() {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_current    = Report{};
+        m_boot_start = m_phase_start = Clock::now();
+    }
+
+    /// @p phase ended now; it began where the previous phase ended.
+    void end_phase(BootPhase phase) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto now = Clock::now();
+        m_current.phase_us[static_cast<size_t>(phase)] += micros(now - m_phase_start);
+        m_phase_start = now;
+    }
+
+    /// The boot reached the application. @return its report.
+    Report finish(bool warm) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_current.valid    = true;
+        m_current.warm     = warm;
+        m_current.total_us = micros(Clock::now() - m_boot_start);
+        m_last = m_current;
+        return m_last;
+    }
+
+    Report last() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_last;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static uint64_t micros(Clock::duration d) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    }
+
+    mutable std::mutex m_mutex;
+    Clock::time_point  m_boot_start;
+    Clock::time_point  m_phase_start;
+    Report             m_current;
+    Report             m_last;
+};
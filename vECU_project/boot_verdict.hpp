@@ -0,0 +1,214 @@
+#pragma once
+
+/**
+ * @file boot_verdict.hpp
+ * @brief Secure-boot verdict cache: skip re-hashing an image that has not changed.
+ *
+ * Secure boot hashes the whole executable on every boot. A restart-heavy
+ * bench boots the same image hundreds of times, so after a full hash the
+ * digest is recorded in NVRAM (BOOT_VERDICT, BYTES) together with the
+ * image's identity:
+ *
+ *   device, inode, size, mtime and ctime (nanoseconds) from stat(2), and a
+ *   SHA-256 fingerprint of the first and the last page of the file.
+ *
+ * A later boot whose image has the same identity reuses the recorded
+ * digest; it is still compared against the golden hash as usual. Any
+ * replacement of the file (new inode), in-place write (mtime/ctime) or
+ * edit of the header or tail (fingerprint) makes the boot hash in full.
+ * An edit that preserves all of these is caught by the periodic full
+ * re-hash: every <rehash_every> boots the cache is bypassed.
+ *
+ * Record layout (little-endian):
+ *   version(1) dev(8) ino(8) size(8) mtime_ns(8) ctime_ns(8)
+ *   fingerprint(32) digest(32) warm_boots(4)
+ */
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "nvram_manager.hpp"
+#include "streaming_digest.hpp"
+
+// ---------------------------------------------------------------------------
+// ImageIdentity — what must not change for a cached digest to stay valid
+// ---------------------------------------------------------------------------
+struct ImageIdentity {
+    static constexpr size_t FINGERPRINT_PAGE = 4096;
+
+    uint64_t dev      = 0;
+    uint64_t ino      = 0;
+    uint64_t size     = 0;
+    uint64_t mtime_ns = 0;
+    uint64_t ctime_ns = 0;
+    std::vector<uint8_t> fingerprint;   // SHA-256 of first page + last page
+
+    /// stat() the file and fingerprint its first and last page.
+    static std::optional<ImageIdentity> of(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::nullopt;
+        struct stat st{};
+        ImageIdentity id;
+        bool ok = ::fstat(fd, &st) == 0;
+        if (ok) {
+            id.dev      = static_cast<uint64_t>(st.st_dev);
+            id.ino      = static_cast<uint64_t>(st.st_ino);
+            id.size     = static_cast<uint64_t>(st.st_size);
+            id.mtime_ns = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec;
+            id.ctime_ns = static_cast<uint64_t>(st.st_ctim.tv_sec) * 1000000000ull + st.st_ctim.tv_nsec;
+
+            StreamingDigest digest;
+            const uint64_t head = std::min<uint64_t>(id.size, FINGERPRINT_PAGE);
+            const uint64_t tail = id.size > FINGERPRINT_PAGE ? std::min<uint64_t>(id.size - head, FINGERPRINT_PAGE) : 0;
+            ok = hash_range(fd, 0, head, digest) && hash_range(fd, id.size - tail, tail, digest)
+              && digest.finalize();
+            id.fingerprint = digest.digest();
+        }
+        ::close(fd);
+        if (!ok) return std::nullopt;
+        return id;
+    }
+
+    bool operator==(const ImageIdentity& o) const {
+        return dev == o.dev && ino == o.ino && size == o.size && mtime_ns == o.mtime_ns
+            && ctime_ns == o.ctime_ns && fingerprint == o.fingerprint;
+    }
+
+private:
+    static bool hash_range(int fd, uint64_t offset, uint64_t length, StreamingDigest& digest) {
+        char buf[FINGERPRINT_PAGE];
+        if (length == 0) return true;
+        ssize_t n = ::pread(fd, buf, length, static_cast<off_t>(offset));
+        return n == static_cast<ssize_t>(length) && digest.update(buf, length);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// BootVerdictCache
+// ---------------------------------------------------------------------------
+class BootVerdictCache {
+public:
+    static constexpr const char* NVRAM_KEY = "BOOT_VERDICT";
+
+    explicit BootVerdictCache(NVRAMManager& nvram) : m_nvram(nvram) {}
+
+    /// Hash in full every @p n boots (1: every boot, 0: only when the image changes).
+    void set_rehash_every(uint32_t n) { m_rehash_every = n; }
+
+    /**
+     * @brief The recorded digest (hex) of the image @p id, if it may be trusted this boot.
+     *
+     * A hit counts one more boot on the cached digest (one NVRAM save).
+     * @p why is set to the reason for a miss.
+     */
+    std::optional<std::string> lookup(const ImageIdentity& id, const char*& why) {
+        auto raw = m_nvram.get_bytes(NVRAM_KEY);
+        Entry e;
+        if (!raw || !decode(*raw, e)) {
+            why = "no cached verdict";
+            return std::nullopt;
+        }
+        if (!(e.identity == id)) {
+            why = "image changed";
+            return std::nullopt;
+        }
+        if (m_rehash_every > 0 && e.warm_boots + 1 >= m_rehash_every) {
+            why = "periodic full re-hash";
+            return std::nullopt;
+        }
+        ++e.warm_boots;
+        m_nvram.set_bytes(NVRAM_KEY, encode(e));
+        m_nvram.save();
+        return StreamingDigest::to_hex(e.digest);
+    }
+
+    /// Record @p digest_hex after a full hash of image @p id matched the golden hash.
+    void store(const ImageIdentity& id, const std::string& digest_hex) {
+        Entry e;
+        e.identity = id;
+        e.digest   = from_hex(digest_hex);
+        if (e.digest.size() != DIGEST_SIZE) return;
+        m_nvram.set_bytes(NVRAM_KEY, encode(e));
+        m_nvram.save();
+    }
+
+    /// Drop the cached verdict (e.g. after it failed the golden-hash comparison).
+    void forget() {
+        m_nvram.set_bytes(NVRAM_KEY, {});
+        m_nvram.save();
+    }
+
+private:
+    static constexpr uint8_t VERSION     = 1;
+    static constexpr size_t  DIGEST_SIZE = 32;
+    static constexpr size_t  RECORD_SIZE = 1 + 5 * 8 + 2 * DIGEST_SIZE + 4;
+
+    struct Entry {
+        ImageIdentity        identity;
+        std::vector<uint8_t> digest;
+        uint32_t             warm_boots = 0;
+    };
+
+    NVRAMManager& m_nvram;
+    uint32_t      m_rehash_every = 10;
+
+    static std::vector<uint8_t> encode(const Entry& e) {
+        std::vector<uint8_t> out;
+        out.reserve(RECORD_SIZE);
+        out.push_back(VERSION);
+        for (uint64_t v : {e.identity.dev, e.identity.ino, e.identity.size,
+                           e.identity.mtime_ns, e.identity.ctime_ns})
+            put_le(out, v, 8);
+        out.insert(out.end(), e.identity.fingerprint.begin(), e.identity.fingerprint.end());
+        out.insert(out.end(), e.digest.begin(), e.digest.end());
+        put_le(out, e.warm_boots, 4);
+        return out;
+    }
+
+    static bool decode(const std::vector<uint8_t>& in, Entry& e) {
+        if (in.size() != RECORD_SIZE || in[0] != VERSION) return false;
+        size_t at = 1;
+        for (uint64_t* v : {&e.identity.dev, &e.identity.ino, &e.identity.size,
+                            &e.identity.mtime_ns, &e.identity.ctime_ns}) {
+            *v = get_le(in, at, 8);
+            at += 8;
+        }
+        e.identity.fingerprint.assign(in.begin() + at, in.begin() + at + DIGEST_SIZE);
+        at += DIGEST_SIZE;
+        e.digest.assign(in.begin() + at, in.begin() + at + DIGEST_SIZE);
+        at += DIGEST_SIZE;
+        e.warm_boots = static_cast<uint32_t>(get_le(in, at, 4));
+        return true;
+    }
+
+    static void put_le(std::vector<uint8_t>& out, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    static uint64_t get_le(const std::vector<uint8_t>& in, size_t at, int bytes) {
+        uint64_t v = 0;
+        for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | in[at + i];
+        return v;
+    }
+
+    static std::vector<uint8_t> from_hex(const std::string& hex) {
+        std::vector<uint8_t> out;
+        if (hex.size() % 2 != 0) return out;
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            char* end = nullptr;
+            std::string byte = hex.substr(i, 2);
+            long v = std::strtol(byte.c_str(), &end, 16);
+            if (end != byte.c_str() + 2) return {};
+            out.push_back(static_cast<uint8_t>(v));
+        }
+        return out;
+    }
+};
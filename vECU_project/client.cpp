@@ -5,17 +5,53 @@
  * Commands:
  *   --identify                    Vehicle ID Request (DoIP 0x0004)
  *   --program                     Enter Programming Session (UDS $31 / 0xFF00)
- *   --update <file> [--sig <sig>]  Full OTA firmware update sequence ($34/$36/$37)
+ *   --update <file> [--sig <sig>] [--block-size <n>] [--window <n>]
+ *            [--compress] [--delta <base>] [--no-resume]
+ *                                 Full OTA firmware update sequence ($34/$36/$37)
  *                                   Without --sig: legacy SHA-256 hash mode
  *                                   With    --sig: ECDSA P-256 signature mode
- *   --read-dtcs                   Read all active DTCs (UDS $19 sub-fn 0x02)
- *   --clear-dtcs                  Clear all DTCs (UDS $14)
- *   --read-data <did_hex>         Read a Data Identifier (UDS $22)
+ *                                   $36 blocks are sized from the ECU's $74
+ *                                   maxNumberOfBlockLength; --block-size caps it.
+ *                                   --window keeps up to n $36 blocks in flight.
+ *                                   --compress sends a zlib stream
+ *                                   (dataFormatIdentifier 0x10).
+ *                                   An interrupted transfer of the same image
+ *                                   is resumed ($31 0xFF01) unless --no-resume.
+ *                                   --delta sends a zlib-compressed binary
+ *                                   patch against <base> (dataFormatIdentifier
+ *                                   0x30). If <base> is a directory, the file
+ *                                   in it whose SHA-256 matches the running
+ *                                   image ($22 F413) is used.
+ *   --read-dtcs [mask_hex]        Read active DTCs (UDS $19 sub-fn 0x02),
+ *                                 optionally only those matching a status mask
+ *   --clear-dtcs [group_hex]      Clear DTCs (UDS $14): all by default, or one
+ *                                 group (HH0000) or a single DTC code
+ *   --read-data <did_hex>...      Read one or more Data Identifiers in one
+ *                                 UDS $22 request
  *                                   Known DIDs:
  *                                     F400  Engine temperature (°C, 2-byte signed)
  *                                     F401  Fan status (0=OFF, 1=ON)
+ *                                     F402  Stored DTC count
+ *                                     F403  ECU uptime (s)
  *                                     F189  Firmware version string
  *                                     F18C  ECU serial number
+ *                                     F410  NVRAM flash writes this drive cycle
+ *                                     F411  NVRAM flash geometry and wear
+ *                                     F412  Last boot: cold/warm, phase times
+ *                                     F413  SHA-256 of the running image
+ *   --periodic <slow|medium|fast> <seconds> <pdid_hex>...
+ *                                 Subscribe periodic identifiers (UDS $2A),
+ *                                 print what the ECU pushes for <seconds>,
+ *                                 then stop. pDID xx is DID F2xx:
+ *                                     F0  Engine temperature
+ *                                     F1  Fan status
+ *                                 A dDID (below) can be scheduled as well.
+ *   --define-did <ddid_hex> <did_hex>[:<position>:<size>]...
+ *                                 Define dynamic DID F200-F2FF (UDS $2C 01)
+ *                                 from slices of other DIDs; position is
+ *                                 1-based. A bare DID takes all of it.
+ *                                 Defining it again appends.
+ *   --clear-did [ddid_hex]        Clear one dynamic DID, or all (UDS $2C 03)
  */
 
 #include <iostream>
@@ -26,10 +62,26 @@
 #include <iomanip>
 #include <sstream>
 #include <cstdint>
+#include <optional>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <unordered_map>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
 #include <boost/asio.hpp>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include <zlib.h>
 
 using boost::asio::ip::tcp;
 
@@ -51,12 +103,16 @@ struct DoIPHeader {
 const uint8_t  UDS_CLEAR_DTC             = 0x14;
 const uint8_t  UDS_READ_DTC              = 0x19;
 const uint8_t  UDS_READ_DATA_BY_ID       = 0x22;
+const uint8_t  UDS_READ_DATA_PERIODIC    = 0x2A;
+const uint8_t  UDS_DEFINE_DATA_ID        = 0x2C;
 const uint8_t  UDS_ROUTINE_CONTROL       = 0x31;
 const uint8_t  UDS_REQUEST_DOWNLOAD      = 0x34;
 const uint8_t  UDS_TRANSFER_DATA         = 0x36;
 const uint8_t  UDS_REQUEST_TRANSFER_EXIT = 0x37;
 
 const uint16_t ROUTINE_ENTER_PROG        = 0xFF00;
+const uint16_t ROUTINE_QUERY_RESUME      = 0xFF01;
+const uint16_t DID_FW_DIGEST             = 0xF413;
 
 // ---------------------------------------------------------------------------
 // Helper: pretty-print a byte vector as hex
@@ -69,14 +125,11 @@ static void print_hex(const std::vector<uint8_t>& data, const std::string& label
 }
 
 // ---------------------------------------------------------------------------
-// send_and_receive: send one DoIP message, read back the response.
-// Returns false on network error or UDS negative response.
+// send_message / receive_message: one DoIP frame in each direction.
 // ---------------------------------------------------------------------------
-static bool send_and_receive(tcp::socket& socket,
-                              uint16_t type,
-                              const std::vector<uint8_t>& payload,
-                              std::vector<uint8_t>& response_payload) {
-    // Build and send header + payload
+static void send_message(tcp::socket& socket,
+                         uint16_t type,
+                         const std::vector<uint8_t>& payload) {
     DoIPHeader hdr;
     hdr.protocol_version         = 0x02;
     hdr.inverse_protocol_version = ~hdr.protocol_version;
@@ -88,23 +141,72 @@ static bool send_and_receive(tcp::socket& socket,
     if (!payload.empty())
         bufs.push_back(boost::asio::buffer(payload));
     boost::asio::write(socket, bufs);
+}
 
-    // Read response header
+static uint16_t receive_message(tcp::socket& socket,
+                                std::vector<uint8_t>& response_payload) {
     DoIPHeader rsp_hdr;
     boost::asio::read(socket, boost::asio::buffer(&rsp_hdr, sizeof(rsp_hdr)));
     rsp_hdr.payload_type   = ntohs(rsp_hdr.payload_type);
     rsp_hdr.payload_length = ntohl(rsp_hdr.payload_length);
 
-    // Read response payload
     response_payload.resize(rsp_hdr.payload_length);
     if (rsp_hdr.payload_length > 0)
         boost::asio::read(socket, boost::asio::buffer(response_payload));
+    return rsp_hdr.payload_type;
+}
+
+// ---------------------------------------------------------------------------
+// receive_message_until: receive_message() for when the ECU may stay
+// silent. Waits for a frame to start until @p deadline, then returns
+// std::nullopt; a frame that has started is read to its end.
+// ---------------------------------------------------------------------------
+static std::optional<uint16_t> receive_message_until(boost::asio::io_context& io_context,
+                                                     tcp::socket& socket,
+                                                     std::vector<uint8_t>& response_payload,
+                                                     std::chrono::steady_clock::time_point deadline) {
+    DoIPHeader rsp_hdr;
+    boost::system::error_code read_ec;
+    boost::asio::steady_timer timer(io_context, deadline);
+    boost::asio::async_read(socket, boost::asio::buffer(&rsp_hdr, sizeof(rsp_hdr)),
+        [&](const boost::system::error_code& ec, size_t) { read_ec = ec; timer.cancel(); });
+    timer.async_wait([&](const boost::system::error_code& ec) { if (!ec) socket.cancel(); });
+    io_context.restart();
+    io_context.run();
+    if (read_ec == boost::asio::error::operation_aborted) return std::nullopt;
+    if (read_ec) throw boost::system::system_error(read_ec);
 
-    printf("\n[CLIENT] Response <- Type: 0x%04X, Len: %u\n",
-           rsp_hdr.payload_type, rsp_hdr.payload_length);
+    rsp_hdr.payload_type   = ntohs(rsp_hdr.payload_type);
+    rsp_hdr.payload_length = ntohl(rsp_hdr.payload_length);
+    response_payload.resize(rsp_hdr.payload_length);
+    if (rsp_hdr.payload_length > 0)
+        boost::asio::read(socket, boost::asio::buffer(response_payload));
+    return rsp_hdr.payload_type;
+}
+
+// ---------------------------------------------------------------------------
+// send_and_receive: send one DoIP message, read back the response.
+// Returns false on network error or UDS negative response.
+// 7F <SID> 78 (responsePending) is not the answer: the ECU is still
+// working, so keep reading until the final response arrives.
+// ---------------------------------------------------------------------------
+static bool send_and_receive(tcp::socket& socket,
+                              uint16_t type,
+                              const std::vector<uint8_t>& payload,
+                              std::vector<uint8_t>& response_payload) {
+    send_message(socket, type, payload);
+    uint16_t rsp_type = receive_message(socket, response_payload);
+    while (rsp_type == 0x8001 && response_payload.size() >= 3
+           && response_payload[0] == 0x7F && response_payload[2] == 0x78) {
+        printf("[CLIENT] $%02X responsePending — ECU still busy, waiting...\n", response_payload[1]);
+        rsp_type = receive_message(socket, response_payload);
+    }
+
+    printf("\n[CLIENT] Response <- Type: 0x%04X, Len: %zu\n",
+           rsp_type, response_payload.size());
 
     // Check for DoIP-level error
-    if (rsp_hdr.payload_type == 0x8002) {
+    if (rsp_type == 0x8002) {
         std::cerr << "[CLIENT] ECU returned DoIP error response." << std::endl;
         return false;
     }
@@ -147,6 +249,352 @@ static std::optional<std::string> calculate_file_hash(const std::string& path) {
     return ss.str();
 }
 
+static std::vector<uint8_t> hex_to_bytes(const std::string& hex) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        out.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Delta base for --delta: <base> itself, or the file in directory <base>,
+// whose SHA-256 is @p digest (the ECU's running image, $22 F413).
+// ---------------------------------------------------------------------------
+static std::optional<std::string> find_delta_base(const std::string& base,
+                                                  const std::vector<uint8_t>& digest) {
+    std::vector<std::string> candidates;
+    std::error_code ec;
+    if (std::filesystem::is_directory(base, ec)) {
+        for (const auto& entry : std::filesystem::directory_iterator(base, ec))
+            if (entry.is_regular_file(ec)) candidates.push_back(entry.path().string());
+        std::sort(candidates.begin(), candidates.end());
+    } else {
+        candidates.push_back(base);
+    }
+    for (const std::string& path : candidates) {
+        auto hash = calculate_file_hash(path);
+        if (hash && hex_to_bytes(*hash) == digest) return path;
+    }
+    return std::nullopt;
+}
+
+// ---------------------------------------------------------------------------
+// Query the ECU for a parked download of this image ($31 0xFF01).
+// Response: [0x71, 0x01, 0xFF, 0x01, resumeOffset (4), nextBlockSequenceCounter]
+// Returns {0, 0x01} (start from scratch) if nothing matching is parked.
+// ---------------------------------------------------------------------------
+struct ResumePoint {
+    uint32_t offset  = 0;
+    uint8_t  counter = 0x01;
+};
+
+static std::optional<ResumePoint> query_resume_point(tcp::socket& socket,
+                                                     uint8_t data_format,
+                                                     uint32_t image_size,
+                                                     const std::string& image_hash_hex) {
+    std::vector<uint8_t> req = {
+        UDS_ROUTINE_CONTROL, 0x01,
+        static_cast<uint8_t>((ROUTINE_QUERY_RESUME >> 8) & 0xFF),
+        static_cast<uint8_t>( ROUTINE_QUERY_RESUME       & 0xFF),
+        data_format,
+        static_cast<uint8_t>((image_size >> 24) & 0xFF),
+        static_cast<uint8_t>((image_size >> 16) & 0xFF),
+        static_cast<uint8_t>((image_size >>  8) & 0xFF),
+        static_cast<uint8_t>( image_size        & 0xFF)
+    };
+    // Image id: the SHA-256 of the image as 32 raw bytes
+    auto image_id = hex_to_bytes(image_hash_hex);
+    req.insert(req.end(), image_id.begin(), image_id.end());
+
+    std::vector<uint8_t> rsp;
+    if (!send_and_receive(socket, 0x8001, req, rsp) || rsp.size() < 9 || rsp[0] != 0x71)
+        return std::nullopt;
+    ResumePoint rp;
+    rp.offset  = ((uint32_t)rsp[4] << 24) | ((uint32_t)rsp[5] << 16)
+               | ((uint32_t)rsp[6] <<  8) |  (uint32_t)rsp[7];
+    rp.counter = rsp[8];
+    return rp;
+}
+
+// ---------------------------------------------------------------------------
+// $36 data as a stream. A ByteReader fills dst with up to n bytes and
+// returns how many, 0 at the end. Readers are chained (image file or delta
+// patch -> deflate), so the client only holds the blocks in flight,
+// whatever the image size.
+// ---------------------------------------------------------------------------
+using ByteReader = std::function<size_t(uint8_t* dst, size_t n)>;
+
+static ByteReader file_reader(const std::string& path) {
+    auto file = std::make_shared<std::ifstream>(path, std::ios::binary);
+    if (!file->is_open()) throw std::runtime_error("cannot open " + path);
+    return [file, path](uint8_t* dst, size_t n) {
+        file->read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(n));
+        if (file->bad()) throw std::runtime_error("cannot read " + path);
+        return static_cast<size_t>(file->gcount());
+    };
+}
+
+/// Read until @p n bytes or the end of @p reader.
+static size_t read_full(const ByteReader& reader, uint8_t* dst, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        size_t k = reader(dst + got, n - got);
+        if (k == 0) break;
+        got += k;
+    }
+    return got;
+}
+
+// zlib-compress a reader's stream on the fly ($34 dfi 0x10)
+class Deflater {
+public:
+    explicit Deflater(ByteReader source) : m_source(std::move(source)), m_in(64 * 1024) {
+        std::memset(&m_zs, 0, sizeof(m_zs));
+        if (deflateInit(&m_zs, Z_DEFAULT_COMPRESSION) != Z_OK) throw std::runtime_error("zlib init failed");
+    }
+    ~Deflater() { deflateEnd(&m_zs); }
+    Deflater(const Deflater&)            = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    size_t read(uint8_t* dst, size_t n) {
+        m_zs.next_out  = dst;
+        m_zs.avail_out = static_cast<uInt>(n);
+        while (m_zs.avail_out > 0 && !m_done) {
+            if (m_zs.avail_in == 0 && !m_eof) {
+                size_t got = m_source(m_in.data(), m_in.size());
+                m_eof          = got == 0;
+                m_zs.next_in   = m_in.data();
+                m_zs.avail_in  = static_cast<uInt>(got);
+            }
+            int rc = deflate(&m_zs, m_eof ? Z_FINISH : Z_NO_FLUSH);
+            if (rc == Z_STREAM_END)                 m_done = true;
+            else if (rc != Z_OK && rc != Z_BUF_ERROR) throw std::runtime_error("zlib compression failed");
+        }
+        return n - m_zs.avail_out;
+    }
+
+private:
+    ByteReader           m_source;
+    std::vector<uint8_t> m_in;
+    z_stream             m_zs;
+    bool                 m_eof  = false;
+    bool                 m_done = false;
+};
+
+// Read-only mapping of a whole file: the delta matcher needs random access
+// to both images without copying them into memory.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) {
+            if (fd >= 0) ::close(fd);
+            throw std::runtime_error("cannot open " + path);
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        void* p = m_size > 0 ? ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+        m_data = static_cast<const uint8_t*>(p);
+    }
+    ~MappedFile() {
+        if (m_data) ::munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t         size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+};
+
+static void put_be32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v >> 24));
+    out.push_back(static_cast<uint8_t>(v >> 16));
+    out.push_back(static_cast<uint8_t>(v >>  8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+// ---------------------------------------------------------------------------
+// Binary patch of `target` against `base` in the ECU's VDP1 format
+// (see delta_patcher.hpp), produced as it is read:
+//   "VDP1" | baseSize | baseSha256 | targetSize | ops... | END
+//
+// Matches are seeded with exact 16-byte hits, tried first at the offset
+// where the previous match ended (code that merely moved), then through a
+// hash of the base. Each seed is extended forward for as long as the
+// region still matches more bytes than it differs, and sent as a DIFF
+// (mostly zero bytes, which zlib squeezes out) or a COPY if it is exact.
+// Everything else is sent as ADD. Ops are split at MAX_OP bytes, so no
+// single op asks the ECU for more than that at once, and the patch is
+// buffered at most one op at a time.
+// ---------------------------------------------------------------------------
+class DeltaStream {
+public:
+    DeltaStream(const std::string& base_path, const std::string& target_path,
+                const std::vector<uint8_t>& base_sha256)
+        : m_base(base_path), m_target(target_path), m_table(size_t(1) << TABLE_BITS, -1)
+    {
+        // Last base offset seen for each seed hash
+        for (size_t i = 0; i + SEED <= m_base.size(); ++i)
+            m_table[seed_hash(m_base.data() + i)] = static_cast<int64_t>(i);
+
+        m_buf = {'V', 'D', 'P', '1'};
+        put_be32(m_buf, static_cast<uint32_t>(m_base.size()));
+        m_buf.insert(m_buf.end(), base_sha256.begin(), base_sha256.end());
+        put_be32(m_buf, static_cast<uint32_t>(m_target.size()));
+    }
+
+    size_t read(uint8_t* dst, size_t n) {
+        while (m_buf.size() - m_buf_at < n && next_op()) {}
+        size_t take = std::min(n, m_buf.size() - m_buf_at);
+        std::memcpy(dst, m_buf.data() + m_buf_at, take);
+        m_buf_at    += take;
+        m_bytes_out += take;
+        if (m_buf_at == m_buf.size()) {
+            m_buf.clear();
+            m_buf_at = 0;
+        }
+        return take;
+    }
+
+    uint64_t bytes_out() const { return m_bytes_out; }   // Patch bytes read so far
+
+private:
+    static constexpr size_t SEED        = 16;
+    static constexpr size_t TABLE_BITS  = 22;
+    static constexpr size_t GIVE_UP_GAP = 32;          // Stop extending after this many bytes without gain
+    static constexpr size_t MAX_OP      = 64 * 1024;   // Longest op
+
+    static size_t seed_hash(const uint8_t* p) {
+        uint64_t h = 1469598103934665603ull;
+        for (size_t i = 0; i < SEED; ++i) h = (h ^ p[i]) * 1099511628211ull;
+        return static_cast<size_t>(h >> (64 - TABLE_BITS));
+    }
+
+    bool seed_matches(size_t p, int64_t c) const {
+        return c >= 0 && static_cast<size_t>(c) + SEED <= m_base.size()
+            && std::memcmp(m_target.data() + p, m_base.data() + c, SEED) == 0;
+    }
+
+    // Append the next op, or the next MAX_OP piece of one, to m_buf.
+    // @return false once END has been written.
+    bool next_op() {
+        const uint8_t* t = m_target.data();
+        const uint8_t* b = m_base.data();
+        if (m_add_from < m_add_to) {
+            size_t len = std::min(MAX_OP, m_add_to - m_add_from);
+            m_buf.push_back(0x02);
+            put_be32(m_buf, static_cast<uint32_t>(len));
+            m_buf.insert(m_buf.end(), t + m_add_from, t + m_add_from + len);
+            m_add_from += len;
+            return true;
+        }
+        if (m_match_done < m_match_len) {
+            size_t len = std::min(MAX_OP, m_match_len - m_match_done);
+            size_t src = m_match_src + m_match_done, at = m_match_at + m_match_done;
+            m_buf.push_back(m_match_exact ? 0x01 : 0x03);
+            put_be32(m_buf, static_cast<uint32_t>(src));
+            put_be32(m_buf, static_cast<uint32_t>(len));
+            if (!m_match_exact) {
+                for (size_t i = 0; i < len; ++i)
+                    m_buf.push_back(static_cast<uint8_t>(t[at + i] - b[src + i]));
+            }
+            m_match_done += len;
+            return true;
+        }
+        if (m_ended) return false;
+        if (m_scanned) {
+            m_buf.push_back(0x00);
+            m_ended = true;
+            return true;
+        }
+        find_match();
+        return true;
+    }
+
+    // Scan on from m_p: queue the literal run before the next match and the
+    // match itself, or the rest of the target as literals.
+    void find_match() {
+        const uint8_t* t = m_target.data();
+        const uint8_t* b = m_base.data();
+        while (m_p + SEED <= m_target.size()) {
+            int64_t c = static_cast<int64_t>(m_p) + m_displacement;
+            if (!seed_matches(m_p, c)) {
+                c = m_table[seed_hash(t + m_p)];
+                if (!seed_matches(m_p, c)) { ++m_p; continue; }
+            }
+            size_t p   = m_p;
+            size_t src = static_cast<size_t>(c);
+
+            // Grow backwards into the pending literal run
+            while (p > m_literal_start && src > 0 && t[p - 1] == b[src - 1]) { --p; --src; }
+
+            // Grow forwards while matches outnumber mismatches
+            long   score = 0, best_score = 0;
+            size_t best_len = 0;
+            bool   exact = true, best_exact = true;
+            for (size_t i = 0; p + i < m_target.size() && src + i < m_base.size(); ++i) {
+                bool eq = t[p + i] == b[src + i];
+                score += eq ? 1 : -1;
+                exact  = exact && eq;
+                if (score > best_score) { best_score = score; best_len = i + 1; best_exact = exact; }
+                if (i + 1 - best_len > GIVE_UP_GAP) break;
+            }
+
+            m_add_from      = m_literal_start;
+            m_add_to        = p;
+            m_match_src     = src;
+            m_match_at      = p;
+            m_match_len     = best_len;
+            m_match_done    = 0;
+            m_match_exact   = best_exact;
+            m_displacement  = static_cast<int64_t>(src) - static_cast<int64_t>(p);
+            m_p             = p + best_len;
+            m_literal_start = m_p;
+            return;
+        }
+        m_add_from = m_literal_start;
+        m_add_to   = m_target.size();
+        m_scanned  = true;
+    }
+
+    MappedFile           m_base;
+    MappedFile           m_target;
+    std::vector<int64_t> m_table;
+    std::vector<uint8_t> m_buf;                 // Patch bytes not yet read
+    size_t               m_buf_at = 0;
+    uint64_t             m_bytes_out = 0;
+
+    size_t  m_p             = 0;                // Scan position in the target
+    size_t  m_literal_start = 0;
+    int64_t m_displacement  = 0;                // base offset - target offset of the last match
+    size_t  m_add_from = 0, m_add_to = 0;       // Queued ADD range of the target
+    size_t  m_match_src = 0, m_match_at = 0;    // Queued COPY / DIFF
+    size_t  m_match_len = 0, m_match_done = 0;
+    bool    m_match_exact = true;
+    bool    m_scanned = false;                  // Target fully matched
+    bool    m_ended   = false;                  // END written
+};
+
+// ---------------------------------------------------------------------------
+// Parse maxNumberOfBlockLength from a $74 RequestDownload response:
+//   [0x74, lengthFormatIdentifier, <n bytes big-endian>]
+// ---------------------------------------------------------------------------
+static std::optional<uint32_t> parse_max_block_length(const std::vector<uint8_t>& rsp) {
+    if (rsp.size() < 2 || rsp[0] != 0x74) return std::nullopt;
+    size_t width = rsp[1] >> 4;
+    if (width == 0 || width > 4 || rsp.size() < 2 + width) return std::nullopt;
+    uint32_t len = 0;
+    for (size_t i = 0; i < width; ++i)
+        len = (len << 8) | rsp[2 + i];
+    return len;
+}
+
 // ---------------------------------------------------------------------------
 // DTC helpers: decode the $59 response payload
 // ---------------------------------------------------------------------------
@@ -181,14 +629,126 @@ static void print_dtc_response(const std::vector<uint8_t>& payload) {
     }
 }
 
+// ---------------------------------------------------------------------------
+// DID helpers: decode the $62 response payload
+//   [0x62, DID_H, DID_L, data, (DID_H, DID_L, data)...]
+// Records carry no length, so each is split off by the known size of its
+// DID. A variable-length (F189, F18C) or unknown DID takes the rest of the
+// response, so request it last.
+// ---------------------------------------------------------------------------
+static std::optional<size_t> did_data_size(uint16_t did) {
+    switch (did) {
+        case 0xF400: case 0xF2F0: return 2;
+        case 0xF401: case 0xF2F1: return 1;
+        case 0xF402: return 2;
+        case 0xF403: return 4;
+        case 0xF410: return 26;
+        case 0xF411: return 22;
+        case 0xF412: return 21;
+        case 0xF413: return 32;
+        default:     return std::nullopt;
+    }
+}
+
+static void print_did(uint16_t did, const uint8_t* data, size_t len) {
+    // Big-endian field of n bytes at offset 'at' of the data record
+    auto be = [&](size_t at, int n) {
+        uint32_t v = 0;
+        for (int i = 0; i < n; ++i) v = (v << 8) | data[at + i];
+        return v;
+    };
+    auto fixed = did_data_size(did);
+    if (fixed && len < *fixed) {
+        printf("[CLIENT] DID 0x%04X: short record (%zu of %zu bytes)\n", did, len, *fixed);
+        return;
+    }
+    switch (did) {
+        case 0xF400:
+        case 0xF2F0:
+            std::cout << "[CLIENT] ENGINE_TEMP = " << (int16_t)be(0, 2) << " °C" << std::endl;
+            break;
+        case 0xF401:
+        case 0xF2F1:
+            std::cout << "[CLIENT] FAN_STATUS = " << (data[0] ? "ON" : "OFF") << std::endl;
+            break;
+        case 0xF402:
+            std::cout << "[CLIENT] DTC_COUNT = " << be(0, 2) << std::endl;
+            break;
+        case 0xF403:
+            std::cout << "[CLIENT] UPTIME = " << be(0, 4) << " s" << std::endl;
+            break;
+        case 0xF189:
+        case 0xF18C:
+            std::cout << "[CLIENT] " << (did == 0xF189 ? "FW_VERSION" : "ECU_SERIAL") << " = \""
+                      << std::string(data, data + len) << "\"" << std::endl;
+            break;
+        case 0xF410:
+            std::cout << "[CLIENT] FLASH_STATS: " << be(0, 4) << " NVRAM commit(s), "
+                      << be(4, 4) << " bytes -> " << be(8, 4) << " page program(s) + "
+                      << be(12, 4) << " by GC, " << be(16, 4) << " erase(s), write amplification "
+                      << std::fixed << std::setprecision(2) << be(20, 2) / 100.0
+                      << ", busy " << be(22, 4) << " ms" << std::endl;
+            break;
+        case 0xF411:
+            std::cout << "[CLIENT] FLASH_WEAR: " << be(0, 2) << " B pages, " << be(2, 4)
+                      << " B blocks x " << be(6, 2) << " (" << be(8, 2) << " free), erase count min "
+                      << be(10, 4) << " / mean " << std::fixed << std::setprecision(2)
+                      << be(18, 4) / 100.0 << " / max " << be(14, 4) << std::endl;
+            break;
+        case 0xF412: {
+            static const char* const KINDS[] = {"none yet", "cold", "warm"};
+            uint8_t kind = data[0];
+            std::cout << "[CLIENT] BOOT_TIMING: " << (kind < 3 ? KINDS[kind] : "?") << " start, "
+                      << std::fixed << std::setprecision(1) << be(1, 4) / 1000.0 << " ms (nvram "
+                      << be(5, 4) / 1000.0 << ", slot " << be(9, 4) / 1000.0 << ", integrity "
+                      << be(13, 4) / 1000.0 << ", init " << be(17, 4) / 1000.0 << " ms)" << std::endl;
+            break;
+        }
+        case 0xF413:
+            print_hex(std::vector<uint8_t>(data, data + len), "[CLIENT] FW_DIGEST =");
+            break;
+        default: {
+            char label[32];
+            std::snprintf(label, sizeof(label), "[CLIENT] DID 0x%04X raw data:", did);
+            print_hex(std::vector<uint8_t>(data, data + len), label);
+            break;
+        }
+    }
+}
+
+static void print_did_response(const std::vector<uint8_t>& payload) {
+    size_t at = 1;
+    while (at + 2 <= payload.size()) {
+        uint16_t did  = ((uint16_t)payload[at] << 8) | payload[at + 1];
+        size_t   rest = payload.size() - at - 2;
+        size_t   len  = std::min(did_data_size(did).value_or(rest), rest);
+        print_did(did, payload.data() + at + 2, len);
+        at += 2 + len;
+    }
+}
+
+// Periodic $2A message: [0x6A, pDID, data, (pDID, data)...], pDID xx = DID F2xx
+static void print_periodic_response(const std::vector<uint8_t>& payload) {
+    size_t at = 1;
+    while (at < payload.size()) {
+        uint16_t did  = 0xF200 | payload[at];
+        size_t   rest = payload.size() - at - 1;
+        size_t   len  = std::min(did_data_size(did).value_or(rest), rest);
+        print_did(did, payload.data() + at + 1, len);
+        at += 1 + len;
+    }
+}
+
 // ---------------------------------------------------------------------------
 // main
 // ---------------------------------------------------------------------------
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0]
-                  << " --identify | --program | --update <file> [--sig <sig_file>]"
-                     " | --read-dtcs | --clear-dtcs | --read-data <did_hex>"
+                  << " --identify | --program | --update <file> [--sig <sig_file>] [--block-size <n>] [--window <n>] [--compress]"
+                     " [--no-resume] [--delta <base>] | --read-dtcs [mask] | --clear-dtcs [group] | --read-data <did_hex>..."
+                     " | --periodic <slow|medium|fast> <seconds> <pdid_hex>..."
+                     " | --define-did <ddid_hex> <did_hex>[:<position>:<size>]... | --clear-did [ddid_hex]"
                   << std::endl;
         return 1;
     }
@@ -232,17 +792,37 @@ int main(int argc, char* argv[]) {
         } else if (command == "--update") {
             if (argc < 3) {
                 std::cerr << "Usage: " << argv[0]
-                          << " --update <file> [--sig <sig_file>]" << std::endl;
+                          << " --update <file> [--sig <sig_file>] [--block-size <n>] [--window <n>] [--compress]"
+                             " [--no-resume] [--delta <base>]" << std::endl;
                 return 1;
             }
             const std::string file_path = argv[2];
 
-            // Optional: --sig <signature_file>
+            // Optional: --sig <signature_file>, --block-size <bytes>, --window <n>, --compress,
+            //           --no-resume, --delta <base_image_or_dir>
             std::string sig_path;
-            for (int i = 3; i < argc - 1; ++i) {
-                if (std::string(argv[i]) == "--sig") {
-                    sig_path = argv[i + 1];
+            std::string delta_base;
+            uint32_t    block_size_cap = 0;
+            size_t      window         = 1;
+            bool        compress       = false;
+            bool        resume         = true;
+            for (int i = 3; i < argc; ++i) {
+                std::string opt = argv[i];
+                if (opt == "--compress") {
+                    compress = true;
+                } else if (opt == "--no-resume") {
+                    resume = false;
+                } else if (i + 1 >= argc) {
                     break;
+                } else if (opt == "--sig") {
+                    sig_path = argv[++i];
+                } else if (opt == "--block-size") {
+                    block_size_cap = static_cast<uint32_t>(std::stoul(argv[++i], nullptr, 0));
+                } else if (opt == "--window") {
+                    window = std::max<size_t>(1, std::stoul(argv[++i]));
+                } else if (opt == "--delta") {
+                    delta_base = argv[++i];
+                    compress   = true;    // DIFF ops only pay off compressed
                 }
             }
 
@@ -272,20 +852,95 @@ int main(int argc, char* argv[]) {
             }
             std::cout << "[CLIENT] Firmware hash: " << *hash_opt << std::endl;
 
-            std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-            if (!file.is_open()) {
+            std::error_code size_ec;
+            const auto image_size = std::filesystem::file_size(file_path, size_ec);
+            if (size_ec) {
                 std::cerr << "[CLIENT] Cannot open: " << file_path << std::endl;
                 return 1;
             }
-            uint32_t file_size = static_cast<uint32_t>(file.tellg());
-            file.seekg(0, std::ios::beg);
+            uint32_t file_size = static_cast<uint32_t>(image_size);
             std::cout << "[CLIENT] Firmware size: " << file_size << " bytes." << std::endl;
 
+            // Delta mode: the payload is a patch against the ECU's running image,
+            // found by the SHA-256 the ECU reports in $22 F413.
+            std::string          base_path;
+            std::vector<uint8_t> base_sha256;
+            if (!delta_base.empty()) {
+                std::vector<uint8_t> digest_req = {
+                    UDS_READ_DATA_BY_ID,
+                    static_cast<uint8_t>((DID_FW_DIGEST >> 8) & 0xFF),
+                    static_cast<uint8_t>( DID_FW_DIGEST       & 0xFF)
+                };
+                if (!send_and_receive(socket, 0x8001, digest_req, response) || response.size() < 3 + 32) return 1;
+                base_sha256.assign(response.begin() + 3, response.begin() + 3 + 32);
+                auto found = find_delta_base(delta_base, base_sha256);
+                if (!found) {
+                    print_hex(base_sha256, "[CLIENT] No delta base in " + delta_base + " matches the running image:");
+                    return 1;
+                }
+                base_path = *found;
+                std::cout << "[CLIENT] Diffing against " << base_path << std::endl;
+            }
+
+            // Bytes sent in $36: the image or its patch, deflated on the fly
+            // if compressing. Read block by block as they are sent.
+            std::shared_ptr<DeltaStream> delta;
+            auto open_wire = [&]() -> ByteReader {
+                ByteReader source;
+                if (!delta_base.empty()) {
+                    delta  = std::make_shared<DeltaStream>(base_path, file_path, base_sha256);
+                    source = [d = delta](uint8_t* dst, size_t n) { return d->read(dst, n); };
+                } else {
+                    source = file_reader(file_path);
+                }
+                if (!compress) return source;
+                auto deflater = std::make_shared<Deflater>(std::move(source));
+                return [deflater](uint8_t* dst, size_t n) { return deflater->read(dst, n); };
+            };
+            ByteReader wire = open_wire();
+
+            // dataFormatIdentifier: compressionMethod bit 0x1 = zlib,
+            // bit 0x2 = delta patch; encryption none
+            const uint8_t data_format = static_cast<uint8_t>((compress ? 0x10 : 0x00)
+                                                           | (delta_base.empty() ? 0x00 : 0x20));
+
+            // 0. Ask whether an earlier, interrupted transfer can be continued.
+            //    The resume offset counts wire bytes ($36 data as sent). Those
+            //    bytes are regenerated and dropped; resuming needs at least one
+            //    more after them.
+            ResumePoint            resume_at;
+            std::optional<uint8_t> carry;   // First wire byte after the resume point
+            if (resume) {
+                auto rp = query_resume_point(socket, data_format, file_size, *hash_opt);
+                if (rp && rp->offset > 0) {
+                    std::vector<uint8_t> skip(64 * 1024);
+                    size_t skipped = 0;
+                    while (skipped < rp->offset) {
+                        size_t n = read_full(wire, skip.data(), std::min<size_t>(skip.size(), rp->offset - skipped));
+                        if (n == 0) break;
+                        skipped += n;
+                    }
+                    uint8_t next;
+                    if (skipped == rp->offset && read_full(wire, &next, 1) == 1) {
+                        resume_at = *rp;
+                        carry     = next;
+                        printf("[CLIENT] Resuming interrupted transfer at offset %u (block 0x%02X).\n",
+                               resume_at.offset, resume_at.counter);
+                    } else {
+                        wire = open_wire();
+                    }
+                }
+            }
+
             // 1. Request Download ($34)
+            // A non-zero memoryAddress asks the ECU to resume at that offset.
             std::vector<uint8_t> req_dl = {
                 UDS_REQUEST_DOWNLOAD,
-                0x00, 0x44,
-                0x00, 0x00, 0x00, 0x00,
+                data_format, 0x44,
+                static_cast<uint8_t>((resume_at.offset >> 24) & 0xFF),
+                static_cast<uint8_t>((resume_at.offset >> 16) & 0xFF),
+                static_cast<uint8_t>((resume_at.offset >>  8) & 0xFF),
+                static_cast<uint8_t>( resume_at.offset        & 0xFF),
                 static_cast<uint8_t>((file_size >> 24) & 0xFF),
                 static_cast<uint8_t>((file_size >> 16) & 0xFF),
                 static_cast<uint8_t>((file_size >>  8) & 0xFF),
@@ -293,20 +948,80 @@ int main(int argc, char* argv[]) {
             };
             if (!send_and_receive(socket, 0x8001, req_dl, response)) return 1;
 
-            // 2. Transfer Data ($36) — 4 KB chunks
-            constexpr size_t CHUNK = 4096;
-            std::vector<char> buf(CHUNK);
-            uint8_t block = 1;
-            while (file.read(buf.data(), CHUNK) || file.gcount() > 0) {
-                size_t n = file.gcount();
-                std::cout << "[CLIENT] Chunk " << (int)block << " — " << n << " bytes..." << std::endl;
-                std::vector<uint8_t> chunk_pld;
-                chunk_pld.push_back(UDS_TRANSFER_DATA);
-                chunk_pld.push_back(block++);
-                chunk_pld.insert(chunk_pld.end(), buf.begin(), buf.begin() + n);
-                if (!send_and_receive(socket, 0x8001, chunk_pld, response)) return 1;
+            // maxNumberOfBlockLength counts the SID and block counter too
+            auto max_block = parse_max_block_length(response);
+            if (!max_block || *max_block < 3) {
+                std::cerr << "[CLIENT] Invalid $74 response (no usable block length)." << std::endl;
+                return 1;
             }
+            uint32_t block_length = *max_block;
+            if (block_size_cap >= 3) block_length = std::min(block_length, block_size_cap);
+            const size_t CHUNK = block_length - 2;
+            std::cout << "[CLIENT] ECU maxNumberOfBlockLength=" << *max_block
+                      << ", using " << CHUNK << "-byte data blocks." << std::endl;
+
+            // 2. Transfer Data ($36)
+            // Up to `window` blocks are kept in flight. The ECU answers in
+            // order, so each $76 must echo the oldest outstanding counter.
+            // The 8-bit counter starts at 0x01 and wraps 0xFF -> 0x00.
+            auto t_start = std::chrono::steady_clock::now();
+            std::deque<uint8_t> in_flight;
+            uint32_t            block_index = resume_at.counter;
+            size_t              sent = resume_at.offset;
+            bool                wire_done = false;
+            while (!wire_done || !in_flight.empty()) {
+                while (!wire_done && in_flight.size() < window) {
+                    std::vector<uint8_t> chunk_pld(2 + CHUNK);
+                    size_t n = 0;
+                    if (carry) {
+                        chunk_pld[2] = *carry;
+                        carry.reset();
+                        n = 1;
+                    }
+                    n += read_full(wire, chunk_pld.data() + 2 + n, CHUNK - n);
+                    if (n == 0) {
+                        wire_done = true;
+                        break;
+                    }
+                    chunk_pld.resize(2 + n);
+                    uint8_t counter = static_cast<uint8_t>(block_index++ & 0xFF);
+                    std::cout << "[CLIENT] Chunk 0x" << std::hex << std::setw(2) << std::setfill('0')
+                              << (int)counter << std::dec << " — " << n << " bytes..." << std::endl;
+                    chunk_pld[0] = UDS_TRANSFER_DATA;
+                    chunk_pld[1] = counter;
+                    send_message(socket, 0x8001, chunk_pld);
+                    sent += n;
+                    in_flight.push_back(counter);
+                }
+                if (in_flight.empty()) break;
+
+                receive_message(socket, response);
+                if (response.size() < 2 || response[0] != 0x76 || response[1] != in_flight.front()) {
+                    if (!response.empty() && response[0] == 0x7F) {
+                        printf("[CLIENT] $36 Negative Response — NRC: 0x%02X\n",
+                               response.size() >= 3 ? response[2] : 0xFF);
+                    } else {
+                        printf("[CLIENT] $36 unexpected response for block 0x%02X\n", in_flight.front());
+                    }
+                    return 1;
+                }
+                in_flight.pop_front();
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
             std::cout << "[CLIENT] Transfer complete." << std::endl;
+            printf("[CLIENT] Transfer stats: %u bytes in %.3f s (%.2f MB/s, block=%zu, window=%zu)\n",
+                   file_size, secs, secs > 0 ? file_size / secs / (1024.0 * 1024.0) : 0.0, CHUNK, window);
+            if (resume_at.offset > 0)
+                printf("[CLIENT] Resumed: %zu of %zu wire bytes sent this session.\n",
+                       sent - resume_at.offset, sent);
+            if (delta)
+                printf("[CLIENT] Delta patch: %llu bytes for a %u-byte image\n",
+                       static_cast<unsigned long long>(delta->bytes_out()), file_size);
+            if (compress) {
+                printf("[CLIENT] Wire bytes: %zu (compression ratio %.2fx, %.2f MB/s on the wire)\n",
+                       sent, sent == 0 ? 0.0 : (double)file_size / sent,
+                       secs > 0 ? sent / secs / (1024.0 * 1024.0) : 0.0);
+            }
 
             // 3. Request Transfer Exit ($37)
             // Payload: [0x37 | sig_len_H | sig_len_L | <sig_bytes OR hash_string>]
@@ -336,7 +1051,8 @@ int main(int argc, char* argv[]) {
         // ------------------------------------------------------------------
         } else if (command == "--read-dtcs") {
             // $19 sub-function 0x02, mask 0xFF = all DTCs
-            std::vector<uint8_t> payload = {UDS_READ_DTC, 0x02, 0xFF};
+            uint8_t mask = argc >= 3 ? static_cast<uint8_t>(std::stoul(argv[2], nullptr, 16)) : 0xFF;
+            std::vector<uint8_t> payload = {UDS_READ_DTC, 0x02, mask};
             if (!send_and_receive(socket, 0x8001, payload, response)) return 1;
             print_dtc_response(response);
 
@@ -345,52 +1061,145 @@ int main(int argc, char* argv[]) {
         // ------------------------------------------------------------------
         } else if (command == "--clear-dtcs") {
             // $14, group 0xFFFFFF = clear all
-            std::vector<uint8_t> payload = {UDS_CLEAR_DTC, 0xFF, 0xFF, 0xFF};
+            uint32_t group = argc >= 3 ? static_cast<uint32_t>(std::stoul(argv[2], nullptr, 16)) & 0xFFFFFF
+                                       : 0xFFFFFF;
+            std::vector<uint8_t> payload = {
+                UDS_CLEAR_DTC,
+                static_cast<uint8_t>((group >> 16) & 0xFF),
+                static_cast<uint8_t>((group >>  8) & 0xFF),
+                static_cast<uint8_t>( group        & 0xFF)
+            };
             if (!send_and_receive(socket, 0x8001, payload, response)) return 1;
-            std::cout << "[CLIENT] All DTCs cleared." << std::endl;
+            if (group == 0xFFFFFF) std::cout << "[CLIENT] All DTCs cleared." << std::endl;
+            else std::cout << "[CLIENT] DTC group 0x" << std::hex << std::uppercase << std::setw(6)
+                           << std::setfill('0') << group << std::dec << " cleared." << std::endl;
 
         // ------------------------------------------------------------------
-        // --read-data <did_hex>
+        // --read-data <did_hex>...
         // ------------------------------------------------------------------
         } else if (command == "--read-data") {
-            if (argc != 3) {
-                std::cerr << "Usage: " << argv[0] << " --read-data <did_hex>"
-                          << "  (e.g. F400 for engine temp)" << std::endl;
+            if (argc < 3) {
+                std::cerr << "Usage: " << argv[0] << " --read-data <did_hex>..."
+                          << "  (e.g. F400 for engine temp, F400 F401 F412 for several)" << std::endl;
                 return 1;
             }
-            uint16_t did = static_cast<uint16_t>(std::stoul(argv[2], nullptr, 16));
-            std::vector<uint8_t> payload = {
-                UDS_READ_DATA_BY_ID,
-                static_cast<uint8_t>((did >> 8) & 0xFF),
-                static_cast<uint8_t>( did        & 0xFF)
-            };
+            std::vector<uint8_t> payload = {UDS_READ_DATA_BY_ID};
+            for (int i = 2; i < argc; ++i) {
+                uint16_t did = static_cast<uint16_t>(std::stoul(argv[i], nullptr, 16));
+                payload.push_back(static_cast<uint8_t>((did >> 8) & 0xFF));
+                payload.push_back(static_cast<uint8_t>( did       & 0xFF));
+            }
             if (!send_and_receive(socket, 0x8001, payload, response)) return 1;
+            print_did_response(response);
 
-            // Parse and display based on DID
-            if (response.size() >= 5) {
-                uint16_t resp_did = ((uint16_t)response[1] << 8) | response[2];
-                switch (resp_did) {
-                    case 0xF400: {
-                        int16_t temp = (int16_t)(((uint16_t)response[3] << 8) | response[4]);
-                        std::cout << "[CLIENT] ENGINE_TEMP = " << temp << " °C" << std::endl;
-                        break;
-                    }
-                    case 0xF401: {
-                        std::cout << "[CLIENT] FAN_STATUS = "
-                                  << (response[3] ? "ON" : "OFF") << std::endl;
-                        break;
-                    }
-                    default:
-                        print_hex(std::vector<uint8_t>(response.begin() + 3, response.end()),
-                                  "[CLIENT] Raw data:");
-                        break;
+        // ------------------------------------------------------------------
+        // --periodic <slow|medium|fast> <seconds> <pdid_hex>...
+        // ------------------------------------------------------------------
+        } else if (command == "--periodic") {
+            const std::string rate = argc >= 3 ? argv[2] : "";
+            const uint8_t mode = rate == "slow" ? 0x01 : rate == "medium" ? 0x02 : rate == "fast" ? 0x03 : 0x00;
+            if (argc < 5 || mode == 0x00) {
+                std::cerr << "Usage: " << argv[0] << " --periodic <slow|medium|fast> <seconds> <pdid_hex>..."
+                          << "  (e.g. fast 5 F0 F1 for engine temp + fan)" << std::endl;
+                return 1;
+            }
+            const double seconds = std::stod(argv[3]);
+            std::vector<uint8_t> payload = {UDS_READ_DATA_PERIODIC, mode};
+            for (int i = 4; i < argc; ++i)
+                payload.push_back(static_cast<uint8_t>(std::stoul(argv[i], nullptr, 16)));
+            if (!send_and_receive(socket, 0x8001, payload, response)) return 1;
+
+            // Print what is pushed; measure the spacing of the messages.
+            using Clock = std::chrono::steady_clock;
+            const auto t0 = Clock::now();
+            const auto deadline = t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+            size_t messages = 0, bytes = 0;
+            double sum = 0.0, sum_sq = 0.0;
+            Clock::time_point last;
+            while (Clock::now() < deadline) {
+                if (!receive_message_until(io_context, socket, response, deadline)) break;   // ECU went quiet
+                if (response.size() < 2 || response[0] != 0x6A) continue;
+                const auto now = Clock::now();
+                printf("[CLIENT] Periodic message at +%.1f ms:\n", std::chrono::duration<double, std::milli>(now - t0).count());
+                std::cout.flush();
+                print_periodic_response(response);
+                if (messages > 0) {
+                    double gap = std::chrono::duration<double, std::milli>(now - last).count();
+                    sum += gap;
+                    sum_sq += gap * gap;
+                }
+                last = now;
+                ++messages;
+                bytes += sizeof(DoIPHeader) + response.size();
+            }
+
+            // Stop; samples already on the way arrive before the [0x6A] confirmation.
+            send_message(socket, 0x8001, {UDS_READ_DATA_PERIODIC, 0x04});
+            const auto stop_deadline = Clock::now() + std::chrono::seconds(2);
+            do {
+                if (!receive_message_until(io_context, socket, response, stop_deadline)) {
+                    std::cerr << "[CLIENT] ECU did not confirm the stop." << std::endl;
+                    break;
                 }
-            } else if (response.size() >= 3) {
-                // Short response (e.g. FW version string)
-                std::string val(response.begin() + 3, response.end());
-                std::cout << "[CLIENT] Value = \"" << val << "\"" << std::endl;
+            } while (!response.empty() && response[0] == 0x6A && response.size() > 1);
+
+            if (messages > 1) {
+                double mean = sum / (messages - 1);
+                double jitter = std::sqrt(std::max(0.0, sum_sq / (messages - 1) - mean * mean));
+                printf("[CLIENT] %zu periodic message(s), %zu bytes; interval %.2f ms, jitter %.2f ms\n",
+                       messages, bytes, mean, jitter);
+            } else {
+                printf("[CLIENT] %zu periodic message(s), %zu bytes.\n", messages, bytes);
             }
 
+        // ------------------------------------------------------------------
+        // --define-did <ddid_hex> <did_hex>[:<position>:<size>]...
+        // ------------------------------------------------------------------
+        } else if (command == "--define-did") {
+            if (argc < 4) {
+                std::cerr << "Usage: " << argv[0] << " --define-did <ddid_hex> <did_hex>[:<position>:<size>]..."
+                          << "  (e.g. F200 F400 F401 F402 F403 for a dashboard)" << std::endl;
+                return 1;
+            }
+            uint16_t ddid = static_cast<uint16_t>(std::stoul(argv[2], nullptr, 16));
+            std::vector<uint8_t> payload = {UDS_DEFINE_DATA_ID, 0x01,
+                                            static_cast<uint8_t>(ddid >> 8), static_cast<uint8_t>(ddid & 0xFF)};
+            for (int i = 3; i < argc; ++i) {
+                // <did>[:<position>:<size>]
+                std::string arg = argv[i];
+                size_t colon = arg.find(':');
+                uint16_t did = static_cast<uint16_t>(std::stoul(arg.substr(0, colon), nullptr, 16));
+                unsigned long position = 1, size = did_data_size(did).value_or(0);
+                if (colon != std::string::npos) {
+                    size_t second = arg.find(':', colon + 1);
+                    position = std::stoul(arg.substr(colon + 1, second - colon - 1));
+                    size     = second == std::string::npos ? 0 : std::stoul(arg.substr(second + 1));
+                }
+                if (size == 0 || size > 0xFF || position == 0 || position > 0xFF) {
+                    std::cerr << "[CLIENT] " << arg << ": give <position>:<size> (1..255) for this DID." << std::endl;
+                    return 1;
+                }
+                payload.push_back(static_cast<uint8_t>(did >> 8));
+                payload.push_back(static_cast<uint8_t>(did & 0xFF));
+                payload.push_back(static_cast<uint8_t>(position));
+                payload.push_back(static_cast<uint8_t>(size));
+            }
+            if (!send_and_receive(socket, 0x8001, payload, response)) return 1;
+            printf("[CLIENT] Dynamic DID 0x%04X defined; read it with --read-data %04X.\n", ddid, ddid);
+
+        // ------------------------------------------------------------------
+        // --clear-did [ddid_hex]
+        // ------------------------------------------------------------------
+        } else if (command == "--clear-did") {
+            std::vector<uint8_t> payload = {UDS_DEFINE_DATA_ID, 0x03};
+            if (argc >= 3) {
+                uint16_t ddid = static_cast<uint16_t>(std::stoul(argv[2], nullptr, 16));
+                payload.push_back(static_cast<uint8_t>(ddid >> 8));
+                payload.push_back(static_cast<uint8_t>(ddid & 0xFF));
+            }
+            if (!send_and_receive(socket, 0x8001, payload, response)) return 1;
+            std::cout << "[CLIENT] " << (argc >= 3 ? "Dynamic DID cleared." : "All dynamic DIDs cleared.") << std::endl;
+
         // ------------------------------------------------------------------
         // Unknown
         // ------------------------------------------------------------------
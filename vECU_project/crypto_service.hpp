@@ -0,0 +1,225 @@
+#pragma once
+
+/**
+ * @file crypto_service.hpp
+ * @brief Process-wide firmware signature verification with a cached key.
+ *
+ * Creating an ECDSAVerifier per $37 re-opens and PEM-parses the public key
+ * and builds a new EVP context every time. CryptoService does that work
+ * once:
+ *
+ *   - load_key() reads the PEM at boot and validates it (EC P-256, public
+ *     point on the curve) before it is used for anything.
+ *   - The SHA-256 method is fetched once (sha256_method()), so OpenSSL 3
+ *     does no implicit fetch per context.
+ *   - Verification contexts (EVP_PKEY_CTX, already initialized for verify
+ *     with SHA-256) are kept in a free list and reused, so a verification
+ *     costs only the signature math.
+ *
+ * The key is replaced only by an explicit rotate_key() (TargetECU does it
+ * on SIGHUP). The current key and its contexts form one immutable
+ * KeyState held by shared_ptr: a rotation publishes a new one, and
+ * verifications already running finish on the old key, which is freed
+ * with its last user.
+ *
+ * All members are thread-safe.
+ */
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/err.h>
+#include <openssl/core_names.h>
+
+#include "streaming_digest.hpp"
+#include "logger.hpp"
+
+class CryptoService {
+public:
+    CryptoService() = default;
+    CryptoService(const CryptoService&)            = delete;
+    CryptoService& operator=(const CryptoService&) = delete;
+
+    /// Load and validate the signing public key. @return false (and keep no key) on failure.
+    bool load_key(const std::string& pubkey_path) {
+        auto state = read_key(pubkey_path, 1);
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_path = pubkey_path;
+        m_key  = state;
+        return state != nullptr;
+    }
+
+    /**
+     * @brief Reload the key file (key-rotation event).
+     *
+     * The new key must load and validate; otherwise the current key stays.
+     */
+    bool rotate_key() {
+        std::string path;
+        uint64_t    generation;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            path       = m_path;
+            generation = m_key ? m_key->generation + 1 : 1;
+        }
+        auto state = read_key(path, generation);
+        if (!state) {
+            LOG_ERROR("CRYPTO", "Key rotation failed; keeping the current key.");
+            return false;
+        }
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_key = state;
+        LOG_INFO("CRYPTO", "Signing key rotated (generation %llu).", static_cast<unsigned long long>(generation));
+        return true;
+    }
+
+    bool has_key() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_key != nullptr;
+    }
+
+    /// 1 for the key loaded at boot, +1 per rotation; 0 if none.
+    uint64_t key_generation() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_key ? m_key->generation : 0;
+    }
+
+    /**
+     * @brief Verify a DER ECDSA signature over a precomputed SHA-256 digest.
+     * @return true if the signature is valid for the current key.
+     */
+    bool verify_digest(const std::vector<uint8_t>& digest, const std::vector<uint8_t>& signature) const {
+        std::shared_ptr<KeyState> key;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            key = m_key;
+        }
+        if (!key) {
+            LOG_ERROR("CRYPTO", "No signing key loaded.");
+            return false;
+        }
+
+        EVP_PKEY_CTX* ctx = key->acquire();
+        if (!ctx) {
+            log_openssl_error();
+            return false;
+        }
+        int rc = EVP_PKEY_verify(ctx, signature.data(), signature.size(), digest.data(), digest.size());
+        key->release(ctx);
+
+        if (rc == 1) {
+            LOG_INFO("CRYPTO", "Signature VALID.");
+            return true;
+        }
+        LOG_ERROR("CRYPTO", "Signature INVALID.");
+        log_openssl_error();
+        return false;
+    }
+
+private:
+    /// One loaded key and the verification contexts made for it.
+    struct KeyState {
+        EVP_PKEY*                  pkey       = nullptr;
+        uint64_t                   generation = 0;
+        std::mutex                 mutex;
+        std::vector<EVP_PKEY_CTX*> free;
+
+        ~KeyState() {
+            for (EVP_PKEY_CTX* ctx : free) EVP_PKEY_CTX_free(ctx);
+            EVP_PKEY_free(pkey);
+        }
+
+        // A context ready for EVP_PKEY_verify() (reused, or made now).
+        EVP_PKEY_CTX* acquire() {
+            {
+                std::lock_guard<std::mutex> lk(mutex);
+                if (!free.empty()) {
+                    EVP_PKEY_CTX* ctx = free.back();
+                    free.pop_back();
+                    return ctx;
+                }
+            }
+            EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_from_pkey(nullptr, pkey, nullptr);
+            if (ctx && EVP_PKEY_verify_init(ctx) == 1
+                && EVP_PKEY_CTX_set_signature_md(ctx, sha256_method()) == 1)
+                return ctx;
+            EVP_PKEY_CTX_free(ctx);
+            return nullptr;
+        }
+
+        void release(EVP_PKEY_CTX* ctx) {
+            std::lock_guard<std::mutex> lk(mutex);
+            free.push_back(ctx);
+        }
+    };
+
+    mutable std::mutex        m_mutex;
+    std::string               m_path;
+    std::shared_ptr<KeyState> m_key;
+
+    static std::shared_ptr<KeyState> read_key(const std::string& path, uint64_t generation) {
+        FILE* fp = std::fopen(path.c_str(), "r");
+        if (!fp) {
+            LOG_ERROR("CRYPTO", "Cannot open public key: %s", path.c_str());
+            return nullptr;
+        }
+        EVP_PKEY* pkey = PEM_read_PUBKEY(fp, nullptr, nullptr, nullptr);
+        std::fclose(fp);
+        if (!pkey) {
+            LOG_ERROR("CRYPTO", "Failed to parse public key: %s", path.c_str());
+            log_openssl_error();
+            return nullptr;
+        }
+        auto state = std::make_shared<KeyState>();
+        state->pkey       = pkey;
+        state->generation = generation;
+        if (!validate(pkey)) return nullptr;
+
+        // Prove the key is usable now rather than on the first $37.
+        EVP_PKEY_CTX* ctx = state->acquire();
+        if (!ctx) {
+            LOG_ERROR("CRYPTO", "Public key cannot be used for verification.");
+            log_openssl_error();
+            return nullptr;
+        }
+        state->release(ctx);
+        LOG_INFO("CRYPTO", "Public key loaded and validated: %s", path.c_str());
+        return state;
+    }
+
+    // EC key on P-256 whose public point is valid.
+    static bool validate(EVP_PKEY* pkey) {
+        char group[64] = {};
+        size_t len = 0;
+        if (!EVP_PKEY_is_a(pkey, "EC")
+            || EVP_PKEY_get_utf8_string_param(pkey, OSSL_PKEY_PARAM_GROUP_NAME, group, sizeof(group), &len) != 1
+            || std::strcmp(group, "prime256v1") != 0) {
+            LOG_ERROR("CRYPTO", "Public key is not an ECDSA P-256 key.");
+            return false;
+        }
+        EVP_PKEY_CTX* check = EVP_PKEY_CTX_new_from_pkey(nullptr, pkey, nullptr);
+        bool ok = check && EVP_PKEY_public_check(check) == 1;
+        EVP_PKEY_CTX_free(check);
+        if (!ok) {
+            LOG_ERROR("CRYPTO", "Public key failed validation.");
+            log_openssl_error();
+        }
+        return ok;
+    }
+
+    static void log_openssl_error() {
+        unsigned long err;
+        while ((err = ERR_get_error()) != 0) {
+            char buf[256];
+            ERR_error_string_n(err, buf, sizeof(buf));
+            LOG_ERROR("CRYPTO", "OpenSSL: %s", buf);
+        }
+    }
+};
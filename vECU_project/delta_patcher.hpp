@@ -0,0 +1,294 @@
+#pragma once
+
+/**
+ * @file delta_patcher.hpp
+ * @brief Streaming reconstruction of a firmware image from a binary patch.
+ *
+ * A delta download ($34 dataFormatIdentifier compressionMethod bit 0x2)
+ * carries a patch against the image the ECU is running instead of the
+ * image itself. The patch is applied as it arrives: each op reads what it
+ * needs from the base executable with pread(), so the new image is never
+ * held in memory as a whole.
+ *
+ * Patch format (all integers big-endian):
+ *
+ *   Header:  "VDP1" | baseSize (4) | baseSha256 (32) | targetSize (4)
+ *   Ops:     0x01 COPY  | baseOffset (4) | length (4)
+ *            0x02 ADD   | length (4) | bytes[length]
+ *            0x03 DIFF  | baseOffset (4) | length (4) | bytes[length]
+ *                       out[i] = base[baseOffset + i] + bytes[i]  (mod 256)
+ *            0x00 END
+ *
+ * DIFF covers regions that moved and changed only slightly (relocated
+ * addresses in a rebuilt executable); its bytes are mostly zero and
+ * compress well, so delta patches are normally sent zlib-compressed.
+ *
+ * Output is produced in bounded steps: apply() stops once it has made
+ * max_output bytes and resumes there on the next call, so a COPY of the
+ * whole base never has to be read or held in one piece.
+ *
+ * The patch names the base by SHA-256. It is applied only if that matches
+ * the digest the running image passed secure boot with.
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "streaming_digest.hpp"
+#include "logger.hpp"
+
+class DeltaPatcher {
+public:
+    /// The image a patch is applied against.
+    struct Base {
+        std::string path;        // Running executable
+        std::string digest_hex;  // Its verified SHA-256 (FIRMWARE_HASH_GOLDEN)
+    };
+
+    static constexpr uint8_t OP_END  = 0x00;
+    static constexpr uint8_t OP_COPY = 0x01;
+    static constexpr uint8_t OP_ADD  = 0x02;
+    static constexpr uint8_t OP_DIFF = 0x03;
+    static constexpr size_t  HEADER_SIZE = 4 + 4 + 32 + 4;
+
+    explicit DeltaPatcher(Base base)
+        : m_base(std::move(base))
+    {
+        m_fd = ::open(m_base.path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        m_ok = m_fd >= 0 && ::fstat(m_fd, &st) == 0;
+        if (m_ok) m_base_size = static_cast<uint64_t>(st.st_size);
+    }
+
+    ~DeltaPatcher() {
+        if (m_fd >= 0) ::close(m_fd);
+    }
+
+    DeltaPatcher(const DeltaPatcher&)            = delete;
+    DeltaPatcher& operator=(const DeltaPatcher&) = delete;
+
+    /**
+     * @brief Apply the next piece of the patch stream.
+     *
+     * Stops after @p max_output image bytes. Patch bytes not consumed then
+     * must be passed again on the next call. A COPY needs no patch bytes,
+     * so it may still be pending() when the input is used up; call again,
+     * with @p len 0 if need be, to continue it.
+     *
+     * @param data       Patch bytes (already decompressed).
+     * @param len        Number of patch bytes.
+     * @param consumed   Set to the number of patch bytes used.
+     * @param out        Receives the reconstructed image bytes (replaced).
+     * @param max_output Most image bytes to produce in this call.
+     * @return false on a malformed patch, a base mismatch, a read error,
+     *         data after END, or output past the target size.
+     */
+    bool apply(const uint8_t* data, size_t len, size_t& consumed, std::vector<uint8_t>& out, size_t max_output) {
+        out.clear();
+        consumed = 0;
+        if (!m_ok) return false;
+
+        auto t0 = std::chrono::steady_clock::now();
+        size_t pos = 0;
+        while (m_ok && out.size() < max_output && (pos < len || m_phase == Phase::COPY)) {
+            switch (m_phase) {
+                case Phase::HEADER:
+                case Phase::OP_HEADER: {
+                    // The op byte comes first and decides the op header size.
+                    size_t need = (m_phase == Phase::HEADER ? HEADER_SIZE : op_header_size()) - m_hdr.size();
+                    size_t take = std::min(need, len - pos);
+                    m_hdr.insert(m_hdr.end(), data + pos, data + pos + take);
+                    pos += take;
+                    if (m_hdr.size() == (m_phase == Phase::HEADER ? HEADER_SIZE : op_header_size())) {
+                        if (m_phase == Phase::HEADER) parse_header();
+                        else                          parse_op();
+                    }
+                    break;
+                }
+                case Phase::ADD:
+                case Phase::DIFF: {
+                    size_t take = static_cast<size_t>(std::min<uint64_t>(m_op_remaining,
+                                                                         std::min(len - pos, max_output - out.size())));
+                    size_t at   = out.size();
+                    out.insert(out.end(), data + pos, data + pos + take);
+                    if (m_phase == Phase::DIFF) apply_diff(out.data() + at, take);
+                    pos            += take;
+                    m_op_offset    += take;
+                    m_op_remaining -= take;
+                    if (m_op_remaining == 0) next_op();
+                    break;
+                }
+                case Phase::COPY:
+                    // COPY carries no payload; read from the base as output room allows.
+                    emit_copy(out, max_output - out.size());
+                    break;
+                case Phase::DONE:
+                    // Trailing bytes after END mean a corrupt or padded patch.
+                    m_ok = false;
+                    break;
+            }
+        }
+
+        consumed     = pos;
+        m_bytes_in  += pos;
+        m_bytes_out += out.size();
+        if (m_ok && m_bytes_out > m_target_size && m_phase != Phase::HEADER) m_ok = false;
+        m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return m_ok;
+    }
+
+    bool     ok()           const { return m_ok; }
+    bool     finished()     const { return m_phase == Phase::DONE && m_bytes_out == m_target_size; }
+    /// A COPY has output left that needs no more patch bytes.
+    bool     pending()      const { return m_ok && m_phase == Phase::COPY; }
+    uint64_t bytes_in()     const { return m_bytes_in; }
+    uint64_t bytes_out()    const { return m_bytes_out; }
+    uint64_t copied_bytes() const { return m_copied; }      // COPY + DIFF output
+    uint64_t literal_bytes() const { return m_literal; }    // ADD output
+    double   seconds()      const { return m_seconds; }
+
+private:
+    enum class Phase { HEADER, OP_HEADER, COPY, ADD, DIFF, DONE };
+
+    static uint32_t be32(const uint8_t* p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    /// Bytes of op header still expected, counting the op byte itself.
+    size_t op_header_size() const {
+        if (m_hdr.empty()) return 1;
+        switch (m_hdr[0]) {
+            case OP_COPY: case OP_DIFF: return 1 + 4 + 4;
+            case OP_ADD:                return 1 + 4;
+            default:                    return 1;
+        }
+    }
+
+    void parse_header() {
+        const uint8_t* h = m_hdr.data();
+        if (std::memcmp(h, "VDP1", 4) != 0) {
+            fail("not a VDP1 patch");
+            return;
+        }
+        uint32_t base_size = be32(h + 4);
+        std::string base_hex = StreamingDigest::to_hex(std::vector<uint8_t>(h + 8, h + 40));
+        m_target_size = be32(h + 40);
+        if (base_size != m_base_size || base_hex != m_base.digest_hex) {
+            fail("patch was built against a different base image (" + base_hex + ")");
+            return;
+        }
+        next_op();
+    }
+
+    void parse_op() {
+        const uint8_t* h = m_hdr.data();
+        switch (h[0]) {
+            case OP_END:
+                m_phase = Phase::DONE;
+                m_hdr.clear();
+                return;
+            case OP_ADD:
+                m_op_remaining = be32(h + 1);
+                m_op_offset    = 0;
+                m_literal     += m_op_remaining;
+                m_phase        = Phase::ADD;
+                break;
+            case OP_COPY:
+            case OP_DIFF:
+                m_op_base      = be32(h + 1);
+                m_op_remaining = be32(h + 5);
+                m_op_offset    = 0;
+                if (m_op_base + m_op_remaining > m_base_size) {
+                    fail("op reads past the end of the base image");
+                    return;
+                }
+                m_copied      += m_op_remaining;
+                m_phase        = h[0] == OP_COPY ? Phase::COPY : Phase::DIFF;
+                break;
+            default:
+                fail("unknown op");
+                return;
+        }
+        m_hdr.clear();
+        if (m_op_remaining == 0) next_op();
+    }
+
+    void next_op() {
+        m_hdr.clear();
+        m_phase = Phase::OP_HEADER;
+    }
+
+    /// Read base bytes [m_op_base + m_op_offset, +len) into @p dst.
+    bool read_base(uint8_t* dst, size_t len) {
+        uint64_t at = m_op_base + m_op_offset;
+        while (len > 0) {
+            ssize_t n = ::pread(m_fd, dst, len, static_cast<off_t>(at));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                fail("cannot read base image");
+                return false;
+            }
+            dst += n;
+            at  += static_cast<uint64_t>(n);
+            len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    /// Append up to @p room bytes of the current COPY to @p out.
+    void emit_copy(std::vector<uint8_t>& out, size_t room) {
+        size_t n  = static_cast<size_t>(std::min<uint64_t>(m_op_remaining, room));
+        size_t at = out.size();
+        out.resize(at + n);
+        if (!read_base(out.data() + at, n)) return;
+        m_op_offset    += n;
+        m_op_remaining -= n;
+        if (m_op_remaining == 0) next_op();
+    }
+
+    void apply_diff(uint8_t* bytes, size_t len) {
+        uint8_t base[4096];
+        for (size_t done = 0; done < len && m_ok; ) {
+            size_t n = std::min(len - done, sizeof(base));
+            uint64_t saved = m_op_offset;
+            m_op_offset += done;
+            bool read = read_base(base, n);
+            m_op_offset = saved;
+            if (!read) return;
+            for (size_t i = 0; i < n; ++i) bytes[done + i] = static_cast<uint8_t>(bytes[done + i] + base[i]);
+            done += n;
+        }
+    }
+
+    void fail(const std::string& why) {
+        m_ok = false;
+        LOG_ERROR("DELTA", "Patch rejected: %s.", why.c_str());
+    }
+
+    Base                 m_base;
+    int                  m_fd        = -1;
+    uint64_t             m_base_size = 0;
+    bool                 m_ok        = false;
+
+    Phase                m_phase       = Phase::HEADER;
+    std::vector<uint8_t> m_hdr;                     // Partial header / op header
+    uint32_t             m_target_size = 0;
+    uint64_t             m_op_base      = 0;
+    uint64_t             m_op_offset    = 0;        // Progress within the current op
+    uint64_t             m_op_remaining = 0;
+
+    uint64_t m_bytes_in  = 0;
+    uint64_t m_bytes_out = 0;
+    uint64_t m_copied    = 0;
+    uint64_t m_literal   = 0;
+    double   m_seconds   = 0.0;
+};
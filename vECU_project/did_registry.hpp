@@ -0,0 +1,139 @@
+#pragma once
+
+/**
+ * @file did_registry.hpp
+ * @brief Data Identifiers served by $22 ReadDataByIdentifier.
+ *
+ * Each DID is registered once at startup with an encoder that appends the
+ * current value to a response, and the value's size in bytes (0 for a
+ * variable-length value such as a string).
+ *
+ * Lookup is two array indexes, with no hashing and no locks: the table
+ * has a page of 256 entries per DID high byte, and only pages with
+ * entries exist. The table is immutable once published. add() copies the
+ * page index and the one page it changes, then publishes the new table;
+ * remove() does the same. A reader keeps the snapshot it got from table()
+ * for the whole request, so DIDs may be added or removed at any time, even
+ * while $22 requests are being served.
+ *
+ * All members are thread-safe.
+ */
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// ---------------------------------------------------------------------------
+// UDS Data Identifiers (for $22 ReadDataByIdentifier)
+// ---------------------------------------------------------------------------
+namespace DataID {
+    constexpr uint16_t ENGINE_TEMP   = 0xF400; // Engine temperature in °C (2 bytes, signed)
+    constexpr uint16_t FAN_STATUS    = 0xF401; // Fan active: 0x01 = ON, 0x00 = OFF (1 byte)
+    constexpr uint16_t DTC_COUNT     = 0xF402; // Stored DTCs (2 bytes)
+    constexpr uint16_t UPTIME        = 0xF403; // Seconds since ECU start (4 bytes)
+    constexpr uint16_t FW_VERSION    = 0xF189; // Firmware version string (ISO 14229 standard ID)
+    constexpr uint16_t ECU_SERIAL    = 0xF18C; // ECU serial number
+    // Emulated NVRAM flash, this drive cycle (all fields big-endian):
+    //   commits(4) hostBytes(4) pagePrograms(4) gcPrograms(4) erases(4)
+    //   writeAmplification x100 (2) busyMs(4)
+    constexpr uint16_t FLASH_STATS   = 0xF410;
+    //   pageSize(2) blockSize(4) blocks(2) freeBlocks(2)
+    //   minErase(4) maxErase(4) meanErase x100 (4)   (lifetime counts)
+    constexpr uint16_t FLASH_WEAR    = 0xF411;
+    // Last boot: kind(1: 0 = none yet, 1 = cold, 2 = warm) totalUs(4)
+    //   nvramUs(4) slotUs(4) integrityUs(4) initUs(4)
+    constexpr uint16_t BOOT_TIMING   = 0xF412;
+    // SHA-256 of the running image (32 bytes, FIRMWARE_HASH_GOLDEN; zeros
+    // if unknown). Testers pick their delta base by it.
+    constexpr uint16_t FW_DIGEST     = 0xF413;
+    // $2A periodic identifiers F0/F1: ENGINE_TEMP and FAN_STATUS in the
+    // 0xF2xx range periodic reads are limited to (periodic_scheduler.hpp)
+    constexpr uint16_t PERIODIC_ENGINE_TEMP = 0xF2F0;
+    constexpr uint16_t PERIODIC_FAN_STATUS  = 0xF2F1;
+}
+
+class DidRegistry {
+public:
+    /// Appends the DID's current value (without the DID itself) to the response.
+    using Encoder = std::function<void(std::vector<uint8_t>& out)>;
+
+    static constexpr uint16_t VARIABLE = 0;   // Size of a variable-length value
+
+    struct Entry {
+        uint16_t    did  = 0;
+        const char* name = nullptr;
+        uint16_t    size = VARIABLE;
+        Encoder     encode;
+    };
+
+    /// Immutable snapshot of every registered DID.
+    class Table {
+    public:
+        /// @return The entry for @p did, or nullptr if it is not registered.
+        const Entry* find(uint16_t did) const {
+            const Page* page = m_pages[did >> 8].get();
+            if (!page) return nullptr;
+            const Entry* e = &(*page)[did & 0xFF];
+            return e->encode ? e : nullptr;
+        }
+
+        size_t count() const { return m_count; }
+
+    private:
+        friend class DidRegistry;
+        using Page = std::array<Entry, 256>;
+
+        std::array<std::shared_ptr<const Page>, 256> m_pages{};
+        size_t                                       m_count = 0;
+    };
+
+    DidRegistry() : m_table(std::make_shared<Table>()) {}
+    DidRegistry(const DidRegistry&)            = delete;
+    DidRegistry& operator=(const DidRegistry&) = delete;
+
+    /// Register (or replace) @p did. @p size is in bytes, VARIABLE if not fixed.
+    void add(uint16_t did, const char* name, uint16_t size, Encoder encode) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto table = std::make_shared<Table>(*m_table);
+        const auto& old_page = table->m_pages[did >> 8];
+        auto page = old_page ? std::make_shared<Table::Page>(*old_page) : std::make_shared<Table::Page>();
+        Entry& e = (*page)[did & 0xFF];
+        if (!e.encode) ++table->m_count;
+        e = Entry{did, name, size, std::move(encode)};
+        table->m_pages[did >> 8] = std::move(page);
+        m_table = std::move(table);
+    }
+
+    /// Unregister @p did. @return false if it was not registered.
+    bool remove(uint16_t did) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        const auto& old_page = m_table->m_pages[did >> 8];
+        if (!old_page || !(*old_page)[did & 0xFF].encode) return false;
+        auto table = std::make_shared<Table>(*m_table);
+        auto page  = std::make_shared<Table::Page>(*old_page);
+        (*page)[did & 0xFF] = Entry{};
+        --table->m_count;
+        table->m_pages[did >> 8] = std::move(page);
+        m_table = std::move(table);
+        return true;
+    }
+
+    /// The current table; hold it for the duration of one request.
+    std::shared_ptr<const Table> table() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_table;
+    }
+
+    /// Append the low @p bytes bytes of @p value, big-endian.
+    static void push_be(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int shift = 8 * (bytes - 1); shift >= 0; shift -= 8)
+            out.push_back(static_cast<uint8_t>((value >> shift) & 0xFF));
+    }
+
+private:
+    mutable std::mutex           m_mutex;
+    std::shared_ptr<const Table> m_table;
+};
@@ -1,29 +1,48 @@
 #pragma once
 
-#include <iostream>
+/**
+ * @file doip_server.hpp
+ * @brief Async TCP acceptor that runs the shared io_context on a worker pool.
+ *
+ * Threading model:
+ *   - run() drives the io_context from `thread_count` threads (the calling
+ *     thread plus thread_count - 1 workers), so independent sessions are
+ *     served in parallel.
+ *   - Every accepted socket is bound to its own strand. All completion
+ *     handlers of a DoIPSession therefore run serialized, and the session's
+ *     members need no locking.
+ *   - Handlers of *different* sessions run concurrently. See main.cpp for
+ *     which shared globals may be touched from them.
+ */
+
 #include <vector>
 #include <thread>
 #include <boost/asio.hpp>
 #include "doip_session.hpp" // Include the new session header
+#include "logger.hpp"
 
 using boost::asio::ip::tcp;
 
 class DoIPServer {
 public:
-    DoIPServer(boost::asio::io_context& io_context, short port)
+    DoIPServer(boost::asio::io_context& io_context, short port, std::size_t thread_count = 1)
         : m_io_context(io_context),
-          m_acceptor(io_context, tcp::endpoint(tcp::v4(), port)) {
-        std::cout << "[DoIP] Server starting on port " << port << "..." << std::endl;
+          m_acceptor(io_context, tcp::endpoint(tcp::v4(), port)),
+          m_thread_count(thread_count > 0 ? thread_count : 1) {
+        LOG_INFO("DoIP", "Server starting on port %d with %zu I/O thread(s)...", port, m_thread_count);
     }
 
     void run() {
-        try {
-            start_accept();
-            m_io_context.run();
-        } catch (const std::exception& e) {
-            std::cerr << "[DoIP] Server exception: " << e.what() << std::endl;
-        }
-        std::cout << "[DoIP] Server has stopped." << std::endl;
+        start_accept();
+
+        std::vector<std::thread> workers;
+        workers.reserve(m_thread_count - 1);
+        for (std::size_t i = 1; i < m_thread_count; ++i)
+            workers.emplace_back([this]() { run_worker(); });
+
+        run_worker();
+        for (auto& t : workers) t.join();
+        LOG_INFO("DoIP", "Server has stopped.");
     }
 
     void stop() {
@@ -31,15 +50,28 @@ public:
     }
 
 private:
+    void run_worker() {
+        try {
+            m_io_context.run();
+        } catch (const std::exception& e) {
+            LOG_ERROR("DoIP", "Server exception: %s", e.what());
+            m_io_context.stop();
+        }
+    }
+
     void start_accept() {
-        // Asynchronously accept a new connection.
-        m_acceptor.async_accept([this](const boost::system::error_code& error, tcp::socket socket) {
+        // Asynchronously accept a new connection. The socket is created on a
+        // fresh strand so that all of the session's handlers are serialized.
+        m_acceptor.async_accept(boost::asio::make_strand(m_io_context),
+            [this](const boost::system::error_code& error, tcp::socket socket) {
+            // The acceptor is closed: this server may already be destroyed.
+            if (error == boost::asio::error::operation_aborted) return;
             if (!error) {
                 // Connection successful. Create a new session and start it.
                 // The session will manage its own lifecycle from here.
                 std::make_shared<DoIPSession>(std::move(socket))->start();
             } else {
-                std::cerr << "[DoIP] Error accepting connection: " << error.message() << std::endl;
+                LOG_ERROR("DoIP", "Error accepting connection: %s", error.message().c_str());
             }
 
             // Immediately start waiting for the next connection.
@@ -49,4 +81,5 @@ private:
 
     boost::asio::io_context& m_io_context;
     tcp::acceptor m_acceptor;
+    std::size_t   m_thread_count;
 };
@@ -8,10 +8,20 @@
  *   $14  ClearDiagnosticInformation
  *   $19  ReadDTCInformation (sub-function 0x02: reportDTCByStatusMask)
  *   $22  ReadDataByIdentifier
- *   $31  RoutineControl (0xFF00 = enter programming session)
+ *   $2A  ReadDataByPeriodicIdentifier (periodic_scheduler.hpp)
+ *   $2C  DynamicallyDefineDataIdentifier (dynamic_dids.hpp)
+ *   $31  RoutineControl (0xFF00 = enter programming session,
+ *                        0xFF01 = query resumable download)
  *   $34  RequestDownload
  *   $36  TransferData
  *   $37  RequestTransferExit
+ *
+ * Concurrency: the socket handed in by DoIPServer is bound to a per-session
+ * strand, so every handler below runs serialized for this session while
+ * other sessions proceed in parallel on the I/O pool.
+ *
+ * Long requests ($37 verification and slot switch) run on g_workers, never
+ * on an I/O thread; see run_with_response_pending().
  */
 
 #include <iostream>
@@ -22,24 +32,47 @@
 #include <atomic>
 #include <mutex>
 #include <cstdio>
+#include <algorithm>
+#include <deque>
+#include <cstring>
+#include <optional>
+#include <chrono>
+#include <functional>
+#include <utility>
 #include <boost/asio.hpp>
 
 #include "ecu_state.hpp"
+#include "ecu_config.hpp"
 #include "dtc_manager.hpp"
-#include "ecdsa_verifier.hpp"
+#include "crypto_service.hpp"
+#include "firmware_download.hpp"
+#include "download_registry.hpp"
+#include "slot_manager.hpp"
+#include "thread_pool.hpp"
+#include "did_registry.hpp"
+#include "response_cache.hpp"
+#include "periodic_scheduler.hpp"
+#include "dynamic_dids.hpp"
+#include "logger.hpp"
 
 // ---------------------------------------------------------------------------
 // Externals from main.cpp
 // ---------------------------------------------------------------------------
+extern EcuConfig               g_config;
 extern std::atomic<EcuState>  g_ecu_state;
 extern std::string             g_executable_path;
 extern DTCManager              g_dtc_manager;
-extern std::atomic<int>        g_engine_temp_c;
-extern std::atomic<bool>       g_fan_active;
-extern std::mutex              g_console_mutex;
-
-extern std::optional<std::string> calculate_file_hash(const std::string& file_path);
-extern void apply_update(const std::string& current_executable_path);
+extern NVRAMManager            g_nvram;
+extern SlotManager             g_slots;
+extern DownloadRegistry        g_download_registry;
+extern CryptoService           g_crypto;
+extern DidRegistry             g_dids;
+extern ResponseCache           g_responses;
+extern DynamicDids             g_dynamic_dids;
+extern std::unique_ptr<ThreadPool> g_workers;
+
+extern bool apply_update(const std::string& image_digest_hex, const std::string& merkle_root_hex);
+extern void reset_after_update();
 
 using boost::asio::ip::tcp;
 
@@ -55,31 +88,56 @@ struct DoIPHeader {
 };
 #pragma pack(pop)
 
-// ---------------------------------------------------------------------------
-// UDS Data Identifiers (for $22 ReadDataByIdentifier)
-// ---------------------------------------------------------------------------
-namespace DataID {
-    constexpr uint16_t ENGINE_TEMP   = 0xF400; // Engine temperature in °C (2 bytes, signed)
-    constexpr uint16_t FAN_STATUS    = 0xF401; // Fan active: 0x01 = ON, 0x00 = OFF (1 byte)
-    constexpr uint16_t FW_VERSION    = 0xF189; // Firmware version string (ISO 14229 standard ID)
-    constexpr uint16_t ECU_SERIAL    = 0xF18C; // ECU serial number
-}
-
 // ---------------------------------------------------------------------------
 // DoIPSession
 // ---------------------------------------------------------------------------
 class DoIPSession : public std::enable_shared_from_this<DoIPSession> {
 public:
     explicit DoIPSession(tcp::socket socket)
-        : m_socket(std::move(socket)),
-          m_firmware_file_size(0),
-          m_bytes_received(0)
+        : m_socket(std::move(socket))
+        , m_pending_timer(m_socket.get_executor())
+        , m_periodic(m_socket.get_executor(), g_dids,
+                     [this](std::vector<uint8_t> payload) { send_periodic(std::move(payload)); })
     {}
 
+    ~DoIPSession() {
+        // Connection lost mid-transfer: keep the download for a later resume.
+        if (m_download && m_download->resumable() && g_download_registry.park(m_download)) {
+            LOG_INFO("SESSION", "Parking interrupted download at offset %llu for resume.",
+                     (unsigned long long)m_download->wire_bytes());
+            m_download.reset();
+        }
+        retire_download();
+    }
+
     void start() {
         do_read_header();
     }
 
+    /**
+     * @brief Define the frames of g_responses (see response_cache.hpp).
+     *
+     * Called once at startup; each is rebuilt when its NVRAM key changes.
+     */
+    static void define_cached_responses(ResponseCache& cache) {
+        auto frame_of = [](uint16_t payload_type, std::vector<uint8_t> prefix, const std::string& key,
+                           const char* fallback) {
+            return [=] {
+                std::string value = g_nvram.get_string(key).value_or(fallback);
+                std::vector<uint8_t> payload = prefix;
+                payload.insert(payload.end(), value.begin(), value.end());
+                return ResponseCache::Entry{build_frame(payload_type, payload), sizeof(DoIPHeader) + prefix.size()};
+            };
+        };
+        cache.define(CachedResponse::VEHICLE_ANNOUNCEMENT, "VIN",
+                     frame_of(0x0005, {}, "VIN", "VECU-SIM-1234567"));
+        // Testers use the version as the base for delta updates.
+        cache.define(CachedResponse::FW_VERSION, "FIRMWARE_VERSION",
+                     frame_of(0x8001, {0x62, 0xF1, 0x89}, "FIRMWARE_VERSION", "1.0.0"));
+        cache.define(CachedResponse::ECU_SERIAL, "ECU_SERIAL_NUMBER",
+                     frame_of(0x8001, {0x62, 0xF1, 0x8C}, "ECU_SERIAL_NUMBER", "VECU-SIM-1234567"));
+    }
+
 private:
     // -----------------------------------------------------------------------
     // Async read pipeline: header -> payload -> process
@@ -92,19 +150,27 @@ private:
                 if (!ec) {
                     m_received_header.payload_type   = ntohs(m_received_header.payload_type);
                     m_received_header.payload_length = ntohl(m_received_header.payload_length);
-                    {
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        printf("[SESSION] Header -> Type: 0x%04X, Len: %u\n",
-                               m_received_header.payload_type, m_received_header.payload_length);
+                    LOG_DEBUG("SESSION", "Header -> Type: 0x%04X, Len: %u",
+                              m_received_header.payload_type, m_received_header.payload_length);
+                    if (m_received_header.payload_length > max_payload_length()) {
+                        // Never allocate for an oversized frame; drop the connection.
+                        LOG_ERROR("SESSION", "Payload too large (%u bytes) — closing.",
+                                  m_received_header.payload_length);
+                        return;
                     }
                     do_read_payload();
                 } else if (ec != boost::asio::error::eof) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] Header read error: " << ec.message() << std::endl;
+                    LOG_ERROR("SESSION", "Header read error: %s", ec.message().c_str());
                 }
             });
     }
 
+    /// Largest accepted DoIP payload: one full $36 block, or a $37 with a
+    /// 16-bit signature length, whichever is bigger.
+    static uint32_t max_payload_length() {
+        return std::max<uint32_t>(g_config.max_block_length, 3u + 0xFFFFu);
+    }
+
     void do_read_payload() {
         auto self = shared_from_this();
         m_payload.resize(m_received_header.payload_length);
@@ -120,8 +186,7 @@ private:
                 if (!ec) {
                     process_message();
                 } else if (ec != boost::asio::error::eof) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] Payload read error: " << ec.message() << std::endl;
+                    LOG_ERROR("SESSION", "Payload read error: %s", ec.message().c_str());
                 }
             });
     }
@@ -132,10 +197,7 @@ private:
     void process_message() {
         switch (m_received_header.payload_type) {
             case 0x0004: // Vehicle Identification Request
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cout << "[SESSION] Vehicle ID Request received." << std::endl;
-                }
+                LOG_DEBUG("SESSION", "Vehicle ID Request received.");
                 do_write_vehicle_announcement();
                 break;
 
@@ -144,10 +206,7 @@ private:
                 break;
 
             default:
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    printf("[SESSION] Unhandled type 0x%04X\n", m_received_header.payload_type);
-                }
+                LOG_WARN("SESSION", "Unhandled type 0x%04X", m_received_header.payload_type);
                 do_read_header();
                 break;
         }
@@ -167,6 +226,9 @@ private:
             // $14 — ClearDiagnosticInformation
             // Payload: [0x14, GroupOfDTC_H, GroupOfDTC_M, GroupOfDTC_L]
             //   0xFFFFFF = clear all DTCs
+            //   0xHH0000 = clear every DTC whose high byte is HH
+            //   otherwise the exact DTC code
+            // A group that is neither defined nor stored gets NRC 0x31.
             // -----------------------------------------------------------------
             case 0x14: {
                 uint32_t group = 0xFFFFFF;
@@ -175,12 +237,12 @@ private:
                           | ((uint32_t)m_payload[2] <<  8)
                           |  (uint32_t)m_payload[3];
                 }
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    printf("[SESSION] $14 ClearDTCInformation — group=0x%06X\n", group);
+                LOG_INFO("SESSION", "$14 ClearDTCInformation — group=0x%06X", group);
+                if (!g_dtc_manager.clear_group(group)) {
+                    // Negative response: requestOutOfRange (0x31)
+                    do_write_generic_response(0x8001, {0x7F, 0x14, 0x31});
+                    return;
                 }
-                // We only support clear-all (0xFFFFFF); could extend per-group later.
-                g_dtc_manager.clear_all();
 
                 // Positive response: 0x54 (echo of 0x14 + 0x40)
                 do_write_generic_response(0x8001, {0x54});
@@ -203,10 +265,7 @@ private:
                 }
 
                 uint8_t mask = (m_payload.size() >= 3) ? m_payload[2] : 0xFF;
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    printf("[SESSION] $19 ReadDTCInformation — statusMask=0x%02X\n", mask);
-                }
+                LOG_INFO("SESSION", "$19 ReadDTCInformation — statusMask=0x%02X", mask);
 
                 auto response = g_dtc_manager.build_read_dtc_response(mask);
                 do_write_generic_response(0x8001, response);
@@ -215,56 +274,50 @@ private:
 
             // -----------------------------------------------------------------
             // $22 — ReadDataByIdentifier
-            // Payload: [0x22, DID_H, DID_L]
-            // Can request multiple DIDs; we handle one per message for simplicity.
+            // Payload:  [0x22, DID_H, DID_L, (DID_H, DID_L)...]
+            // Response: [0x62, DID_H, DID_L, data, (DID_H, DID_L, data)...]
+            // DIDs come from g_dids. Unsupported ones are left out of the
+            // response; requestOutOfRange (0x31) only if none is supported.
+            // A lone F189 or F18C is answered with its prebuilt frame.
             // -----------------------------------------------------------------
             case 0x22: {
-                if (m_payload.size() < 3) break;
-                uint16_t did = ((uint16_t)m_payload[1] << 8) | m_payload[2];
+                if (m_payload.size() < 3 || (m_payload.size() - 1) % 2 != 0) {
+                    // Negative response: incorrectMessageLengthOrInvalidFormat (0x13)
+                    do_write_generic_response(0x8001, {0x7F, 0x22, 0x13});
+                    return;
+                }
+                if (m_payload.size() == 3) {
+                    uint16_t did = ((uint16_t)m_payload[1] << 8) | m_payload[2];
+                    if (auto which = cached_did(did)) {
+                        if (Frame frame = g_responses.get(*which).frame) {
+                            do_write_frame(std::move(frame));
+                            return;
+                        }
+                    }
+                }
+                const auto dids = g_dids.table();
+                const size_t requested = (m_payload.size() - 1) / 2;
 
                 std::vector<uint8_t> response;
+                response.reserve(1 + requested * 8);
                 response.push_back(0x62);      // Positive response SID
-                response.push_back(m_payload[1]);
-                response.push_back(m_payload[2]);
-
-                bool supported = true;
-                switch (did) {
-                    case DataID::ENGINE_TEMP: {
-                        int16_t temp = static_cast<int16_t>(g_engine_temp_c.load());
-                        response.push_back((temp >> 8) & 0xFF);
-                        response.push_back( temp       & 0xFF);
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cout << "[SESSION] $22 RDBI ENGINE_TEMP = " << temp << "°C" << std::endl;
-                        break;
-                    }
-                    case DataID::FAN_STATUS: {
-                        response.push_back(g_fan_active.load() ? 0x01 : 0x00);
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cout << "[SESSION] $22 RDBI FAN_STATUS = "
-                                  << (g_fan_active.load() ? "ON" : "OFF") << std::endl;
-                        break;
-                    }
-                    case DataID::FW_VERSION: {
-                        // Populate from NVRAM if possible; fallback to "1.0.0"
-                        std::string ver = "1.0.0";
-                        response.insert(response.end(), ver.begin(), ver.end());
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cout << "[SESSION] $22 RDBI FW_VERSION = " << ver << std::endl;
-                        break;
-                    }
-                    case DataID::ECU_SERIAL: {
-                        std::string serial = "VECU-SIM-1234567";
-                        response.insert(response.end(), serial.begin(), serial.end());
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cout << "[SESSION] $22 RDBI ECU_SERIAL = " << serial << std::endl;
-                        break;
-                    }
-                    default:
-                        supported = false;
-                        break;
+                size_t served = 0;
+                for (size_t i = 1; i + 1 < m_payload.size(); i += 2) {
+                    uint16_t did = ((uint16_t)m_payload[i] << 8) | m_payload[i + 1];
+                    const DidRegistry::Entry* entry = dids->find(did);
+                    if (!entry) continue;
+                    response.push_back(m_payload[i]);
+                    response.push_back(m_payload[i + 1]);
+                    const size_t at = response.size();
+                    entry->encode(response);
+                    if (entry->size != DidRegistry::VARIABLE && response.size() - at != entry->size)
+                        LOG_ERROR("SESSION", "$22 %s encoded %zu bytes, registered as %u.",
+                                  entry->name, response.size() - at, entry->size);
+                    ++served;
                 }
+                LOG_DEBUG("SESSION", "$22 RDBI %zu of %zu DID(s), %zu bytes", served, requested, response.size());
 
-                if (!supported) {
+                if (served == 0) {
                     // Negative response: requestOutOfRange (0x31)
                     do_write_generic_response(0x8001, {0x7F, 0x22, 0x31});
                 } else {
@@ -274,165 +327,389 @@ private:
             }
 
             // -----------------------------------------------------------------
-            // $31 — RoutineControl  (0xFF00 = enter programming session)
+            // $2A — ReadDataByPeriodicIdentifier
+            // Payload:  [0x2A, transmissionMode, pDID...]
+            //   transmissionMode 0x01 slow, 0x02 medium, 0x03 fast,
+            //   0x04 stopSending (the listed pDIDs, or all if none).
+            // Response: [0x6A], then periodic [0x6A, pDID, data, ...]
+            //   pushed by m_periodic until stopped or disconnected.
+            // -----------------------------------------------------------------
+            case 0x2A: {
+                if (m_payload.size() < 2) {
+                    // Negative response: incorrectMessageLengthOrInvalidFormat (0x13)
+                    do_write_generic_response(0x8001, {0x7F, 0x2A, 0x13});
+                    return;
+                }
+                const uint8_t mode = m_payload[1];
+                std::vector<uint8_t> pdids(m_payload.begin() + 2, m_payload.end());
+
+                if (mode == 0x04) {
+                    m_periodic.stop(pdids);
+                    LOG_DEBUG("SESSION", "$2A stop %zu pDID(s); %zu still scheduled.",
+                              pdids.size(), m_periodic.scheduled());
+                    do_write_generic_response(0x8001, {0x6A});
+                    return;
+                }
+                if (mode < 0x01 || mode > 0x03) {
+                    // Negative response: requestOutOfRange (0x31)
+                    do_write_generic_response(0x8001, {0x7F, 0x2A, 0x31});
+                    return;
+                }
+                if (pdids.empty()) {
+                    do_write_generic_response(0x8001, {0x7F, 0x2A, 0x13});
+                    return;
+                }
+                const auto dids = g_dids.table();
+                for (uint8_t pdid : pdids) {
+                    if (!dids->find(PeriodicScheduler::PDID_BASE | pdid)) {
+                        do_write_generic_response(0x8001, {0x7F, 0x2A, 0x31});
+                        return;
+                    }
+                }
+                const auto rate = static_cast<PeriodicRate>(mode);
+                if (!m_periodic.start(rate, pdids, weak_from_this())) {
+                    LOG_WARN("SESSION", "$2A would exceed %zu periodic identifiers.",
+                             PeriodicScheduler::MAX_SCHEDULED);
+                    do_write_generic_response(0x8001, {0x7F, 0x2A, 0x31});
+                    return;
+                }
+                LOG_INFO("SESSION", "$2A %zu pDID(s) every %lld ms.", pdids.size(),
+                         static_cast<long long>(PeriodicScheduler::period(rate).count()));
+                do_write_generic_response(0x8001, {0x6A});
+                return;
+            }
+
+            // -----------------------------------------------------------------
+            // $2C — DynamicallyDefineDataIdentifier
+            //   0x01 defineByIdentifier:
+            //     Payload:  [0x2C, 0x01, dDID_H, dDID_L,
+            //                (sourceDID_H, sourceDID_L, position, size)...]
+            //     position is 1-based, as in ISO 14229. Defining a dDID
+            //     again appends to it.
+            //   0x03 clearDynamicallyDefinedDataIdentifier:
+            //     Payload:  [0x2C, 0x03, (dDID_H, dDID_L)]; all if omitted.
+            // Response: [0x6C, subFunction, (dDID_H, dDID_L)]
+            // -----------------------------------------------------------------
+            case 0x2C: {
+                if (m_payload.size() < 2) {
+                    // Negative response: incorrectMessageLengthOrInvalidFormat (0x13)
+                    do_write_generic_response(0x8001, {0x7F, 0x2C, 0x13});
+                    return;
+                }
+                const uint8_t sub_fn = m_payload[1];
+
+                if (sub_fn == 0x01) {
+                    if (m_payload.size() < 8 || (m_payload.size() - 4) % 4 != 0) {
+                        do_write_generic_response(0x8001, {0x7F, 0x2C, 0x13});
+                        return;
+                    }
+                    uint16_t did = ((uint16_t)m_payload[2] << 8) | m_payload[3];
+                    std::vector<DynamicDids::Slice> slices;
+                    bool valid = true;
+                    for (size_t i = 4; i + 3 < m_payload.size(); i += 4) {
+                        const uint8_t position = m_payload[i + 2];
+                        valid = valid && position > 0;
+                        slices.push_back({static_cast<uint16_t>(((uint16_t)m_payload[i] << 8) | m_payload[i + 1]),
+                                          static_cast<uint16_t>(position - 1), m_payload[i + 3]});
+                    }
+                    if (!valid || !g_dynamic_dids.define(did, slices)) {
+                        // Negative response: requestOutOfRange (0x31)
+                        do_write_generic_response(0x8001, {0x7F, 0x2C, 0x31});
+                        return;
+                    }
+                    do_write_generic_response(0x8001, {0x6C, 0x01, m_payload[2], m_payload[3]});
+                    return;
+                }
+                if (sub_fn == 0x03) {
+                    if (m_payload.size() == 2) {
+                        g_dynamic_dids.clear_all();
+                        do_write_generic_response(0x8001, {0x6C, 0x03});
+                        return;
+                    }
+                    if (m_payload.size() != 4) {
+                        do_write_generic_response(0x8001, {0x7F, 0x2C, 0x13});
+                        return;
+                    }
+                    uint16_t did = ((uint16_t)m_payload[2] << 8) | m_payload[3];
+                    if (!g_dynamic_dids.clear(did)) {
+                        do_write_generic_response(0x8001, {0x7F, 0x2C, 0x31});
+                        return;
+                    }
+                    do_write_generic_response(0x8001, {0x6C, 0x03, m_payload[2], m_payload[3]});
+                    return;
+                }
+                // Negative response: sub-function not supported (0x12);
+                // defineByMemoryAddress (0x02) has no memory map to read.
+                do_write_generic_response(0x8001, {0x7F, 0x2C, 0x12});
+                return;
+            }
+
+            // -----------------------------------------------------------------
+            // $31 — RoutineControl
+            //   0xFF00 = enter programming session
+            //   0xFF01 = query resumable download
+            //     Request:  [0x31, 0x01, 0xFF, 0x01, dataFormatIdentifier,
+            //                memorySize (4), imageId (32)]
+            //     Response: [0x71, 0x01, 0xFF, 0x01, resumeOffset (4),
+            //                nextBlockSequenceCounter]
+            //   resumeOffset is 0 when nothing matching is parked. The
+            //   identity is remembered so the following $34 is resumable.
             // -----------------------------------------------------------------
             case 0x31: {
                 if (m_payload.size() < 4) break;
                 uint16_t routine_id = ((uint16_t)m_payload[2] << 8) | m_payload[3];
 
                 if (routine_id == 0xFF00) {
-                    {
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cout << "[SESSION] $31 Enter Programming Session." << std::endl;
-                    }
+                    LOG_INFO("SESSION", "$31 Enter Programming Session.");
                     g_ecu_state = EcuState::UPDATE_PENDING;
                     std::vector<uint8_t> rsp = {0x71};
                     rsp.insert(rsp.end(), m_payload.begin() + 1, m_payload.end());
                     do_write_generic_response(0x8001, rsp);
                     return;
                 }
+                if (routine_id == 0xFF01) {
+                    if (m_payload.size() < 4 + 1 + 4 + 32) {
+                        do_write_generic_response(0x8001, {0x7F, 0x31, 0x13});
+                        return;
+                    }
+                    DownloadIdentity id;
+                    id.data_format = m_payload[4];
+                    id.image_size  = ((uint32_t)m_payload[5] << 24) | ((uint32_t)m_payload[6] << 16)
+                                   | ((uint32_t)m_payload[7] <<  8) |  (uint32_t)m_payload[8];
+                    std::copy(m_payload.begin() + 9, m_payload.begin() + 41, id.image_id.begin());
+                    m_pending_identity = id;
+
+                    uint32_t offset  = 0;
+                    uint8_t  counter = 0x01;
+                    if (auto parked = g_download_registry.find(id)) {
+                        offset  = static_cast<uint32_t>(parked->wire_bytes());
+                        counter = parked->next_block_counter();
+                    }
+                    LOG_INFO("SESSION", "$31 Query resumable download — offset %u", offset);
+                    do_write_generic_response(0x8001, {0x71, 0x01, 0xFF, 0x01,
+                        static_cast<uint8_t>(offset >> 24), static_cast<uint8_t>(offset >> 16),
+                        static_cast<uint8_t>(offset >>  8), static_cast<uint8_t>(offset),
+                        counter});
+                    return;
+                }
                 break;
             }
 
             // -----------------------------------------------------------------
             // $34 — RequestDownload
+            // Payload: [0x34, dataFormatIdentifier, addressAndLengthFormatIdentifier,
+            //           memoryAddress (n bytes), memorySize (m bytes)]
+            //   dataFormatIdentifier high nibble = compressionMethod
+            //   (bit 0x1 zlib, bit 0x2 delta patch against the running image,
+            //   see DeltaPatcher); low nibble = encryptingMethod (0x0 only).
+            //   memorySize is the size of the reconstructed image.
+            //   A non-zero memoryAddress resumes a parked download at that
+            //   wire offset (see $31 0xFF01); zero starts a fresh one.
+            // Response: [0x74, lengthFormatIdentifier, maxNumberOfBlockLength]
+            //   lengthFormatIdentifier high nibble = byte count of the block
+            //   length that follows (big-endian, minimal width).
+            //   A fresh download first aborts the previous one, answering
+            //   7F 34 78 until its writer has stopped; 7F 34 70 if the
+            //   staging slot cannot be opened.
             // -----------------------------------------------------------------
             case 0x34: {
                 if (g_ecu_state != EcuState::UPDATE_PENDING) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] $34 received outside UPDATE_PENDING." << std::endl;
+                    LOG_ERROR("SESSION", "$34 received outside UPDATE_PENDING.");
                     g_dtc_manager.set_dtc(DTC::INVALID_UDS_SEQUENCE);
                     break;
                 }
-                if (m_payload.size() < 10) break;
+                if (m_payload.size() < 3) break;
 
-                m_firmware_file_size = ((uint32_t)m_payload[6] << 24)
-                                     | ((uint32_t)m_payload[7] << 16)
-                                     | ((uint32_t)m_payload[8] <<  8)
-                                     |  (uint32_t)m_payload[9];
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cout << "[SESSION] $34 RequestDownload — size: "
-                              << m_firmware_file_size << " bytes." << std::endl;
+                uint8_t dfi        = m_payload[1];
+                size_t  addr_len   = m_payload[2] & 0x0F;
+                size_t  size_len   = m_payload[2] >> 4;
+                if (size_len == 0 || size_len > 4 || addr_len > 4
+                    || m_payload.size() < 3 + addr_len + size_len) {
+                    // Negative response: incorrectMessageLengthOrInvalidFormat (0x13)
+                    do_write_generic_response(0x8001, {0x7F, 0x34, 0x13});
+                    return;
+                }
+                uint8_t compression = dfi >> 4;
+                uint8_t encryption  = dfi & 0x0F;
+                if (encryption != 0x0 || compression > static_cast<uint8_t>(TransferEncoding::ZLIB_DELTA)) {
+                    // Negative response: requestOutOfRange (0x31)
+                    do_write_generic_response(0x8001, {0x7F, 0x34, 0x31});
+                    return;
                 }
 
-                m_update_file.open("update.bin", std::ios::binary | std::ios::trunc);
-                if (!m_update_file.is_open()) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] CRITICAL: Cannot open update.bin." << std::endl;
-                    g_dtc_manager.set_dtc(DTC::OTA_FILE_WRITE_ERROR);
-                    break;
+                uint32_t memory_address = 0;
+                for (size_t i = 0; i < addr_len; ++i)
+                    memory_address = (memory_address << 8) | m_payload[3 + i];
+                uint32_t firmware_file_size = 0;
+                for (size_t i = 0; i < size_len; ++i)
+                    firmware_file_size = (firmware_file_size << 8) | m_payload[3 + addr_len + i];
+
+                std::optional<DownloadIdentity> identity = m_pending_identity;
+                m_pending_identity.reset();
+                if (identity && (identity->data_format != dfi || identity->image_size != firmware_file_size))
+                    identity.reset();
+
+                if (memory_address != 0) {
+                    auto resumed = identity ? g_download_registry.take(*identity, memory_address) : nullptr;
+                    if (!resumed) {
+                        LOG_ERROR("SESSION", "$34 resume at offset %u does not match a parked download.",
+                                  memory_address);
+                        // Negative response: requestOutOfRange (0x31)
+                        do_write_generic_response(0x8001, {0x7F, 0x34, 0x31});
+                        return;
+                    }
+                    retire_download();
+                    m_download = std::move(resumed);
+                    LOG_INFO("SESSION", "$34 RequestDownload — resuming at offset %u (%u/%u image bytes).",
+                             memory_address, m_download->bytes_received(), firmware_file_size);
+                    do_write_generic_response(0x8001, build_request_download_response(g_config.max_block_length));
+                    return;
                 }
-                m_bytes_received = 0;
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cout << "[SESSION] update.bin opened. Ready for transfer." << std::endl;
+
+                auto encoding = static_cast<TransferEncoding>(compression);
+                LOG_INFO("SESSION", "$34 RequestDownload — size: %u bytes%s%s", firmware_file_size,
+                         has_encoding(encoding, TransferEncoding::DELTA) ? ", delta patch" : "",
+                         has_encoding(encoding, TransferEncoding::ZLIB) ? ", zlib-compressed." : ".");
+
+                // A delta is patched against the image that passed secure boot.
+                DeltaPatcher::Base delta_base;
+                if (has_encoding(encoding, TransferEncoding::DELTA)) {
+                    auto golden = g_nvram.get_string("FIRMWARE_HASH_GOLDEN");
+                    if (!golden) {
+                        // Negative response: conditionsNotCorrect (0x22)
+                        do_write_generic_response(0x8001, {0x7F, 0x34, 0x22});
+                        return;
+                    }
+                    delta_base = {g_executable_path, *golden};
                 }
-                do_write_generic_response(0x8001, {0x74, 0x20, 0x10, 0x00});
+
+                // The image is staged straight into the inactive A/B slot.
+                // Claim it first: the previous owner (ours, a parked one or
+                // another session's) is aborted and its writer joined on
+                // g_workers before open() truncates the file.
+                retire_download();
+                const std::string staging_path = g_slots.staging_path();
+                auto download = std::make_shared<FirmwareDownload>();
+                if (identity) download->set_identity(*identity);
+                if (g_config.boot_hash == ImageHash::MERKLE) download->enable_merkle();
+                auto previous = g_download_registry.claim(download);
+                run_with_response_pending(0x34,
+                    [download, previous, staging_path, firmware_file_size, encoding,
+                     delta_base = std::move(delta_base)]() mutable {
+                        if (previous) previous->abort_and_wait();
+                        return download->open(staging_path, firmware_file_size, g_config.write_queue_depth,
+                                              encoding, std::move(delta_base));
+                    },
+                    [this, download, staging_path](bool ok) {
+                        if (!ok) {
+                            LOG_ERROR("SESSION", "CRITICAL: Cannot open %s (or the delta base).", staging_path.c_str());
+                            g_dtc_manager.set_dtc(DTC::OTA_FILE_WRITE_ERROR);
+                            // Negative response: uploadDownloadNotAccepted (0x70)
+                            do_write_generic_response(0x8001, {0x7F, 0x34, 0x70});
+                            return;
+                        }
+                        m_download = download;
+                        LOG_INFO("SESSION", "Staging into slot %c (%s). Ready for transfer.",
+                                 g_slots.inactive_slot(), staging_path.c_str());
+                        do_write_generic_response(0x8001, build_request_download_response(g_config.max_block_length));
+                    });
                 return;
             }
 
             // -----------------------------------------------------------------
             // $36 — TransferData
+            // Each block is hashed as it arrives and handed to the staged
+            // writer (see FirmwareDownload); $76 is sent once the block is
+            // queued, and is held back while the write queue is full.
+            // Testers may pipeline several blocks; they are processed in
+            // order and each $76 echoes the block's sequence counter.
             // -----------------------------------------------------------------
             case 0x36: {
-                if (g_ecu_state != EcuState::UPDATE_PENDING || !m_update_file.is_open()) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] $36 received in wrong state." << std::endl;
+                if (g_ecu_state != EcuState::UPDATE_PENDING || !m_download || m_payload.size() < 2) {
+                    LOG_ERROR("SESSION", "$36 received in wrong state.");
                     g_dtc_manager.set_dtc(DTC::INVALID_UDS_SEQUENCE);
                     break;
                 }
-                const char* data = reinterpret_cast<const char*>(m_payload.data() + 2);
-                size_t data_size = m_payload.size() - 2;
-                m_update_file.write(data, data_size);
-                m_bytes_received += data_size;
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cout << "[SESSION] $36 chunk " << (int)m_payload[1]
-                              << " — " << data_size << " bytes ("
-                              << m_bytes_received << "/" << m_firmware_file_size << ")" << std::endl;
-                }
-                do_write_generic_response(0x8001, {0x76, m_payload[1]});
+                if (m_payload.size() > g_config.max_block_length) {
+                    // Negative response: incorrectMessageLengthOrInvalidFormat (0x13)
+                    do_write_generic_response(0x8001, {0x7F, 0x36, 0x13});
+                    return;
+                }
+                uint8_t block_counter = m_payload[1];
+                size_t  data_size     = m_payload.size() - 2;
+
+                // blockSequenceCounter: starts at 0x01 and wraps 0xFF -> 0x00.
+                // A repeat of the last accepted block (lost $76) is re-acked
+                // without being written again.
+                if (m_download->is_repeat_block(block_counter)) {
+                    do_write_generic_response(0x8001, {0x76, block_counter});
+                    return;
+                }
+                if (block_counter != m_download->next_block_counter()) {
+                    LOG_WARN("SESSION", "$36 wrong block counter 0x%02X (expected 0x%02X)",
+                             block_counter, m_download->next_block_counter());
+                    // Negative response: wrongBlockSequenceCounter (0x73)
+                    do_write_generic_response(0x8001, {0x7F, 0x36, 0x73});
+                    return;
+                }
+                if (m_download->exceeds_size(data_size)) {
+                    LOG_ERROR("SESSION", "$36 block 0x%02X goes past the %u bytes announced in $34.",
+                              block_counter, m_download->expected_size());
+                    retire_download();
+                    // Negative response: transferDataSuspended (0x71)
+                    do_write_generic_response(0x8001, {0x7F, 0x36, 0x71});
+                    return;
+                }
+                LOG_DEBUG("SESSION", "$36 chunk %d — %zu bytes (%llu/%u)", (int)block_counter, data_size,
+                          (unsigned long long)m_download->bytes_received() + data_size,
+                          m_download->expected_size());
+
+                auto self = shared_from_this();
+                m_download->async_append(std::move(m_payload), 2, m_socket.get_executor(),
+                    [this, self, block_counter](bool ok) {
+                        if (!ok) {
+                            LOG_ERROR("SESSION", "CRITICAL: Write, decompression or patching of the staged image failed.");
+                            g_dtc_manager.set_dtc(DTC::OTA_FILE_WRITE_ERROR);
+                            retire_download();
+                            // Negative response: generalProgrammingFailure (0x72)
+                            do_write_generic_response(0x8001, {0x7F, 0x36, 0x72});
+                            return;
+                        }
+                        do_write_generic_response(0x8001, {0x76, block_counter});
+                    });
                 return;
             }
 
             // -----------------------------------------------------------------
             // $37 — RequestTransferExit
-            //
-            // Payload format (Phase 7 — ECDSA):
-            //   [0x37, sig_len_H, sig_len_L, <DER signature bytes>]
-            //
-            // The ECU verifies the ECDSA P-256 signature of the SHA-256 digest
-            // of update.bin using the embedded public key (firmware_signing_pub.pem).
-            //
-            // Fallback (legacy / no sig file): if sig_len == 0, falls back to
-            // SHA-256 hash comparison (payload = [0x37, 0x00, 0x00, <hash_string>]).
+            // Drains the staged writer, then verifies and switches slots in
+            // complete_transfer_exit(), answering 7F 37 78 until that is done.
             // -----------------------------------------------------------------
             case 0x37: {
-                if (g_ecu_state != EcuState::UPDATE_PENDING || !m_update_file.is_open()) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] $37 received in wrong state." << std::endl;
+                if (g_ecu_state != EcuState::UPDATE_PENDING || !m_download) {
+                    LOG_ERROR("SESSION", "$37 received in wrong state.");
                     g_dtc_manager.set_dtc(DTC::INVALID_UDS_SEQUENCE);
                     break;
                 }
-                m_update_file.close();
-
                 if (m_payload.size() < 3) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] $37 payload too short." << std::endl;
+                    LOG_ERROR("SESSION", "$37 payload too short.");
                     break;
                 }
 
-                uint16_t sig_len = ((uint16_t)m_payload[1] << 8) | m_payload[2];
-                bool verify_ok = false;
-
-                if (sig_len > 0 && m_payload.size() >= 3u + sig_len) {
-                    // --- ECDSA verification path ---
-                    std::vector<uint8_t> signature(m_payload.begin() + 3,
-                                                   m_payload.begin() + 3 + sig_len);
-                    {
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cout << "[SESSION] Verifying ECDSA signature ("
-                                  << sig_len << " bytes)..." << std::endl;
-                    }
-
-                    ECDSAVerifier verifier;
-                    if (verifier.load_public_key("firmware_signing_pub.pem")) {
-                        verify_ok = verifier.verify_file("update.bin", signature);
-                    } else {
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cerr << "[SESSION] Public key unavailable — OTA aborted." << std::endl;
-                        g_dtc_manager.set_dtc(DTC::OTA_HASH_MISMATCH);
-                    }
-                } else {
-                    // --- Legacy SHA-256 hash comparison path ---
-                    auto calc_hash = calculate_file_hash("update.bin");
-                    if (!calc_hash) {
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cerr << "[SESSION] Could not hash update.bin." << std::endl;
-                        break;
-                    }
-                    std::string expected_hash(m_payload.begin() + 3, m_payload.end());
-                    {
-                        std::lock_guard<std::mutex> lk(g_console_mutex);
-                        std::cout << "[SESSION] (Legacy mode) Hash verification" << std::endl;
-                        std::cout << "  -> Expected:   " << expected_hash << std::endl;
-                        std::cout << "  -> Calculated: " << *calc_hash   << std::endl;
-                    }
-                    verify_ok = (*calc_hash == expected_hash);
-                    if (!verify_ok) g_dtc_manager.set_dtc(DTC::OTA_HASH_MISMATCH);
-                }
-
-                if (verify_ok) {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cout << "[SESSION] Firmware verification PASSED. Applying update." << std::endl;
-                    do_write_generic_response(0x8001, {0x77});
-                    apply_update(g_executable_path);
-                } else {
-                    g_dtc_manager.set_dtc(DTC::OTA_HASH_MISMATCH);
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] !!! VERIFICATION FAILED — OTA aborted." << std::endl;
-                }
+                // Wait for the staged writer to drain before verifying.
+                auto self     = shared_from_this();
+                auto download = std::move(m_download);
+                download->async_finish(m_socket.get_executor(),
+                    [this, self, download](bool ok) {
+                        if (!ok) {
+                            LOG_ERROR("SESSION", "Could not finalize the staged image.");
+                            g_dtc_manager.set_dtc(DTC::OTA_FILE_WRITE_ERROR);
+                            // Negative response: generalProgrammingFailure (0x72)
+                            do_write_generic_response(0x8001, {0x7F, 0x37, 0x72});
+                            return;
+                        }
+                        complete_transfer_exit(download);
+                    });
                 return;
             }
 
@@ -441,74 +718,262 @@ private:
         }
 
         // Fell through — unsupported or out-of-sequence
-        {
-            std::lock_guard<std::mutex> lk(g_console_mutex);
-            printf("[SESSION] Unsupported/out-of-sequence UDS SID=0x%02X\n", sid);
-        }
+        LOG_WARN("SESSION", "Unsupported/out-of-sequence UDS SID=0x%02X", sid);
         do_read_header();
     }
 
     // -----------------------------------------------------------------------
-    // Write helpers
+    // $74 response with the smallest lengthFormatIdentifier that fits
     // -----------------------------------------------------------------------
-    void do_write_generic_response(uint16_t payload_type,
-                                    const std::vector<uint8_t>& payload) {
-        auto self = shared_from_this();
-        auto hdr  = std::make_shared<DoIPHeader>();
-        hdr->protocol_version        = 0x02;
-        hdr->inverse_protocol_version = ~hdr->protocol_version;
-        hdr->payload_type            = htons(payload_type);
-        hdr->payload_length          = htonl(static_cast<uint32_t>(payload.size()));
-
-        std::vector<boost::asio::const_buffer> bufs;
-        bufs.push_back(boost::asio::buffer(hdr.get(), sizeof(DoIPHeader)));
-        bufs.push_back(boost::asio::buffer(payload));
-
-        boost::asio::async_write(m_socket, bufs,
-            [this, self, hdr](const boost::system::error_code& ec, std::size_t) {
-                if (!ec) {
-                    do_read_header();
-                } else {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cerr << "[SESSION] Write error: " << ec.message() << std::endl;
+    static std::vector<uint8_t> build_request_download_response(uint32_t max_block_length) {
+        uint8_t width = 1;
+        while (width < 4 && (max_block_length >> (8 * width)) != 0) ++width;
+
+        std::vector<uint8_t> rsp = {0x74, static_cast<uint8_t>(width << 4)};
+        for (int shift = 8 * (width - 1); shift >= 0; shift -= 8)
+            rsp.push_back(static_cast<uint8_t>((max_block_length >> shift) & 0xFF));
+        return rsp;
+    }
+
+    // -----------------------------------------------------------------------
+    // $37 — RequestTransferExit, second half
+    //
+    // Payload format (Phase 7 — ECDSA):
+    //   [0x37, sig_len_H, sig_len_L, <DER signature bytes>]
+    //
+    // The ECU verifies the ECDSA P-256 signature of the SHA-256 digest
+    // of the staged image with the public key g_crypto loaded at start
+    // (--signing-key, default firmware_signing_pub.pem).
+    // The digest was accumulated during $36, so only the signature
+    // check remains here.
+    //
+    // Fallback (legacy / no sig file): if sig_len == 0, falls back to
+    // SHA-256 hash comparison (payload = [0x37, 0x00, 0x00, <hash_string>]).
+    // With --boot-hash merkle the image's Merkle root is accepted as well.
+    //
+    // Verification and the slot switch run on g_workers. Response: $77,
+    // then the ECU resets once it is sent; 7F 37 72 (generalProgramming-
+    // Failure) if the image is rejected or the switch fails.
+    // -----------------------------------------------------------------------
+    void complete_transfer_exit(std::shared_ptr<FirmwareDownload> download) {
+        if (const StreamInflater* inf = download->inflater()) {
+            LOG_INFO("SESSION", "Transfer stats: %llu wire bytes -> %u image bytes "
+                   "(ratio %.2fx), inflate %.1f MB/s",
+                   (unsigned long long)download->wire_bytes(), download->bytes_received(),
+                   download->wire_bytes() ? (double)download->bytes_received() / download->wire_bytes() : 0.0,
+                   inf->seconds() > 0 ? inf->bytes_out() / inf->seconds() / (1024.0 * 1024.0) : 0.0);
+        }
+        if (const DeltaPatcher* patch = download->patcher()) {
+            LOG_INFO("SESSION", "Delta stats: %llu patch bytes -> %llu image bytes "
+                   "(%llu from base, %llu literal), patch %.1f MB/s",
+                   (unsigned long long)patch->bytes_in(), (unsigned long long)patch->bytes_out(),
+                   (unsigned long long)patch->copied_bytes(), (unsigned long long)patch->literal_bytes(),
+                   patch->seconds() > 0 ? patch->bytes_out() / patch->seconds() / (1024.0 * 1024.0) : 0.0);
+        }
+
+        uint16_t sig_len = ((uint16_t)m_payload[1] << 8) | m_payload[2];
+        std::vector<uint8_t> signature;
+        std::string          expected_hash;
+        if (sig_len > 0 && m_payload.size() >= 3u + sig_len)
+            signature.assign(m_payload.begin() + 3, m_payload.begin() + 3 + sig_len);
+        else
+            expected_hash.assign(m_payload.begin() + 3, m_payload.end());
+
+        run_with_response_pending(0x37,
+            [download, signature = std::move(signature), expected_hash = std::move(expected_hash)] {
+                if (!verify_image(*download, signature, expected_hash)) {
+                    g_dtc_manager.set_dtc(DTC::OTA_HASH_MISMATCH);
+                    LOG_ERROR("SESSION", "!!! VERIFICATION FAILED — OTA aborted; slot %c stays active.",
+                              g_slots.active_slot());
+                    return false;
+                }
+                LOG_INFO("SESSION", "Firmware verification PASSED. Applying update.");
+                return apply_update(download->digest_hex(), download->merkle_hex());
+            },
+            [this](bool ok) {
+                if (!ok) {
+                    // Negative response: generalProgrammingFailure (0x72)
+                    do_write_generic_response(0x8001, {0x7F, 0x37, 0x72});
+                    return;
                 }
+                m_after_write = reset_after_update;   // Reset only once $77 is out
+                do_write_generic_response(0x8001, {0x77});
             });
     }
 
-    void do_write_vehicle_announcement() {
+    /// The prebuilt single-DID response for @p did, if it has one.
+    static std::optional<CachedResponse> cached_did(uint16_t did) {
+        switch (did) {
+            case DataID::FW_VERSION: return CachedResponse::FW_VERSION;
+            case DataID::ECU_SERIAL: return CachedResponse::ECU_SERIAL;
+            default:                 return std::nullopt;
+        }
+    }
+
+    /// Signature (or legacy digest) check of a finished download. Runs on g_workers.
+    static bool verify_image(const FirmwareDownload& download, const std::vector<uint8_t>& signature,
+                             const std::string& expected_hash) {
+        if (!signature.empty()) {
+            // --- ECDSA verification path ---
+            LOG_INFO("SESSION", "Verifying ECDSA signature (%zu bytes)...", signature.size());
+            if (!g_crypto.has_key()) {
+                LOG_ERROR("SESSION", "Public key unavailable — OTA aborted.");
+                return false;
+            }
+            return g_crypto.verify_digest(download.digest(), signature);
+        }
+
+        // --- Legacy SHA-256 hash comparison path ---
+        std::string calc_hash = download.digest_hex();
+        std::string merkle    = download.merkle_hex();
+        LOG_INFO("SESSION", "(Legacy mode) Hash verification");
+        LOG_INFO("", "  -> Expected:   %s", expected_hash.c_str());
+        LOG_INFO("", "  -> Calculated: %s", calc_hash.c_str());
+        if (!merkle.empty()) LOG_INFO("", "  -> Merkle:     %s", merkle.c_str());
+        return calc_hash == expected_hash || (!merkle.empty() && merkle == expected_hash);
+    }
+
+    /// Drop m_download. Its writer thread is joined on g_workers: that can
+    /// wait for a disk write, which must not stall this session's strand.
+    void retire_download() {
+        if (!m_download) return;
+        g_workers->post([download = std::move(m_download)] { download->abort_and_wait(); });
+    }
+
+    // -----------------------------------------------------------------------
+    // Long requests: worker pool + responsePending
+    //
+    // @p job runs on g_workers, so the I/O threads (and every other
+    // session) are never held up by it. If it has not finished within
+    // P2server, 7F <sid> 78 (requestCorrectlyReceived-ResponsePending) is
+    // sent, and repeated every --response-pending-ms until it has.
+    // @p done(result) then runs on this session's strand and must send the
+    // final response. No further request of this session is read meanwhile.
+    // -----------------------------------------------------------------------
+    static constexpr std::chrono::milliseconds P2_SERVER{50};
+
+    template <typename Job, typename Done>
+    void run_with_response_pending(uint8_t sid, Job job, Done done) {
+        arm_response_pending(sid, ++m_pending_generation, P2_SERVER);
+
         auto self = shared_from_this();
-        std::string vin = "VECU-SIM-1234567";
-        std::vector<uint8_t> payload(vin.begin(), vin.end());
-
-        auto hdr = std::make_shared<DoIPHeader>();
-        hdr->protocol_version         = 0x02;
-        hdr->inverse_protocol_version = ~hdr->protocol_version;
-        hdr->payload_type             = htons(0x0005);
-        hdr->payload_length           = htonl(static_cast<uint32_t>(payload.size()));
-
-        std::vector<boost::asio::const_buffer> bufs;
-        bufs.push_back(boost::asio::buffer(hdr.get(), sizeof(DoIPHeader)));
-        bufs.push_back(boost::asio::buffer(payload));
-
-        boost::asio::async_write(m_socket, bufs,
-            [this, self, hdr](const boost::system::error_code& ec, std::size_t bytes) {
-                std::lock_guard<std::mutex> lk(g_console_mutex);
-                if (!ec) {
-                    std::cout << "[SESSION] Vehicle announcement sent (" << bytes << " bytes)." << std::endl;
-                    do_read_header();
+        g_workers->post([this, self, job = std::move(job), done = std::move(done)]() mutable {
+            auto result = job();
+            boost::asio::post(m_socket.get_executor(),
+                [this, self, result, done = std::move(done)]() mutable {
+                    ++m_pending_generation;   // Stop the 0x78s
+                    m_pending_timer.cancel();
+                    done(result);
+                });
+        });
+    }
+
+    void arm_response_pending(uint8_t sid, uint32_t generation, std::chrono::milliseconds delay) {
+        m_pending_timer.expires_after(delay);
+        auto self = shared_from_this();
+        m_pending_timer.async_wait([this, self, sid, generation](const boost::system::error_code& ec) {
+            if (ec || generation != m_pending_generation) return;   // Job already answered
+            LOG_DEBUG("SESSION", "$%02X still running — responsePending.", sid);
+            queue_frame(build_frame(0x8001, {0x7F, sid, 0x78}));
+            arm_response_pending(sid, generation, std::chrono::milliseconds(g_config.response_pending_ms));
+        });
+    }
+
+    // -----------------------------------------------------------------------
+    // Write helpers
+    // -----------------------------------------------------------------------
+    //
+    // Responses are queued as self-contained frames (header + payload in one
+    // buffer) and written strictly in order. Reading the next request does
+    // not wait for the write to finish, so a tester may pipeline requests.
+    // m_after_write, if set, runs once the queue has drained (or the
+    // connection is gone).
+    // -----------------------------------------------------------------------
+    using Frame = std::shared_ptr<const std::vector<uint8_t>>;
+
+    static Frame build_frame(uint16_t payload_type, const std::vector<uint8_t>& payload) {
+        DoIPHeader hdr;
+        hdr.protocol_version         = 0x02;
+        hdr.inverse_protocol_version = ~hdr.protocol_version;
+        hdr.payload_type             = htons(payload_type);
+        hdr.payload_length           = htonl(static_cast<uint32_t>(payload.size()));
+
+        auto frame = std::make_shared<std::vector<uint8_t>>(sizeof(DoIPHeader) + payload.size());
+        std::memcpy(frame->data(), &hdr, sizeof(DoIPHeader));
+        if (!payload.empty())
+            std::memcpy(frame->data() + sizeof(DoIPHeader), payload.data(), payload.size());
+        return frame;
+    }
+
+    void queue_frame(Frame frame) {
+        m_write_queue.push_back(std::move(frame));
+        if (m_write_queue.size() == 1) do_write_next();
+    }
+
+    void do_write_next() {
+        auto self = shared_from_this();
+        boost::asio::async_write(m_socket, boost::asio::buffer(*m_write_queue.front()),
+            [this, self](const boost::system::error_code& ec, std::size_t) {
+                if (ec) {
+                    m_write_queue.clear();
+                    LOG_ERROR("SESSION", "Write error: %s", ec.message().c_str());
                 } else {
-                    std::cerr << "[SESSION] Write error: " << ec.message() << std::endl;
+                    m_write_queue.pop_front();
+                    if (!m_write_queue.empty()) {
+                        do_write_next();
+                        return;
+                    }
                 }
+                if (m_after_write) std::exchange(m_after_write, nullptr)();
             });
     }
 
+    void do_write_generic_response(uint16_t payload_type,
+                                    const std::vector<uint8_t>& payload) {
+        do_write_frame(build_frame(payload_type, payload));
+    }
+
+    void do_write_frame(Frame frame) {
+        queue_frame(std::move(frame));
+        do_read_header();
+    }
+
+    // Periodic $2A data. A tester that does not keep up loses samples
+    // rather than growing the write queue without bound.
+    static constexpr size_t MAX_QUEUED_PERIODIC = 8;
+
+    void send_periodic(std::vector<uint8_t> payload) {
+        if (m_write_queue.size() >= MAX_QUEUED_PERIODIC) {
+            ++m_periodic_dropped;
+            LOG_DEBUG("SESSION", "$2A sample dropped (%llu so far); tester is not reading.",
+                      static_cast<unsigned long long>(m_periodic_dropped));
+            return;
+        }
+        queue_frame(build_frame(0x8001, payload));
+    }
+
+    void do_write_vehicle_announcement() {
+        Frame frame = g_responses.get(CachedResponse::VEHICLE_ANNOUNCEMENT).frame;
+        LOG_DEBUG("SESSION", "Vehicle announcement queued (%zu bytes).", frame ? frame->size() : 0);
+        if (frame) {
+            do_write_frame(std::move(frame));
+        } else {
+            do_read_header();
+        }
+    }
+
     // -----------------------------------------------------------------------
     // Member data
     // -----------------------------------------------------------------------
     tcp::socket           m_socket;
     DoIPHeader            m_received_header;
     std::vector<uint8_t>  m_payload;
-    std::ofstream         m_update_file;
-    uint32_t              m_firmware_file_size;
-    uint32_t              m_bytes_received;
+    std::shared_ptr<FirmwareDownload> m_download;   // Non-null between $34 and $37
+    std::deque<Frame>     m_write_queue;                // Front is being written
+    std::optional<DownloadIdentity> m_pending_identity; // From $31 0xFF01, consumed by $34
+    boost::asio::steady_timer m_pending_timer;          // Paces 7F <SID> 78
+    uint32_t              m_pending_generation = 0;     // Bumped when a long request answers
+    std::function<void()> m_after_write;                // Run when m_write_queue drains
+    PeriodicScheduler     m_periodic;                   // $2A subscriptions
+    uint64_t              m_periodic_dropped = 0;
 };
@@ -0,0 +1,78 @@
+#pragma once
+
+/**
+ * @file download_registry.hpp
+ * @brief Keeps an interrupted OTA download alive so a tester can resume it.
+ *
+ * When a DoIPSession dies mid-transfer, its FirmwareDownload — staging file,
+ * staged writer, running digest, inflater and block counter — is parked
+ * here instead of being destroyed. A reconnecting tester queries the
+ * resume point with RoutineControl $31 01 FF01 and continues with a $34
+ * whose memoryAddress is that offset.
+ *
+ * There is one staging file, so one download owns it at a time: a fresh
+ * $34 claim()s the slot and aborts the previous owner — parked, or still
+ * held by another session — before the file is truncated. Only the owner
+ * can be parked. A parked download is matched by DownloadIdentity: data format, image
+ * size and the tester-supplied 32-byte image id (SHA-256 of the image).
+ */
+
+#include <memory>
+#include <mutex>
+
+#include "firmware_download.hpp"
+
+class DownloadRegistry {
+public:
+    /**
+     * @brief Make @p download the owner of the staging slot.
+     * @return The previous owner (still transferring in some session, or
+     *         parked), or nullptr. The caller must abort_and_wait() it
+     *         before truncating the staging file.
+     */
+    std::shared_ptr<FirmwareDownload> claim(const std::shared_ptr<FirmwareDownload>& download) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto previous = m_active.lock();
+        m_active = download;
+        m_parked.reset();
+        return previous;
+    }
+
+    /**
+     * @brief Park an unfinished download for a later resume.
+     * @return false if another download has claimed the staging slot since;
+     *         the caller then has to retire @p download itself.
+     */
+    bool park(const std::shared_ptr<FirmwareDownload>& download) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (m_active.lock() != download) return false;
+        m_parked = download;
+        return true;
+    }
+
+    /**
+     * @brief Look up the resume point for @p id without claiming it.
+     * @return The parked download if its identity matches, else nullptr.
+     */
+    std::shared_ptr<const FirmwareDownload> find(const DownloadIdentity& id) const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (m_parked && m_parked->identity() == id) return m_parked;
+        return nullptr;
+    }
+
+    /**
+     * @brief Take over the parked download if it matches @p id at @p wire_offset.
+     * @return The download (no longer parked, still owning the slot), or nullptr.
+     */
+    std::shared_ptr<FirmwareDownload> take(const DownloadIdentity& id, uint64_t wire_offset) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (!m_parked || !(m_parked->identity() == id) || m_parked->wire_bytes() != wire_offset)
+            return nullptr;
+        return std::move(m_parked);
+    }
+
+private:
+    mutable std::mutex                m_mutex;
+    std::weak_ptr<FirmwareDownload>   m_active;   // Owns the staging slot
+    std::shared_ptr<FirmwareDownload> m_parked;   // Kept alive for a resume; also m_active
+};
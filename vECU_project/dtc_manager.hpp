@@ -5,9 +5,9 @@
  * @brief Diagnostic Trouble Code (DTC) manager for the virtual ECU.
  *
  * Implements a UDS-compatible DTC subsystem. DTCs are stored in NVRAM as a
- * comma-separated list under the key "ACTIVE_DTCS". Each DTC is a 3-byte
- * code encoded as a 6-character uppercase hex string (e.g., "P0300" -> "P0300"
- * or raw 3-byte: 0x000001 -> "000001").
+ * BLOB under the key "ACTIVE_DTCS": one 4-byte record per DTC, the 3-byte
+ * code followed by its status byte. In the text NVRAM format that is a
+ * comma-separated list of 8-digit uppercase hex records ("HHMMLLSS,...").
  *
  * Standard DTC format (ISO 14229 / ISO 15031-6):
  *   Byte 1: High byte  (category + code)
@@ -18,15 +18,49 @@
  *   Bit 0: testFailed (currently active)
  *   Bit 3: confirmedDTC
  *   Bit 5: pendingDTC
+ *
+ * Storage: entries live in a dense vector (insertion order, used for
+ * persistence) indexed by code (hash map to the entry's slot) and by group
+ * (the code's high byte), so set/lookup are O(1) and a group clear touches
+ * only that group. Published snapshots add a status-bit index, so a $19
+ * status-mask read touches only DTCs with one of the requested bits when
+ * that is cheaper than a full scan.
+ *
+ * Concurrency (RCU-style, single writer):
+ *   - One writer thread owns the store. set_dtc() only appends to a
+ *     mutation queue and returns; clears, load() and flush() queue their
+ *     request and wait for the writer's reply.
+ *   - After each batch of mutations the writer publishes an immutable
+ *     DTCSnapshot through an atomically swapped shared_ptr. Readers
+ *     (get_all(), status_of(), build_read_dtc_response()) take the current
+ *     snapshot and never wait for the writer, the queue or NVRAM I/O.
+ *   - A set_dtc() becomes visible to readers once the writer has drained
+ *     it (normally within microseconds); a clear is visible when it returns.
+ *
+ * Persistence: the writer also commits the list to NVRAM. By default every
+ * batch that changed something is saved at once. With set_flush_interval()
+ * > 0 it is write-behind instead: changes are coalesced into at most one
+ * save per interval. flush() commits synchronously; call it before anything
+ * that must see the DTCs on disk (shutdown, slot switch, exec).
  */
 
-#include <iostream>
 #include <vector>
+#include <array>
 #include <string>
-#include <sstream>
-#include <iomanip>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include "nvram_manager.hpp"
+#include "logger.hpp"
 
 // ---------------------------------------------------------------------------
 // Well-known DTC codes used by this ECU simulation
@@ -37,7 +71,7 @@ namespace DTC {
     constexpr uint32_t SECURE_BOOT_FAILURE       = 0x000001; // P0001 analog - integrity check failed
     constexpr uint32_t NVRAM_LOAD_FAILURE        = 0x000002; // NVRAM could not be read
     constexpr uint32_t OTA_HASH_MISMATCH         = 0x000010; // Received firmware failed hash check
-    constexpr uint32_t OTA_FILE_WRITE_ERROR      = 0x000011; // Could not write update.bin
+    constexpr uint32_t OTA_FILE_WRITE_ERROR      = 0x000011; // Could not write the staged image
     constexpr uint32_t INVALID_UDS_SEQUENCE      = 0x000020; // UDS command received out of sequence
     constexpr uint32_t ENGINE_OVERTEMP           = 0x000030; // Simulated sensor fault
     constexpr uint32_t FAN_CONTROL_FAULT         = 0x000031; // Fan did not activate on overtemp
@@ -46,6 +80,26 @@ namespace DTC {
     constexpr uint8_t STATUS_TEST_FAILED   = 0x01;
     constexpr uint8_t STATUS_CONFIRMED     = 0x08;
     constexpr uint8_t STATUS_PENDING       = 0x20;
+
+    // groupOfDTC ($14): all DTCs, or every code sharing the high byte
+    // (0xHH0000), or one exact code.
+    constexpr uint32_t GROUP_ALL             = 0xFFFFFF;
+    constexpr uint8_t  group_of(uint32_t code) { return static_cast<uint8_t>((code >> 16) & 0xFF); }
+
+    constexpr uint32_t DEFINED[] = {
+        SECURE_BOOT_FAILURE, NVRAM_LOAD_FAILURE, OTA_HASH_MISMATCH, OTA_FILE_WRITE_ERROR,
+        INVALID_UDS_SEQUENCE, ENGINE_OVERTEMP, FAN_CONTROL_FAULT,
+    };
+
+    /// True if @p group names a defined code, or is 0xHH0000 with a defined
+    /// code whose high byte is HH.
+    constexpr bool is_defined_group(uint32_t group) {
+        for (uint32_t code : DEFINED) {
+            if (code == group) return true;
+            if ((group & 0xFFFF) == 0 && group_of(code) == group_of(group)) return true;
+        }
+        return false;
+    }
 }
 
 // ---------------------------------------------------------------------------
@@ -57,92 +111,280 @@ struct DTCEntry {
 };
 
 // ---------------------------------------------------------------------------
-// DTCManager
+// DTCStore: the indexed DTC list. Not synchronized — owned by the
+// DTCManager writer thread.
 // ---------------------------------------------------------------------------
-class DTCManager {
+class DTCStore {
 public:
-    explicit DTCManager(NVRAMManager& nvram) : m_nvram(nvram) {}
+    const std::vector<DTCEntry>&                entries() const { return m_dtcs; }
+    const std::unordered_map<uint32_t, size_t>& by_code() const { return m_by_code; }
+
+    /// OR @p status into @p code, adding it if new. @return true if anything changed.
+    bool set(uint32_t code, uint8_t status) {
+        auto it = m_by_code.find(code);
+        if (it != m_by_code.end()) {
+            DTCEntry& e = m_dtcs[it->second];
+            if ((e.status | status) == e.status) return false;   // Nothing new to store
+            e.status |= status;
+            LOG_INFO("DTC", "Updated existing DTC 0x%06X status=0x%X", code, e.status);
+            return true;
+        }
+        m_by_code.emplace(code, m_dtcs.size());
+        m_by_group[DTC::group_of(code)].insert(code);
+        m_dtcs.push_back({code, status});
+        LOG_INFO("DTC", "Set new DTC 0x%06X status=0x%X", code, status);
+        return true;
+    }
 
     /**
-     * @brief Load DTCs from NVRAM into memory.
-     *  Format stored: "HHMMLLSS,HHMMLLSS,..." (4-byte hex per entry)
+     * @brief Remove a groupOfDTC: DTC::GROUP_ALL, an exact code, or
+     *        0xHH0000 for every code whose high byte is HH.
+     * @return Number of DTCs removed, or std::nullopt if @p group is not
+     *         supported: neither a defined nor a stored code, nor the high
+     *         byte of one.
      */
-    void load() {
+    std::optional<size_t> clear_group(uint32_t group) {
+        size_t removed = 0;
+        if (group == DTC::GROUP_ALL) {
+            removed = m_dtcs.size();
+            clear();
+            LOG_INFO("DTC", "All DTCs cleared.");
+            return removed;
+        }
+        if (m_by_code.count(group)) {
+            erase(group);
+            removed = 1;
+        } else if ((group & 0xFFFF) == 0) {
+            auto& members = m_by_group[DTC::group_of(group)];
+            std::vector<uint32_t> codes(members.begin(), members.end());
+            for (uint32_t code : codes) erase(code);
+            removed = codes.size();
+        }
+        if (removed == 0 && !DTC::is_defined_group(group)) {
+            LOG_WARN("DTC", "Group 0x%06X is not supported.", group);
+            return std::nullopt;
+        }
+        LOG_INFO("DTC", "Cleared %zu DTC(s) in group 0x%06X.", removed, group);
+        return removed;
+    }
+
+    void clear() {
         m_dtcs.clear();
-        auto stored = m_nvram.get_string("ACTIVE_DTCS");
-        if (!stored || stored->empty() || *stored == "NONE") return;
-
-        std::stringstream ss(*stored);
-        std::string token;
-        while (std::getline(ss, token, ',')) {
-            if (token.size() == 8) {
-                uint32_t val = std::stoul(token, nullptr, 16);
-                DTCEntry e;
-                e.code   = (val >> 8) & 0xFFFFFF;
-                e.status = val & 0xFF;
-                m_dtcs.push_back(e);
-            }
+        m_by_code.clear();
+        for (auto& g : m_by_group) g.clear();
+    }
+
+    /// Replace the contents with an ACTIVE_DTCS value (packed records).
+    void parse(const std::vector<uint8_t>& stored) {
+        clear();
+        for (size_t i = 0; i + RECORD_SIZE <= stored.size(); i += RECORD_SIZE) {
+            uint32_t code = (uint32_t(stored[i]) << 16) | (uint32_t(stored[i + 1]) << 8) | stored[i + 2];
+            uint8_t  st   = stored[i + 3];
+            auto it = m_by_code.find(code);
+            if (it != m_by_code.end()) { m_dtcs[it->second].status |= st; continue; }
+            m_by_code.emplace(code, m_dtcs.size());
+            m_by_group[DTC::group_of(code)].insert(code);
+            m_dtcs.push_back({code, st});
+        }
+    }
+
+    /// Serialize in the ACTIVE_DTCS format.
+    std::vector<uint8_t> serialize() const {
+        std::vector<uint8_t> out;
+        out.reserve(m_dtcs.size() * RECORD_SIZE);
+        for (const auto& e : m_dtcs) {
+            out.push_back(static_cast<uint8_t>((e.code >> 16) & 0xFF));
+            out.push_back(static_cast<uint8_t>((e.code >> 8) & 0xFF));
+            out.push_back(static_cast<uint8_t>(e.code & 0xFF));
+            out.push_back(e.status);
+        }
+        return out;
+    }
+
+    static constexpr size_t RECORD_SIZE = 4;   // Code (3) + status (1)
+
+private:
+    // Removes by moving the last entry into the hole, so the relative
+    // order of the remaining entries is not fully preserved.
+    void erase(uint32_t code) {
+        auto it = m_by_code.find(code);
+        if (it == m_by_code.end()) return;
+        size_t slot = it->second;
+        m_by_group[DTC::group_of(code)].erase(code);
+        m_by_code.erase(it);
+        if (slot != m_dtcs.size() - 1) {
+            m_dtcs[slot] = m_dtcs.back();
+            m_by_code[m_dtcs[slot].code] = slot;
         }
-        std::cout << "[DTC] Loaded " << m_dtcs.size() << " DTC(s) from NVRAM." << std::endl;
+        m_dtcs.pop_back();
+    }
+
+    std::vector<DTCEntry>                         m_dtcs;       // Dense; slot = index
+    std::unordered_map<uint32_t, size_t>          m_by_code;    // code -> slot
+    std::array<std::unordered_set<uint32_t>, 256> m_by_group;   // high byte -> codes
+};
+
+// ---------------------------------------------------------------------------
+// DTCSnapshot: immutable copy of the store published to readers
+// ---------------------------------------------------------------------------
+class DTCSnapshot {
+public:
+    DTCSnapshot() = default;
+
+    explicit DTCSnapshot(const DTCStore& store)
+        : m_dtcs(store.entries()), m_by_code(store.by_code())
+    {
+        for (size_t slot = 0; slot < m_dtcs.size(); ++slot)
+            for (int bit = 0; bit < 8; ++bit)
+                if (m_dtcs[slot].status & (1u << bit)) m_slots_by_status_bit[bit].push_back(slot);
+    }
+
+    const std::vector<DTCEntry>& entries() const { return m_dtcs; }
+    size_t                       size()    const { return m_dtcs.size(); }
+
+    std::optional<uint8_t> status_of(uint32_t code) const {
+        auto it = m_by_code.find(code & 0xFFFFFF);
+        if (it == m_by_code.end()) return std::nullopt;
+        return m_dtcs[it->second].status;
     }
 
     /**
-     * @brief Persist current DTC list to NVRAM and flush to disk.
+     * @brief Call @p fn for every DTC whose status & @p mask != 0, in
+     *        storage order. Visits only the status-bit indexes when the
+     *        requested bits are rare.
      */
-    void save() {
-        if (m_dtcs.empty()) {
-            m_nvram.set_string("ACTIVE_DTCS", "NONE");
-        } else {
-            std::ostringstream oss;
-            for (size_t i = 0; i < m_dtcs.size(); ++i) {
-                if (i > 0) oss << ",";
-                uint32_t packed = ((m_dtcs[i].code & 0xFFFFFF) << 8) | m_dtcs[i].status;
-                oss << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << packed;
-            }
-            m_nvram.set_string("ACTIVE_DTCS", oss.str());
+    template <typename Fn>
+    void for_each_matching(uint8_t mask, Fn&& fn) const {
+        size_t indexed = 0;
+        for (int bit = 0; bit < 8; ++bit)
+            if (mask & (1u << bit)) indexed += m_slots_by_status_bit[bit].size();
+
+        if (indexed >= m_dtcs.size()) {
+            for (const auto& e : m_dtcs)
+                if (e.status & mask) fn(e);
+            return;
         }
-        m_nvram.save();
+        std::vector<size_t> slots;
+        slots.reserve(indexed);
+        for (int bit = 0; bit < 8; ++bit)
+            if (mask & (1u << bit))
+                slots.insert(slots.end(), m_slots_by_status_bit[bit].begin(), m_slots_by_status_bit[bit].end());
+        std::sort(slots.begin(), slots.end());
+        slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+        for (size_t slot : slots) fn(m_dtcs[slot]);
+    }
+
+private:
+    std::vector<DTCEntry>                m_dtcs;
+    std::unordered_map<uint32_t, size_t> m_by_code;
+    std::array<std::vector<size_t>, 8>   m_slots_by_status_bit;   // Ascending slots
+};
+
+// ---------------------------------------------------------------------------
+// DTCManager
+// ---------------------------------------------------------------------------
+class DTCManager {
+public:
+    explicit DTCManager(NVRAMManager& nvram)
+        : m_nvram(nvram),
+          m_snapshot(std::make_shared<const DTCSnapshot>()),
+          m_writer([this] { run_writer(); }) {}
+
+    /// Stops the writer, which commits anything still pending first.
+    ~DTCManager() {
+        enqueue({Op::Kind::STOP});
+        if (m_writer.joinable()) m_writer.join();
+    }
+
+    DTCManager(const DTCManager&)            = delete;
+    DTCManager& operator=(const DTCManager&) = delete;
+
+    /**
+     * @brief Select write-through (0) or write-behind (> 0) persistence.
+     *
+     * Takes effect from the writer's next wake-up.
+     */
+    void set_flush_interval(std::chrono::milliseconds interval) {
+        m_flush_interval_ms.store(interval.count(), std::memory_order_relaxed);
+        enqueue({Op::Kind::FLUSH});   // Wake the writer to pick it up
+    }
+
+    // --- Mutations (serialized through the writer thread) -------------------
+
+    /**
+     * @brief Load DTCs from NVRAM into memory, replacing the current list.
+     *  Stored as the ACTIVE_DTCS BLOB: packed 4-byte records, code (3) then
+     *  status (1). "HHMMLLSS,..." is only its text form (nvram_image.hpp).
+     */
+    void load() { call({Op::Kind::LOAD}); }
+
+    /**
+     * @brief Persist current DTC list to NVRAM and flush to disk.
+     */
+    void save() { call({Op::Kind::SAVE}); }
+
+    /**
+     * @brief Commit pending DTC changes to NVRAM now (no-op if clean).
+     *
+     * Waits for every mutation queued before the call.
+     * @return false if the NVRAM save failed (the changes stay pending).
+     */
+    bool flush() {
+        auto r = call({Op::Kind::FLUSH});
+        return !r || *r != 0;   // Writer already stopped: it committed on exit
     }
 
     /**
      * @brief Set (store) a DTC. If already present, OR the status byte.
+     *
+     * Never blocks on I/O: the change is queued for the writer thread.
      * @param code   24-bit DTC code (use DTC:: constants).
      * @param status Status byte flags (use DTC::STATUS_* constants).
      */
     void set_dtc(uint32_t code, uint8_t status = DTC::STATUS_TEST_FAILED | DTC::STATUS_CONFIRMED) {
-        for (auto& e : m_dtcs) {
-            if (e.code == code) {
-                e.status |= status;
-                std::cout << "[DTC] Updated existing DTC 0x"
-                          << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << code
-                          << " status=0x" << (int)e.status << std::dec << std::endl;
-                save();
-                return;
-            }
-        }
-        m_dtcs.push_back({code, status});
-        std::cout << "[DTC] Set new DTC 0x"
-                  << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << code
-                  << " status=0x" << (int)status << std::dec << std::endl;
-        save();
+        enqueue({Op::Kind::SET, code & 0xFFFFFF, status});
     }
 
     /**
      * @brief Clear all DTCs (UDS $14 ClearDiagnosticInformation).
      */
-    void clear_all() {
-        m_dtcs.clear();
-        std::cout << "[DTC] All DTCs cleared." << std::endl;
-        save();
-    }
+    void clear_all() { clear_group(DTC::GROUP_ALL); }
 
     /**
-     * @brief Return all stored DTCs (for UDS $19 ReadDTCInformation).
+     * @brief Clear one groupOfDTC (UDS $14).
+     * @param group DTC::GROUP_ALL, an exact code, or 0xHH0000 for every
+     *              code whose high byte is HH.
+     * @return Number of DTCs removed (visible to readers on return), or
+     *         std::nullopt if @p group is not supported (NRC 0x31) or the
+     *         writer has stopped.
      */
-    const std::vector<DTCEntry>& get_all() const {
-        return m_dtcs;
+    std::optional<size_t> clear_group(uint32_t group) {
+        auto r = call({Op::Kind::CLEAR_GROUP, group & 0xFFFFFF});
+        if (!r || *r == UNSUPPORTED_GROUP) return std::nullopt;
+        return r;
+    }
+
+    // --- Readers (lock-free w.r.t. the writer; see file comment) ------------
+
+    /// The latest published DTC list. Stays valid for as long as it is held.
+    std::shared_ptr<const DTCSnapshot> snapshot() const {
+        return std::atomic_load_explicit(&m_snapshot, std::memory_order_acquire);
     }
 
+    /**
+     * @brief Return a copy of all stored DTCs (for UDS $19 ReadDTCInformation).
+     */
+    std::vector<DTCEntry> get_all() const { return snapshot()->entries(); }
+
+    /// Status byte of @p code, or std::nullopt if it is not stored.
+    std::optional<uint8_t> status_of(uint32_t code) const { return snapshot()->status_of(code); }
+
+    size_t size() const { return snapshot()->size(); }
+
+    /// DTC changes made / NVRAM commits issued for them since startup.
+    uint64_t change_count() const { return m_changes.load(std::memory_order_relaxed); }
+    uint64_t commit_count() const { return m_commits.load(std::memory_order_relaxed); }
+
     /**
      * @brief Serialize all DTCs into a UDS $59 response payload.
      *
@@ -163,17 +405,179 @@ public:
         payload.push_back(0x02);              // Sub-function echo
         payload.push_back(0xFF);              // DTCStatusAvailabilityMask
 
-        for (const auto& e : m_dtcs) {
-            if ((e.status & status_mask) == 0) continue;
+        snapshot()->for_each_matching(status_mask, [&payload](const DTCEntry& e) {
             payload.push_back((e.code >> 16) & 0xFF);
             payload.push_back((e.code >>  8) & 0xFF);
             payload.push_back( e.code        & 0xFF);
             payload.push_back(e.status);
-        }
+        });
         return payload;
     }
 
 private:
-    NVRAMManager&       m_nvram;
-    std::vector<DTCEntry> m_dtcs;
+    struct Op {
+        enum class Kind : uint8_t { SET, CLEAR_GROUP, LOAD, SAVE, FLUSH, STOP };
+
+        Op(Kind k, uint32_t c = 0, uint8_t st = 0) : kind(k), code(c), status(st) {}
+
+        Kind     kind;
+        uint32_t code   = 0;
+        uint8_t  status = 0;
+        std::shared_ptr<std::promise<size_t>> reply;   // Set for synchronous calls
+    };
+
+    // CLEAR_GROUP reply for a group DTCStore::clear_group() rejects.
+    static constexpr size_t UNSUPPORTED_GROUP = SIZE_MAX;
+
+    /// Queue @p op. @return false once the writer has stopped.
+    bool enqueue(Op op) {
+        {
+            std::lock_guard<std::mutex> lk(m_queue_mutex);
+            if (m_writer_stopped) return false;
+            m_queue.push_back(std::move(op));
+        }
+        m_queue_cv.notify_one();
+        return true;
+    }
+
+    /// Queue @p op and wait for the writer's reply (std::nullopt if stopped).
+    std::optional<size_t> call(Op op) {
+        op.reply = std::make_shared<std::promise<size_t>>();
+        auto result = op.reply->get_future();
+        if (!enqueue(std::move(op))) return std::nullopt;
+        return result.get();
+    }
+
+    std::chrono::milliseconds flush_interval() const {
+        return std::chrono::milliseconds(m_flush_interval_ms.load(std::memory_order_relaxed));
+    }
+
+    // --- Writer thread --------------------------------------------------------
+
+    void run_writer() {
+        std::vector<Op> batch;
+        struct Reply {
+            std::shared_ptr<std::promise<size_t>> promise;
+            size_t                                result;
+            bool                                  is_commit;   // flush()/save(): result = committed
+        };
+        std::vector<Reply> replies;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(m_queue_mutex);
+                auto has_work = [this] { return !m_queue.empty(); };
+                if (m_dirty) m_queue_cv.wait_until(lk, next_commit_due(), has_work);
+                else         m_queue_cv.wait(lk, has_work);
+                batch.swap(m_queue);
+            }
+
+            bool publish = false, commit_now = false, stop = false;
+            for (Op& op : batch) {
+                size_t result = 0;
+                switch (op.kind) {
+                    case Op::Kind::SET:
+                        if (m_store.set(op.code, op.status)) {
+                            m_changes.fetch_add(1, std::memory_order_relaxed);
+                            publish = m_dirty = true;
+                        }
+                        break;
+                    case Op::Kind::CLEAR_GROUP:
+                        result = m_store.clear_group(op.code).value_or(UNSUPPORTED_GROUP);
+                        if (result > 0 && result != UNSUPPORTED_GROUP) {
+                            m_changes.fetch_add(1, std::memory_order_relaxed);
+                            publish = m_dirty = true;
+                        }
+                        break;
+                    case Op::Kind::LOAD: {
+                        // Changes queued before the load are superseded by it.
+                        m_store.parse(m_nvram.get_bytes("ACTIVE_DTCS").value_or(std::vector<uint8_t>{}));
+                        LOG_INFO("DTC", "Loaded %zu DTC(s) from NVRAM.", m_store.entries().size());
+                        publish = true;
+                        m_dirty = false;
+                        break;
+                    }
+                    case Op::Kind::SAVE:
+                        m_dirty = true;
+                        commit_now = true;
+                        break;
+                    case Op::Kind::FLUSH:
+                        commit_now = commit_now || op.reply != nullptr;
+                        break;
+                    case Op::Kind::STOP:
+                        stop = commit_now = true;
+                        break;
+                }
+                if (op.reply) {
+                    bool is_commit = op.kind == Op::Kind::SAVE || op.kind == Op::Kind::FLUSH;
+                    replies.push_back({std::move(op.reply), result, is_commit});
+                }
+            }
+            batch.clear();
+
+            if (publish)
+                std::atomic_store_explicit(&m_snapshot, std::shared_ptr<const DTCSnapshot>(
+                    std::make_shared<const DTCSnapshot>(m_store)), std::memory_order_release);
+
+            bool committed_ok = true;
+            if (m_dirty && (commit_now || std::chrono::steady_clock::now() >= next_commit_due()))
+                committed_ok = commit();
+
+            // Replies go out after publish/commit, so a caller that returns
+            // from clear_group()/flush() sees its effect.
+            for (Reply& r : replies)
+                r.promise->set_value(r.is_commit ? (committed_ok ? 1 : 0) : r.result);
+            replies.clear();
+
+            if (stop) break;
+        }
+        std::lock_guard<std::mutex> lk(m_queue_mutex);
+        m_writer_stopped = true;
+        for (Op& op : m_queue)
+            if (op.reply) op.reply->set_value(0);
+        m_queue.clear();
+    }
+
+    // When the next write-behind commit is allowed. A failed commit is
+    // retried no sooner than RETRY_INTERVAL, even in write-through mode.
+    std::chrono::steady_clock::time_point next_commit_due() const {
+        auto wait = flush_interval();
+        if (m_last_commit_failed) wait = std::max<std::chrono::milliseconds>(wait, RETRY_INTERVAL);
+        return m_last_commit + wait;
+    }
+
+    bool commit() {
+        m_nvram.set_bytes("ACTIVE_DTCS", m_store.serialize());
+        bool ok = m_nvram.save();
+        m_last_commit        = std::chrono::steady_clock::now();
+        m_last_commit_failed = !ok;
+        if (ok) {
+            m_dirty = false;
+            m_commits.fetch_add(1, std::memory_order_relaxed);
+        }
+        return ok;
+    }
+
+    static constexpr std::chrono::milliseconds RETRY_INTERVAL{1000};
+
+    NVRAMManager& m_nvram;
+
+    // Readers
+    std::shared_ptr<const DTCSnapshot> m_snapshot;   // Accessed only via std::atomic_load/store
+    std::atomic<uint64_t>              m_changes{0};
+    std::atomic<uint64_t>              m_commits{0};
+    std::atomic<int64_t>               m_flush_interval_ms{0};
+
+    // Mutation queue
+    std::mutex              m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::vector<Op>         m_queue;
+    bool                    m_writer_stopped = false;
+
+    // Writer-thread state
+    DTCStore                              m_store;
+    bool                                  m_dirty              = false;
+    bool                                  m_last_commit_failed = false;
+    std::chrono::steady_clock::time_point m_last_commit{};
+
+    std::thread m_writer;   // Declared last: starts after everything above
 };
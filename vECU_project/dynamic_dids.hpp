@@ -0,0 +1,199 @@
+#pragma once
+
+/**
+ * @file dynamic_dids.hpp
+ * @brief $2C DynamicallyDefineDataIdentifier: composite DIDs F200-F2FF.
+ *
+ * A tester bundles slices of existing DIDs into one dynamic DID (dDID),
+ * then reads it with $22 or schedules it with $2A like any other. A slice
+ * is (source DID, offset, size). Defining a dDID again appends slices.
+ *
+ * Each definition is compiled into a copy plan when it is made, so a read
+ * does no lookups and no parsing:
+ *
+ *   1. every distinct source encoder appends its value to a scratch
+ *      buffer, once, however many slices use it;
+ *   2. the slices are memcpy'd from scratch into the response, in order.
+ *      Slices that are adjacent in scratch are merged into one copy.
+ *
+ * The plan is flat. A slice of another dDID is replaced by the slices of
+ * that dDID it covers, so a plan only reads static DIDs, and redefining
+ * or clearing the inner dDID later does not change it.
+ *
+ * Definitions are ECU-wide, as in ISO 14229, and live in g_dids, so $22
+ * and $2A need nothing extra to serve them. They are lost at ECU reset.
+ *
+ * All members are thread-safe.
+ */
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include "did_registry.hpp"
+#include "logger.hpp"
+
+class DynamicDids {
+public:
+    static constexpr uint16_t FIRST      = 0xF200;   // dDID range
+    static constexpr uint16_t LAST       = 0xF2FF;
+    static constexpr size_t   MAX_SLICES = 32;       // Per dDID, after flattening
+
+    /// @p size bytes of @p source, starting @p offset bytes into its value.
+    struct Slice {
+        uint16_t source = 0;
+        uint16_t offset = 0;
+        uint16_t size   = 0;
+    };
+
+    explicit DynamicDids(DidRegistry& dids) : m_dids(dids) {}
+    DynamicDids(const DynamicDids&)            = delete;
+    DynamicDids& operator=(const DynamicDids&) = delete;
+
+    /**
+     * @brief Define @p did as @p slices, appended to its current definition.
+     * @return false (and nothing changed) if @p did is outside F200-F2FF or
+     *         a static DID, a source is unknown or variable-length, a slice
+     *         is out of its source's range, or it would exceed MAX_SLICES.
+     */
+    bool define(uint16_t did, const std::vector<Slice>& slices) {
+        if (did < FIRST || did > LAST || slices.empty()) return false;
+        std::lock_guard<std::mutex> lk(m_mutex);
+        const auto table = m_dids.table();
+        auto it = m_defs.find(did);
+        if (it == m_defs.end() && table->find(did)) {
+            LOG_WARN("DDID", "0x%04X is a static DID; not redefined.", did);
+            return false;
+        }
+        std::vector<Slice> flat = it != m_defs.end() ? it->second : std::vector<Slice>{};
+        for (const Slice& s : slices) {
+            if (!flatten(*table, s, flat)) {
+                LOG_WARN("DDID", "0x%04X: 0x%04X[%u..+%u] is not a readable slice.",
+                         did, s.source, s.offset, s.size);
+                return false;
+            }
+        }
+        if (flat.size() > MAX_SLICES) {
+            LOG_WARN("DDID", "0x%04X would have %zu slices (max %zu).", did, flat.size(), MAX_SLICES);
+            return false;
+        }
+        auto plan = compile(*table, flat);
+        if (!plan) return false;
+        LOG_INFO("DDID", "0x%04X defined: %zu byte(s) from %zu source(s), %zu copy(ies).",
+                 did, plan->size, plan->sources.size(), plan->copies.size());
+        m_dids.add(did, "DYNAMIC", static_cast<uint16_t>(plan->size),
+                   [plan](std::vector<uint8_t>& out) { plan->read(out); });
+        m_defs[did] = std::move(flat);
+        return true;
+    }
+
+    /// Clear @p did. @return false if it is not a dDID.
+    bool clear(uint16_t did) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (m_defs.erase(did) == 0) return false;
+        m_dids.remove(did);
+        LOG_INFO("DDID", "0x%04X cleared.", did);
+        return true;
+    }
+
+    /// Clear every dDID.
+    void clear_all() {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        for (const auto& def : m_defs) m_dids.remove(def.first);
+        if (!m_defs.empty()) LOG_INFO("DDID", "%zu dynamic DID(s) cleared.", m_defs.size());
+        m_defs.clear();
+    }
+
+    size_t count() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_defs.size();
+    }
+
+private:
+    // Compiled definition; immutable, shared with the g_dids encoder.
+    struct Plan {
+        struct Copy {
+            uint16_t from;   // Offset in scratch
+            uint16_t size;
+        };
+        std::vector<DidRegistry::Encoder> sources;   // Distinct, in first-use order
+        size_t                            scratch_size = 0;
+        std::vector<Copy>                 copies;
+        size_t                            size = 0;
+
+        void read(std::vector<uint8_t>& out) const {
+            // Sources are static DIDs, so read() never runs nested on a thread.
+            thread_local std::vector<uint8_t> scratch;
+            scratch.clear();
+            for (const auto& encode : sources) encode(scratch);
+            scratch.resize(scratch_size);   // Copies never read past a short source
+            size_t at = out.size();
+            out.resize(at + size);
+            for (const Copy& c : copies) {
+                std::memcpy(out.data() + at, scratch.data() + c.from, c.size);
+                at += c.size;
+            }
+        }
+    };
+
+    DidRegistry&                           m_dids;
+    mutable std::mutex                     m_mutex;
+    std::map<uint16_t, std::vector<Slice>> m_defs;   // Flat, static sources only
+
+    // Append @p s to @p flat, resolving a dDID source to its own slices.
+    bool flatten(const DidRegistry::Table& table, const Slice& s, std::vector<Slice>& flat) const {
+        if (s.size == 0) return false;
+        const size_t end = size_t(s.offset) + s.size;
+        auto inner = m_defs.find(s.source);
+        if (inner == m_defs.end()) {
+            const DidRegistry::Entry* e = table.find(s.source);
+            if (!e || e->size == DidRegistry::VARIABLE || end > e->size) return false;
+            flat.push_back(s);
+            return true;
+        }
+        std::vector<Slice> covered;
+        size_t base = 0;
+        for (const Slice& in : inner->second) {
+            const size_t lo = std::max<size_t>(s.offset, base);
+            const size_t hi = std::min<size_t>(end, base + in.size);
+            if (lo < hi)
+                covered.push_back({in.source, static_cast<uint16_t>(in.offset + (lo - base)),
+                                   static_cast<uint16_t>(hi - lo)});
+            base += in.size;
+        }
+        if (end > base) return false;
+        flat.insert(flat.end(), covered.begin(), covered.end());
+        return true;
+    }
+
+    static std::shared_ptr<const Plan> compile(const DidRegistry::Table& table, const std::vector<Slice>& flat) {
+        auto plan = std::make_shared<Plan>();
+        std::vector<std::pair<uint16_t, size_t>> placed;   // Source DID -> offset in scratch
+        for (const Slice& s : flat) {
+            auto it = std::find_if(placed.begin(), placed.end(),
+                                   [&](const auto& p) { return p.first == s.source; });
+            size_t at;
+            if (it != placed.end()) {
+                at = it->second;
+            } else {
+                const DidRegistry::Entry* e = table.find(s.source);
+                if (!e) return nullptr;
+                at = plan->scratch_size;
+                placed.emplace_back(s.source, at);
+                plan->sources.push_back(e->encode);
+                plan->scratch_size += e->size;
+            }
+            const size_t from = at + s.offset;
+            if (!plan->copies.empty() && size_t(plan->copies.back().from) + plan->copies.back().size == from)
+                plan->copies.back().size += s.size;
+            else
+                plan->copies.push_back({static_cast<uint16_t>(from), s.size});
+            plan->size += s.size;
+        }
+        return plan;
+    }
+};
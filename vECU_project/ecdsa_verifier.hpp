@@ -16,12 +16,12 @@
  *   [0x37 | sig_len_H | sig_len_L | <sig bytes>]
  *
  * The ECU (this module) verifies the signature against the
- * SHA-256 digest of update.bin using the embedded public key.
+ * SHA-256 digest of the staged image using the embedded public key.
+ * When the digest was already computed while the image streamed in,
+ * verify_digest() checks the signature without touching the file again.
  */
 
-#include <iostream>
 #include <fstream>
-#include <iterator>
 #include <vector>
 #include <string>
 
@@ -30,6 +30,8 @@
 #include <openssl/pem.h>
 #include <openssl/err.h>
 
+#include "logger.hpp"
+
 class ECDSAVerifier {
 public:
     /**
@@ -40,23 +42,26 @@ public:
     bool load_public_key(const std::string& pubkey_path) {
         FILE* fp = fopen(pubkey_path.c_str(), "r");
         if (!fp) {
-            std::cerr << "[ECDSA] Cannot open public key: " << pubkey_path << std::endl;
+            LOG_ERROR("ECDSA", "Cannot open public key: %s", pubkey_path.c_str());
             return false;
         }
         m_pkey = PEM_read_PUBKEY(fp, nullptr, nullptr, nullptr);
         fclose(fp);
         if (!m_pkey) {
-            std::cerr << "[ECDSA] Failed to parse public key." << std::endl;
+            LOG_ERROR("ECDSA", "Failed to parse public key.");
             print_openssl_error();
             return false;
         }
-        std::cout << "[ECDSA] Public key loaded from: " << pubkey_path << std::endl;
+        LOG_INFO("ECDSA", "Public key loaded from: %s", pubkey_path.c_str());
         return true;
     }
 
     /**
      * @brief Verify an ECDSA signature over the SHA-256 digest of a file.
      *
+     * The file is streamed through a fixed-size buffer into
+     * EVP_DigestVerifyUpdate, so peak memory is independent of image size.
+     *
      * @param file_path       Path to the data file (e.g. "update.bin").
      * @param signature       Raw DER-encoded ECDSA signature bytes.
      * @return true if the signature is valid.
@@ -64,20 +69,15 @@ public:
     bool verify_file(const std::string&          file_path,
                      const std::vector<uint8_t>& signature) const {
         if (!m_pkey) {
-            std::cerr << "[ECDSA] No public key loaded." << std::endl;
+            LOG_ERROR("ECDSA", "No public key loaded.");
             return false;
         }
 
-        // Read file contents
         std::ifstream file(file_path, std::ios::binary);
         if (!file.is_open()) {
-            std::cerr << "[ECDSA] Cannot open file: " << file_path << std::endl;
+            LOG_ERROR("ECDSA", "Cannot open file: %s", file_path.c_str());
             return false;
         }
-        std::vector<uint8_t> data(
-            (std::istreambuf_iterator<char>(file)),
-             std::istreambuf_iterator<char>()
-        );
 
         // Create digest context
         EVP_MD_CTX* ctx = EVP_MD_CTX_new();
@@ -90,10 +90,18 @@ public:
             return false;
         }
 
-        rc = EVP_DigestVerifyUpdate(ctx, data.data(), data.size());
-        if (rc != 1) {
+        std::vector<char> buf(VERIFY_BUFFER_SIZE);
+        while (file.read(buf.data(), buf.size()) || file.gcount() > 0) {
+            rc = EVP_DigestVerifyUpdate(ctx, buf.data(), static_cast<size_t>(file.gcount()));
+            if (rc != 1) {
+                EVP_MD_CTX_free(ctx);
+                print_openssl_error();
+                return false;
+            }
+        }
+        if (file.bad()) {
             EVP_MD_CTX_free(ctx);
-            print_openssl_error();
+            LOG_ERROR("ECDSA", "Read error on file: %s", file_path.c_str());
             return false;
         }
 
@@ -103,10 +111,53 @@ public:
         EVP_MD_CTX_free(ctx);
 
         if (rc == 1) {
-            std::cout << "[ECDSA] Signature VALID." << std::endl;
+            LOG_INFO("ECDSA", "Signature VALID.");
+            return true;
+        } else {
+            LOG_ERROR("ECDSA", "Signature INVALID.");
+            print_openssl_error();
+            return false;
+        }
+    }
+
+    /**
+     * @brief Verify an ECDSA signature against a precomputed SHA-256 digest.
+     *
+     * Equivalent to verify_file() on the data that produced @p digest, but
+     * costs only the signature math.
+     *
+     * @param digest     32-byte SHA-256 digest of the signed data.
+     * @param signature  Raw DER-encoded ECDSA signature bytes.
+     * @return true if the signature is valid.
+     */
+    bool verify_digest(const std::vector<uint8_t>& digest,
+                       const std::vector<uint8_t>& signature) const {
+        if (!m_pkey) {
+            LOG_ERROR("ECDSA", "No public key loaded.");
+            return false;
+        }
+
+        EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new(m_pkey, nullptr);
+        if (!pctx) return false;
+
+        int rc = EVP_PKEY_verify_init(pctx);
+        if (rc == 1) rc = EVP_PKEY_CTX_set_signature_md(pctx, EVP_sha256());
+        if (rc != 1) {
+            EVP_PKEY_CTX_free(pctx);
+            print_openssl_error();
+            return false;
+        }
+
+        rc = EVP_PKEY_verify(pctx,
+                             signature.data(), signature.size(),
+                             digest.data(),    digest.size());
+        EVP_PKEY_CTX_free(pctx);
+
+        if (rc == 1) {
+            LOG_INFO("ECDSA", "Signature VALID.");
             return true;
         } else {
-            std::cerr << "[ECDSA] Signature INVALID." << std::endl;
+            LOG_ERROR("ECDSA", "Signature INVALID.");
             print_openssl_error();
             return false;
         }
@@ -119,6 +170,9 @@ public:
         }
     }
 
+    /// Read size for verify_file(); bounds its memory use regardless of image size.
+    static constexpr size_t VERIFY_BUFFER_SIZE = 64 * 1024;
+
 private:
     EVP_PKEY* m_pkey = nullptr;
 
@@ -127,7 +181,7 @@ private:
         if (err) {
             char buf[256];
             ERR_error_string_n(err, buf, sizeof(buf));
-            std::cerr << "[ECDSA] OpenSSL: " << buf << std::endl;
+            LOG_ERROR("ECDSA", "OpenSSL: %s", buf);
         }
     }
 };
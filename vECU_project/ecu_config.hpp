@@ -0,0 +1,165 @@
+#pragma once
+
+/**
+ * @file ecu_config.hpp
+ * @brief Runtime configuration for TargetECU, parsed from the command line.
+ *
+ * Usage:
+ *   ./TargetECU [--io-threads <n>] [--write-queue <n>] [--max-block-length <n>]
+ *               [--log-level <level>] [--dtc-flush-ms <n>]
+ *               [--nvram-format <binary|text>]
+ *               [--flash-page <n>] [--flash-block <n>] [--flash-size <n>] [--flash-delay]
+ *               [--boot-rehash-every <n>] [--boot-hash <sha256|merkle>]
+ *               [--worker-threads <n>] [--signing-key <pem>]
+ *               [--response-pending-ms <n>]
+ *
+ *   --io-threads <n>   Number of worker threads running the DoIP io_context.
+ *                      Defaults to the number of hardware threads.
+ *   --write-queue <n>  Max $36 blocks buffered in the staged writer before
+ *                      the session stops acknowledging (backpressure).
+ *   --max-block-length <n>
+ *                      maxNumberOfBlockLength advertised in the $74 response,
+ *                      i.e. the largest $36 request (SID + counter + data).
+ *   --log-level <level>
+ *                      debug, info (default), warn, error or off. Per-block
+ *                      transfer traces are logged at debug.
+ *   --dtc-flush-ms <n> Write-behind interval for DTC persistence: changes
+ *                      are coalesced into at most one NVRAM save per <n> ms.
+ *                      0 saves on every change.
+ *   --nvram-format <binary|text>
+ *                      Format nvram.dat is written in. binary (default) is
+ *                      memory-mapped at boot; a text file found at boot is
+ *                      converted. text keeps it hand-editable.
+ *   --flash-page <n>, --flash-block <n>, --flash-size <n>
+ *                      Page, erase-block and total size in bytes of the
+ *                      emulated NVRAM flash (default 256, 4096, 262144).
+ *   --flash-delay      Stall NVRAM writes for the modelled program/erase time.
+ *   --boot-rehash-every <n>
+ *                      Secure boot trusts the cached verdict for an unchanged
+ *                      image, but hashes it in full every <n> boots (default
+ *                      10). 1 hashes on every boot; 0 only when it changes.
+ *   --boot-hash <sha256|merkle>
+ *                      Image digest secure boot checks. merkle hashes 1 MiB
+ *                      leaves on all worker threads against the recorded
+ *                      Merkle root (see merkle_hash.hpp); sha256 (default)
+ *                      is one sequential stream.
+ *   --worker-threads <n>
+ *                      Threads for CPU-bound work such as image hashing.
+ *                      Defaults to the number of hardware threads.
+ *   --signing-key <pem>
+ *                      Public key $37 signatures are verified with (default
+ *                      firmware_signing_pub.pem). Loaded once at start;
+ *                      SIGHUP reloads it (key rotation).
+ *   --response-pending-ms <n>
+ *                      While a long request ($37 verification and slot
+ *                      switch) runs on the worker pool, 7F <SID> 78
+ *                      (responsePending) is repeated every <n> ms (default
+ *                      2000, well inside the tester's 5 s P2* timeout).
+ */
+
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#include "logger.hpp"
+#include "nvram_image.hpp"
+#include "flash_device.hpp"
+
+/// Digest secure boot verifies the image with.
+enum class ImageHash { SHA256, MERKLE };
+
+struct EcuConfig {
+    std::size_t io_threads        = default_io_threads();
+    std::size_t write_queue_depth = 16;
+    uint32_t    max_block_length  = 64 * 1024;
+    LogLevel    log_level         = LogLevel::INFO;
+    uint32_t    dtc_flush_ms      = 1000;
+    NVRAMFormat nvram_format      = NVRAMFormat::BINARY;
+    FlashGeometry flash;
+    uint32_t    boot_rehash_every = 10;
+    ImageHash   boot_hash         = ImageHash::SHA256;
+    std::size_t worker_threads    = default_io_threads();
+    std::string signing_key       = "firmware_signing_pub.pem";
+    uint32_t    response_pending_ms = 2000;
+
+    /// Bounds for --max-block-length (room for SID + counter, 16 MiB cap).
+    static constexpr uint32_t MIN_BLOCK_LENGTH = 3;
+    static constexpr uint32_t MAX_BLOCK_LENGTH = 16 * 1024 * 1024;
+
+    static std::size_t default_io_threads() {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+};
+
+/**
+ * @brief Parse TargetECU command-line options into an EcuConfig.
+ *
+ * Unknown options are reported and ignored so a typo never prevents boot.
+ * @return The parsed configuration (defaults for anything not given).
+ */
+inline EcuConfig parse_ecu_config(int argc, char* argv[]) {
+    EcuConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--io-threads" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            cfg.io_threads = n > 0 ? static_cast<std::size_t>(n) : 1;
+        } else if (arg == "--write-queue" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            cfg.write_queue_depth = n > 0 ? static_cast<std::size_t>(n) : 1;
+        } else if (arg == "--max-block-length" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 0);
+            cfg.max_block_length = static_cast<uint32_t>(std::clamp<long>(n,
+                EcuConfig::MIN_BLOCK_LENGTH, EcuConfig::MAX_BLOCK_LENGTH));
+        } else if (arg == "--dtc-flush-ms" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            cfg.dtc_flush_ms = n > 0 ? static_cast<uint32_t>(n) : 0;
+        } else if (arg == "--nvram-format" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "binary")    cfg.nvram_format = NVRAMFormat::BINARY;
+            else if (name == "text") cfg.nvram_format = NVRAMFormat::TEXT;
+            else LOG_WARN("CONFIG", "Ignoring unknown NVRAM format: %s", name.c_str());
+        } else if ((arg == "--flash-page" || arg == "--flash-block" || arg == "--flash-size") && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 0);
+            uint32_t v = n > 0 ? static_cast<uint32_t>(n) : 0;
+            if (arg == "--flash-page")       cfg.flash.page_size  = v;
+            else if (arg == "--flash-block") cfg.flash.block_size = v;
+            else                             cfg.flash.total_size = v;
+        } else if (arg == "--flash-delay") {
+            cfg.flash.delays = true;
+        } else if (arg == "--boot-rehash-every" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            cfg.boot_rehash_every = n > 0 ? static_cast<uint32_t>(n) : 0;
+        } else if (arg == "--boot-hash" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "sha256")      cfg.boot_hash = ImageHash::SHA256;
+            else if (name == "merkle") cfg.boot_hash = ImageHash::MERKLE;
+            else LOG_WARN("CONFIG", "Ignoring unknown boot hash: %s", name.c_str());
+        } else if (arg == "--worker-threads" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            cfg.worker_threads = n > 0 ? static_cast<std::size_t>(n) : 1;
+        } else if (arg == "--signing-key" && i + 1 < argc) {
+            cfg.signing_key = argv[++i];
+        } else if (arg == "--response-pending-ms" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            cfg.response_pending_ms = n > 0 ? static_cast<uint32_t>(n) : 1;
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (auto level = Logger::parse_level(name)) cfg.log_level = *level;
+            else LOG_WARN("CONFIG", "Ignoring unknown log level: %s", name.c_str());
+        } else {
+            LOG_WARN("CONFIG", "Ignoring unknown option: %s", arg.c_str());
+        }
+    }
+    if (!cfg.flash.valid()) {
+        LOG_WARN("CONFIG", "Ignoring flash geometry %u/%u/%u: need whole pages per block and >= 4 blocks.",
+                 cfg.flash.page_size, cfg.flash.block_size, cfg.flash.total_size);
+        bool delays = cfg.flash.delays;
+        cfg.flash = FlashGeometry{};
+        cfg.flash.delays = delays;
+    }
+    return cfg;
+}
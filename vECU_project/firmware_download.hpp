@@ -0,0 +1,349 @@
+#pragma once
+
+/**
+ * @file firmware_download.hpp
+ * @brief State of one in-progress OTA download ($34 -> $36... -> $37).
+ *
+ * Every $36 block is fed into a running SHA-256 and handed to a
+ * StagedWriter, so $37 only has to finalize the digest and check the
+ * signature against it — no second pass over the image on disk, and no
+ * disk I/O on the network thread.
+ *
+ * Compressed transfers are inflated block by block before hashing and
+ * writing, and delta transfers are patched against the running image
+ * (see DeltaPatcher), so the digest (and the signature) always cover the
+ * reconstructed image.
+ *
+ * A block is decoded in pieces of at most MAX_CHUNK image bytes, and each
+ * piece waits for the StagedWriter to take the previous one. A block that
+ * expands a lot (a COPY of the whole base, a long run of zeros) therefore
+ * costs no more memory than any other, and the bounded write queue
+ * throttles it like any other. Blocks arriving meanwhile wait their turn.
+ * A parked download may be resumed by a new session while the old one's
+ * blocks are still being decoded, so the block queue has a mutex; only
+ * one piece is decoded at a time.
+ *
+ * With enable_merkle() the image's Merkle root (merkle_hash.hpp) is built
+ * from the same bytes, so it can be recorded for --boot-hash merkle
+ * without reading the staged slot back.
+ */
+
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+#include <utility>
+
+#include "streaming_digest.hpp"
+#include "merkle_hash.hpp"
+#include "staged_writer.hpp"
+#include "stream_inflater.hpp"
+#include "delta_patcher.hpp"
+
+/// compressionMethod (high nibble of the $34 dataFormatIdentifier).
+/// Bit 0x1 = zlib stream, bit 0x2 = delta patch; both may be combined
+/// (a zlib-compressed patch).
+enum class TransferEncoding : uint8_t {
+    RAW        = 0x0,
+    ZLIB       = 0x1,
+    DELTA      = 0x2,
+    ZLIB_DELTA = 0x3,
+};
+
+inline bool has_encoding(TransferEncoding encoding, TransferEncoding bit) {
+    return (static_cast<uint8_t>(encoding) & static_cast<uint8_t>(bit)) != 0;
+}
+
+/// What a resumable download is keyed by (see DownloadRegistry).
+struct DownloadIdentity {
+    uint8_t                  data_format = 0;   // $34 dataFormatIdentifier
+    uint32_t                 image_size  = 0;   // $34 memorySize
+    std::array<uint8_t, 32>  image_id    {};    // Tester-supplied SHA-256 of the image
+
+    bool operator==(const DownloadIdentity& o) const {
+        return data_format == o.data_format && image_size == o.image_size && image_id == o.image_id;
+    }
+};
+
+class FirmwareDownload : public std::enable_shared_from_this<FirmwareDownload> {
+public:
+    using Executor = StagedWriter::Executor;
+    using Handler  = StagedWriter::Handler;
+
+    /**
+     * @brief Create (truncate) the staging file and reset the digest.
+     * @param path              Staging file (the inactive A/B slot).
+     * @param expected_size     Image size announced in $34.
+     * @param max_queued_chunks Depth of the staged-write queue.
+     * @param encoding          How $36 data is encoded on the wire.
+     * @param delta_base        Image a DELTA transfer is patched against.
+     * @return false if the file (or the delta base) cannot be opened.
+     */
+    bool open(const std::string& path, uint32_t expected_size, size_t max_queued_chunks,
+              TransferEncoding encoding = TransferEncoding::RAW,
+              DeltaPatcher::Base delta_base = {}) {
+        m_path           = path;
+        m_encoding       = encoding;
+        m_wire_bytes     = 0;
+        if (has_encoding(encoding, TransferEncoding::ZLIB)) m_inflater = std::make_unique<StreamInflater>();
+        else                                                m_inflater.reset();
+        if (has_encoding(encoding, TransferEncoding::DELTA)) {
+            m_patcher = std::make_unique<DeltaPatcher>(std::move(delta_base));
+            if (!m_patcher->ok()) return false;
+        } else {
+            m_patcher.reset();
+        }
+        m_patch.clear();
+        m_patch_at       = 0;
+        m_blocks.clear();
+        m_busy           = false;
+        m_failed         = false;
+        m_expected_size  = expected_size;
+        m_bytes_received = 0;
+        m_blocks_accepted    = 0;
+        m_next_block_counter = 0x01;
+        m_writer         = std::make_unique<StagedWriter>(max_queued_chunks);
+        return m_digest.ok() && m_writer->open(path);
+    }
+
+    /// Also build the image's Merkle root. Call before the first block.
+    void enable_merkle() { m_merkle = std::make_unique<MerkleBuilder>(); }
+
+    /**
+     * @brief Decode one block, hash the image bytes and queue them for writing.
+     *
+     * @param block   Buffer holding the block; moved, not copied.
+     * @param offset  Start of image data inside @p block (e.g. 2 to skip
+     *                the $36 SID and block counter).
+     * @param ex      Executor on which @p handler runs.
+     * @param handler Called once the block's last piece is queued (ok) or
+     *                on error.
+     */
+    void async_append(std::vector<uint8_t> block, size_t offset, Executor ex, Handler handler) {
+        m_wire_bytes += block.size() - offset;
+        ++m_blocks_accepted;
+        m_next_block_counter = static_cast<uint8_t>(m_next_block_counter + 1);
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_blocks.push_back({StagedWriter::Chunk{std::move(block), offset}, std::move(ex), std::move(handler)});
+            if (m_busy) return;
+            m_busy = true;
+        }
+        decode_blocks();
+    }
+
+    /**
+     * @brief Flush and close the staging file, then finalize the digest.
+     * @param handler Called with false if any write or the digest failed.
+     */
+    void async_finish(Executor ex, Handler handler) {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            if (m_busy) {
+                // Blocks still being decoded; finish once they are queued.
+                m_finish_ex      = std::move(ex);
+                m_finish_handler = std::move(handler);
+                return;
+            }
+        }
+        auto self = shared_from_this();
+        m_writer->async_finish(ex, [self, handler](bool ok) {
+            {
+                std::lock_guard<std::mutex> lk(self->m_mutex);
+                ok = ok && !self->m_failed;
+            }
+            // A compressed stream or patch must have reached its end marker.
+            ok = ok && (!self->m_inflater || self->m_inflater->finished());
+            ok = ok && (!self->m_patcher  || self->m_patcher->finished());
+            ok = ok && self->m_digest.finalize();
+            if (ok && self->m_merkle) self->m_merkle->finalize();
+            handler(ok);
+        });
+    }
+
+    /**
+     * @brief Fail the download, drop its queued data and join the writer.
+     *
+     * Blocks until the staging file is no longer written to, so never call
+     * it on a session strand. Safe to call more than once.
+     */
+    void abort_and_wait() {
+        fail_blocks();
+        if (m_writer) m_writer->abort();
+    }
+
+    /// Marks the download as resumable under @p id (see DownloadRegistry).
+    void set_identity(const DownloadIdentity& id) { m_identity = id; m_resumable = true; }
+    const DownloadIdentity& identity()  const { return m_identity; }
+    bool                    resumable() const { return m_resumable; }
+
+    /// blockSequenceCounter the next $36 must carry (0x01 first, wraps to 0x00).
+    uint8_t next_block_counter() const { return m_next_block_counter; }
+
+    /// True if @p counter repeats the most recently accepted block.
+    bool is_repeat_block(uint8_t counter) const {
+        return m_blocks_accepted > 0 && static_cast<uint8_t>(counter + 1) == m_next_block_counter;
+    }
+
+    uint32_t blocks_accepted() const { return m_blocks_accepted; }
+
+    /// True if @p len more bytes of a RAW transfer would go past memorySize.
+    /// (Encoded transfers are checked as they are decoded.)
+    bool exceeds_size(size_t len) const {
+        return m_encoding == TransferEncoding::RAW && m_wire_bytes + len > m_expected_size;
+    }
+
+    const std::string&          path()           const { return m_path; }
+    uint32_t                    expected_size()  const { return m_expected_size; }
+    uint32_t                    bytes_received() const { return m_bytes_received; }
+    uint64_t                    wire_bytes()     const { return m_wire_bytes; }
+    const StreamInflater*       inflater()       const { return m_inflater.get(); }
+    const DeltaPatcher*         patcher()        const { return m_patcher.get(); }
+    const std::vector<uint8_t>& digest()         const { return m_digest.digest(); }
+    std::string                 digest_hex()     const { return m_digest.hex(); }
+    /// Merkle root (hex) of the image; empty unless enable_merkle() was called.
+    std::string                 merkle_hex()     const { return m_merkle ? m_merkle->hex() : std::string(); }
+    const StagedWriter&         writer()         const { return *m_writer; }
+
+    /// Most image bytes decoded from a block at once.
+    static constexpr size_t MAX_CHUNK = 64 * 1024;
+
+private:
+    // A received $36 block waiting to be decoded.
+    struct Block {
+        StagedWriter::Chunk input;
+        Executor            ex;
+        Handler             handler;
+    };
+
+    std::string                   m_path;
+    std::unique_ptr<StagedWriter> m_writer;
+    TransferEncoding              m_encoding = TransferEncoding::RAW;
+    std::unique_ptr<StreamInflater> m_inflater;       // Null unless ZLIB
+    std::unique_ptr<DeltaPatcher>   m_patcher;        // Null unless DELTA
+    std::vector<uint8_t>          m_patch;                    // Inflated patch bytes (ZLIB_DELTA)
+    size_t                        m_patch_at = 0;             // ...already applied
+    std::mutex                    m_mutex;                    // Guards the members below
+    std::deque<Block>             m_blocks;                   // Received, not yet fully queued
+    bool                          m_busy     = false;         // Decoding, or waiting for the writer
+    bool                          m_failed   = false;
+    Executor                      m_finish_ex;
+    Handler                       m_finish_handler;           // async_finish() while busy
+    StreamingDigest               m_digest;
+    std::unique_ptr<MerkleBuilder>  m_merkle;         // Null unless enable_merkle()
+    uint32_t                      m_expected_size  = 0;
+    uint32_t                      m_bytes_received = 0;       // Decompressed image bytes
+    uint64_t                      m_wire_bytes     = 0;       // Bytes as received in $36
+    uint32_t                      m_blocks_accepted    = 0;
+    uint8_t                       m_next_block_counter = 0x01;
+    DownloadIdentity              m_identity;
+    bool                          m_resumable          = false;
+
+    // Decode the queued blocks piece by piece (m_busy set by the caller).
+    // Each piece goes to the writer, and decoding resumes from its
+    // completion handler.
+    void decode_blocks() {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        while (!m_blocks.empty()) {
+            Block& b = m_blocks.front();
+            StagedWriter::Chunk piece;
+            if (m_failed || !decode_piece(b.input, piece)) {
+                lk.unlock();
+                fail_blocks();
+                return;
+            }
+            const bool   last = block_decoded(b.input);
+            const size_t len  = piece.data.size() - piece.offset;
+            if (len > 0) {
+                // The image may not grow past the memorySize announced in $34.
+                if (len > m_expected_size - std::min(m_bytes_received, m_expected_size) ||
+                    !m_digest.update(piece.data.data() + piece.offset, len)) {
+                    lk.unlock();
+                    fail_blocks();
+                    return;
+                }
+                if (m_merkle) m_merkle->update(piece.data.data() + piece.offset, len);
+                m_bytes_received += static_cast<uint32_t>(len);
+
+                Executor ex   = b.ex;
+                Handler  done = last ? std::move(b.handler) : Handler();
+                if (last) m_blocks.pop_front();
+                lk.unlock();
+                auto self = shared_from_this();
+                m_writer->async_enqueue(std::move(piece), ex, [self, done](bool ok) {
+                    if (done) done(ok);
+                    if (!ok) self->fail_blocks();
+                    else     self->decode_blocks();
+                });
+                return;
+            }
+            if (last) {
+                boost::asio::post(b.ex, [handler = std::move(b.handler)]() { handler(true); });
+                m_blocks.pop_front();
+            }
+        }
+        m_busy = false;
+        finish_if_requested(lk);
+    }
+
+    // Decode the next piece of @p in (at most MAX_CHUNK image bytes):
+    // wire -> [inflate] -> [patch] -> image bytes
+    bool decode_piece(StagedWriter::Chunk& in, StagedWriter::Chunk& piece) {
+        const uint8_t* data = in.data.data() + in.offset;
+        const size_t   len  = in.data.size() - in.offset;
+        size_t used = 0;
+        bool   ok   = true;
+        if (!m_inflater && !m_patcher) {
+            piece = std::move(in);   // RAW: the block as it is
+            in    = {};
+        } else if (!m_patcher) {
+            ok = m_inflater->inflate(data, len, used, piece.data, MAX_CHUNK);
+            in.offset += used;
+        } else {
+            if (m_inflater && m_patch_at == m_patch.size()) {
+                // The previous piece of the patch is used up; inflate the next.
+                ok = m_inflater->inflate(data, len, used, m_patch, MAX_CHUNK);
+                in.offset += used;
+                m_patch_at = 0;
+            }
+            const uint8_t* patch     = m_inflater ? m_patch.data() + m_patch_at : data;
+            const size_t   patch_len = m_inflater ? m_patch.size() - m_patch_at : len;
+            ok = ok && m_patcher->apply(patch, patch_len, used, piece.data, MAX_CHUNK);
+            if (m_inflater) m_patch_at += used;
+            else            in.offset  += used;
+        }
+        return ok;
+    }
+
+    // True once @p in is used up and nothing decoded from it is held back.
+    bool block_decoded(const StagedWriter::Chunk& in) const {
+        return in.offset == in.data.size()
+            && (!m_inflater || !m_inflater->output_pending())
+            && m_patch_at == m_patch.size()
+            && (!m_patcher || !m_patcher->pending());
+    }
+
+    // Fail every waiting block; the download is unusable from here on.
+    void fail_blocks() {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_failed = true;
+        for (Block& b : m_blocks)
+            boost::asio::post(b.ex, [handler = std::move(b.handler)]() { handler(false); });
+        m_blocks.clear();
+        m_busy = false;
+        finish_if_requested(lk);
+    }
+
+    // Run an async_finish() that arrived while busy. Releases @p lk.
+    void finish_if_requested(std::unique_lock<std::mutex>& lk) {
+        if (!m_finish_handler) return;
+        Executor ex      = std::move(m_finish_ex);
+        Handler  handler = std::exchange(m_finish_handler, nullptr);
+        lk.unlock();
+        async_finish(std::move(ex), std::move(handler));
+    }
+};
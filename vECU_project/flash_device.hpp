@@ -0,0 +1,381 @@
+#pragma once
+
+/**
+ * @file flash_device.hpp
+ * @brief Emulated NVRAM flash: pages, erase blocks, wear and timing.
+ *
+ * The NVRAM files live on the host file system, but a real ECU keeps them
+ * on flash, where a page can only be programmed once between erases and a
+ * block wears out after a limited number of erases. FlashDevice replays
+ * every NVRAM write against such a device to answer "how much flash work
+ * does this firmware cause":
+ *
+ *   - Page-mapped translation layer: rewriting part of a page (a journal
+ *     append into a half-filled page) programs a fresh page and
+ *     invalidates the old one.
+ *   - Dynamic wear leveling: a new block is always the erased block with
+ *     the lowest erase count.
+ *   - Garbage collection: when only the reserve block is left, the full
+ *     block with the fewest valid pages is relocated and erased. Relocated
+ *     pages count as GC programs, i.e. write amplification.
+ *   - Static wear leveling: once the erase counts of two blocks differ by
+ *     more than wear_threshold, the least-worn block holding data is
+ *     relocated, so cold data does not pin a fresh block forever.
+ *   - Timing model: each page program and block erase adds a fixed busy
+ *     time, optionally slept for real (FlashGeometry::delays).
+ *
+ * Only the geometry and page ownership are modelled; the data itself stays
+ * in the files. Counters in stats() cover this run (one drive cycle). Erase
+ * counts persist across runs through save_wear()/load_wear().
+ *
+ * All members are thread-safe.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+
+#include "logger.hpp"
+
+struct FlashGeometry {
+    uint32_t page_size      = 256;          // Smallest programmable unit
+    uint32_t block_size     = 4 * 1024;     // Smallest erasable unit
+    uint32_t total_size     = 256 * 1024;
+    uint32_t program_us     = 150;          // Busy time per page program
+    uint32_t erase_us       = 3000;         // Busy time per block erase
+    uint32_t wear_threshold = 16;           // Erase-count spread that triggers static leveling
+    bool     delays         = false;        // Sleep for the modelled busy time
+
+    uint32_t pages_per_block() const { return block_size / page_size; }
+    uint32_t block_count()     const { return total_size / block_size; }
+
+    /// Whole pages per block, whole blocks, and room for data plus GC.
+    bool valid() const {
+        return page_size > 0 && block_size >= page_size && block_size % page_size == 0
+            && total_size % block_size == 0 && block_count() >= 4;
+    }
+};
+
+class FlashDevice {
+public:
+    struct Stats {
+        uint64_t host_bytes    = 0;   // Bytes NVRAM asked to write
+        uint64_t host_programs = 0;   // Pages programmed for those writes
+        uint64_t gc_programs   = 0;   // Pages relocated by GC / wear leveling
+        uint64_t erases        = 0;   // Block erases this run
+        uint64_t busy_us       = 0;   // Modelled program + erase time
+        uint64_t overflows     = 0;   // Page writes dropped: device full
+        uint32_t min_erase     = 0;   // Lifetime erase counts over all blocks
+        uint32_t max_erase     = 0;
+        double   mean_erase    = 0;
+        uint32_t free_blocks   = 0;
+        uint32_t valid_pages   = 0;
+
+        /// Flash bytes programmed per byte the host wrote.
+        double write_amplification(uint32_t page_size) const {
+            return host_bytes ? double(host_programs + gc_programs) * page_size / double(host_bytes) : 0.0;
+        }
+    };
+
+    explicit FlashDevice(const FlashGeometry& geometry = {}) { configure(geometry); }
+
+    /// Reformat with @p geometry: all counters and wear start from zero.
+    void configure(const FlashGeometry& geometry) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_geo = geometry.valid() ? geometry : FlashGeometry{};
+        m_blocks.assign(m_geo.block_count(), Block{});
+        m_pages.assign(size_t(m_geo.block_count()) * m_geo.pages_per_block(), Page{});
+        m_files.clear();
+        m_maps.clear();
+        m_free_ids.clear();
+        m_active = NONE;
+        m_stats  = Stats{};
+        m_overflow_logged = false;
+    }
+
+    FlashGeometry geometry() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_geo;
+    }
+
+    /// Drop every file mapping (before re-adopting the files at load).
+    void forget_files() {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        for (auto& [name, id] : m_files) invalidate_from(id, 0);
+        m_files.clear();
+        m_maps.clear();
+        m_free_ids.clear();
+    }
+
+    /// Place @p size bytes already on disk as @p file, at no cost.
+    void adopt(const std::string& file, uint64_t size) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        write_range(id_of(file), 0, size, false);
+    }
+
+    /// Model writing @p length bytes of @p file at @p offset.
+    void program(const std::string& file, uint64_t offset, uint64_t length) {
+        uint64_t busy;
+        bool     delays;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            uint64_t before = m_stats.busy_us;
+            m_stats.host_bytes += length;
+            write_range(id_of(file), offset, length, true);
+            busy   = m_stats.busy_us - before;
+            delays = m_geo.delays;
+        }
+        if (delays && busy > 0) std::this_thread::sleep_for(std::chrono::microseconds(busy));
+    }
+
+    /// @p from replaces @p to (whose pages become invalid).
+    void rename(const std::string& from, const std::string& to) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto it = m_files.find(from);
+        if (it == m_files.end()) return;
+        uint32_t id = it->second;
+        m_files.erase(it);
+        remove_locked(to);
+        m_files[to] = id;
+    }
+
+    /// Cut @p file down to @p size bytes.
+    void trim(const std::string& file, uint64_t size) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto it = m_files.find(file);
+        if (it == m_files.end()) return;
+        invalidate_from(it->second, (size + m_geo.page_size - 1) / m_geo.page_size);
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        Stats s = m_stats;
+        s.min_erase = UINT32_MAX;
+        uint64_t sum = 0;
+        for (const Block& b : m_blocks) {
+            s.min_erase = std::min(s.min_erase, b.erase_count);
+            s.max_erase = std::max(s.max_erase, b.erase_count);
+            sum += b.erase_count;
+            if (b.write_ptr == 0) ++s.free_blocks;
+            s.valid_pages += b.valid;
+        }
+        if (m_blocks.empty()) s.min_erase = 0;
+        else s.mean_erase = double(sum) / m_blocks.size();
+        return s;
+    }
+
+    /// Write the per-block erase counters (with the geometry they belong to).
+    bool save_wear(const std::string& path) const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        std::ofstream out(path, std::ios::trunc);
+        out << m_geo.page_size << ' ' << m_geo.block_size << ' ' << m_geo.total_size << '\n';
+        for (const Block& b : m_blocks) out << b.erase_count << '\n';
+        return static_cast<bool>(out);
+    }
+
+    /// Restore erase counters saved for the same geometry.
+    bool load_wear(const std::string& path) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        std::ifstream in(path);
+        uint32_t page = 0, block = 0, total = 0;
+        if (!(in >> page >> block >> total)) return false;
+        if (page != m_geo.page_size || block != m_geo.block_size || total != m_geo.total_size) {
+            LOG_WARN("FLASH", "Ignoring %s: recorded for a different flash geometry.", path.c_str());
+            return false;
+        }
+        std::vector<uint32_t> counts(m_blocks.size());
+        for (auto& c : counts)
+            if (!(in >> c)) return false;
+        for (size_t i = 0; i < counts.size(); ++i) m_blocks[i].erase_count = counts[i];
+        return true;
+    }
+
+private:
+    static constexpr uint32_t NONE     = UINT32_MAX;
+    static constexpr uint32_t RESERVED = 1;   // Erased blocks kept back for GC
+
+    enum class PageState : uint8_t { FREE, VALID, INVALID };
+
+    struct Block {
+        uint32_t erase_count = 0;
+        uint32_t write_ptr   = 0;   // Next page to program; 0 = erased
+        uint32_t valid       = 0;
+    };
+    struct Page {
+        PageState state = PageState::FREE;
+        uint32_t  file  = 0;
+        uint32_t  lpage = 0;
+    };
+
+    mutable std::mutex m_mutex;
+    FlashGeometry      m_geo;
+    std::vector<Block> m_blocks;
+    std::vector<Page>  m_pages;
+    std::map<std::string, uint32_t>    m_files;      // Name -> file id
+    std::vector<std::vector<uint32_t>> m_maps;       // File id -> logical page -> physical page
+    std::vector<uint32_t>              m_free_ids;
+    uint32_t m_active  = NONE;                       // Block being filled
+    bool     m_in_gc   = false;
+    bool     m_overflow_logged = false;
+    Stats    m_stats;
+
+    uint32_t id_of(const std::string& file) {
+        auto it = m_files.find(file);
+        if (it != m_files.end()) return it->second;
+        uint32_t id;
+        if (!m_free_ids.empty()) {
+            id = m_free_ids.back();
+            m_free_ids.pop_back();
+        } else {
+            id = static_cast<uint32_t>(m_maps.size());
+            m_maps.emplace_back();
+        }
+        m_files[file] = id;
+        return id;
+    }
+
+    void remove_locked(const std::string& file) {
+        auto it = m_files.find(file);
+        if (it == m_files.end()) return;
+        invalidate_from(it->second, 0);
+        m_free_ids.push_back(it->second);
+        m_files.erase(it);
+    }
+
+    void invalidate(uint32_t phys) {
+        if (phys == NONE || m_pages[phys].state != PageState::VALID) return;
+        m_pages[phys].state = PageState::INVALID;
+        --m_blocks[phys / m_geo.pages_per_block()].valid;
+    }
+
+    void invalidate_from(uint32_t id, uint64_t first_lpage) {
+        auto& map = m_maps[id];
+        for (uint64_t l = first_lpage; l < map.size(); ++l) invalidate(map[l]);
+        if (first_lpage < map.size()) map.resize(first_lpage);
+    }
+
+    void write_range(uint32_t id, uint64_t offset, uint64_t length, bool counted) {
+        if (length == 0) return;
+        uint64_t first = offset / m_geo.page_size;
+        uint64_t last  = (offset + length - 1) / m_geo.page_size;
+        for (uint64_t l = first; l <= last; ++l) write_page(id, static_cast<uint32_t>(l), counted, false);
+    }
+
+    void write_page(uint32_t id, uint32_t lpage, bool counted, bool gc) {
+        const uint32_t ppb = m_geo.pages_per_block();
+        if (m_active == NONE || m_blocks[m_active].write_ptr == ppb) {
+            m_active = take_free_block();
+            if (m_active == NONE) {
+                ++m_stats.overflows;
+                if (!m_overflow_logged) {
+                    LOG_WARN("FLASH", "Emulated flash full (%u bytes); page writes are being dropped.",
+                             m_geo.total_size);
+                    m_overflow_logged = true;
+                }
+                return;
+            }
+        }
+        uint32_t phys = m_active * ppb + m_blocks[m_active].write_ptr++;
+        auto& map = m_maps[id];
+        if (map.size() <= lpage) map.resize(lpage + 1, NONE);
+        invalidate(map[lpage]);
+        map[lpage] = phys;
+        m_pages[phys] = {PageState::VALID, id, lpage};
+        ++m_blocks[m_active].valid;
+
+        if (!counted) return;
+        ++(gc ? m_stats.gc_programs : m_stats.host_programs);
+        m_stats.busy_us += m_geo.program_us;
+    }
+
+    uint32_t erased_blocks() const {
+        uint32_t n = 0;
+        for (uint32_t b = 0; b < m_blocks.size(); ++b)
+            if (m_blocks[b].write_ptr == 0 && b != m_active) ++n;
+        return n;
+    }
+
+    // Least-worn erased block, collecting garbage first if only the reserve
+    // is left (GC itself may use the reserve).
+    uint32_t take_free_block() {
+        if (!m_in_gc)
+            while (erased_blocks() <= RESERVED && collect(pick_victim())) {}
+        // Relocation may have opened a block of its own; fill that one first.
+        if (m_active != NONE && m_blocks[m_active].write_ptr < m_geo.pages_per_block()) return m_active;
+        if (!m_in_gc && erased_blocks() <= RESERVED) return NONE;
+        uint32_t best = NONE;
+        for (uint32_t b = 0; b < m_blocks.size(); ++b)
+            if (m_blocks[b].write_ptr == 0 && b != m_active
+                && (best == NONE || m_blocks[b].erase_count < m_blocks[best].erase_count))
+                best = b;
+        return best;
+    }
+
+    // Full block with the fewest valid pages (ties: least worn).
+    uint32_t pick_victim() const {
+        const uint32_t ppb = m_geo.pages_per_block();
+        uint32_t best = NONE;
+        for (uint32_t b = 0; b < m_blocks.size(); ++b) {
+            const Block& blk = m_blocks[b];
+            if (b == m_active || blk.write_ptr != ppb || blk.valid == ppb) continue;
+            if (best == NONE || blk.valid < m_blocks[best].valid
+                || (blk.valid == m_blocks[best].valid && blk.erase_count < m_blocks[best].erase_count))
+                best = b;
+        }
+        return best;
+    }
+
+    /// Garbage-collect @p victim, then check the wear spread.
+    bool collect(uint32_t victim) {
+        if (victim == NONE || !relocate_and_erase(victim)) return false;
+        level_wear();
+        return true;
+    }
+
+    /// Move @p b's valid pages elsewhere and erase it.
+    bool relocate_and_erase(uint32_t b) {
+        const uint32_t ppb = m_geo.pages_per_block();
+        m_in_gc = true;
+        for (uint32_t p = b * ppb; p < (b + 1) * ppb; ++p)
+            if (m_pages[p].state == PageState::VALID)
+                write_page(m_pages[p].file, m_pages[p].lpage, true, true);
+        m_in_gc = false;
+        if (m_blocks[b].valid != 0) return false;   // Nowhere to relocate to
+        erase(b);
+        return true;
+    }
+
+    void erase(uint32_t b) {
+        const uint32_t ppb = m_geo.pages_per_block();
+        for (uint32_t p = b * ppb; p < (b + 1) * ppb; ++p) m_pages[p] = Page{};
+        Block& blk = m_blocks[b];
+        ++blk.erase_count;
+        blk.write_ptr = 0;
+        blk.valid     = 0;
+        ++m_stats.erases;
+        m_stats.busy_us += m_geo.erase_us;
+    }
+
+    // Static wear leveling: move the data off the least-worn full block.
+    void level_wear() {
+        const uint32_t ppb = m_geo.pages_per_block();
+        uint32_t max_erase = 0, cold = NONE;
+        for (uint32_t b = 0; b < m_blocks.size(); ++b) {
+            max_erase = std::max(max_erase, m_blocks[b].erase_count);
+            if (b != m_active && m_blocks[b].write_ptr == ppb
+                && (cold == NONE || m_blocks[b].erase_count < m_blocks[cold].erase_count))
+                cold = b;
+        }
+        if (cold == NONE || max_erase - m_blocks[cold].erase_count <= m_geo.wear_threshold) return;
+        if (erased_blocks() <= RESERVED) return;   // Needs room to move into
+        LOG_DEBUG("FLASH", "Wear leveling: relocating block %u (erase count %u, max %u).",
+                  cold, m_blocks[cold].erase_count, max_erase);
+        relocate_and_erase(cold);   // Not collect(): one move per erase
+    }
+};
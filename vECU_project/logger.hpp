@@ -0,0 +1,342 @@
+#pragma once
+
+/**
+ * @file logger.hpp
+ * @brief Asynchronous, lock-free-on-the-hot-path logging for the ECU.
+ *
+ * Producers never take a lock or touch a file descriptor. Each thread owns
+ * a single-producer/single-consumer ring of fixed-size records; LOG_*()
+ * formats the message into the next free slot and publishes it with one
+ * release store. A background thread drains all rings, orders the records
+ * by a global sequence number, renders "[TAG] message" lines and writes
+ * them in a few large fwrite + fflush calls per batch (stderr for WARN
+ * and above). When every ring is empty the writer sleeps on a condition
+ * variable; a producer only takes its mutex to wake it, which it sees
+ * from the `sleeping` flag it checks after publishing.
+ *
+ * Levels:
+ *   - Runtime:      Logger::instance().set_level() (TargetECU --log-level).
+ *                   Records below it are dropped before any formatting.
+ *   - Compile-time: VECU_LOG_COMPILE_LEVEL (0 = DEBUG ... 3 = ERROR).
+ *                   LOG_* macros below it expand to nothing, so their
+ *                   arguments are not even evaluated.
+ *
+ * If a thread's ring is full the record is dropped and counted rather
+ * than blocking the caller; the writer reports the count. Records queued
+ * after shutdown() (or during static destruction) are discarded.
+ *
+ * Tags must be string literals (records keep the pointer).
+ */
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#ifndef VECU_LOG_COMPILE_LEVEL
+#define VECU_LOG_COMPILE_LEVEL 0
+#endif
+
+enum class LogLevel : uint8_t {
+    DEBUG = 0,
+    INFO  = 1,
+    WARN  = 2,
+    ERROR = 3,
+    OFF   = 4,
+};
+
+class Logger {
+public:
+    static constexpr size_t RING_CAPACITY = 1024;   // Records per thread (power of two)
+    static constexpr size_t MESSAGE_SIZE  = 232;    // Bytes of text per record
+
+    /**
+     * Never destroyed, so objects torn down during static destruction may
+     * still log safely; the writer is drained and stopped at exit.
+     */
+    static Logger& instance() {
+        static Logger* logger = [] {
+            auto* l = new Logger();
+            std::atexit([] { instance().shutdown(); });
+            return l;
+        }();
+        return *logger;
+    }
+
+    void     set_level(LogLevel level) { m_level.store(level, std::memory_order_relaxed); }
+    LogLevel level() const             { return m_level.load(std::memory_order_relaxed); }
+    bool     enabled(LogLevel level) const { return level >= this->level() && level != LogLevel::OFF; }
+
+    /// Records dropped because a thread's ring was full.
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Queue one record. Never blocks; drops the record if the
+     *        calling thread's ring is full.
+     * @param tag Component tag, e.g. "SESSION" (string literal), or "" for
+     *            continuation lines printed without a tag.
+     */
+    void log(LogLevel level, const char* tag, const char* fmt, ...) __attribute__((format(printf, 4, 5))) {
+        if (!enabled(level)) return;
+        Ring& ring = this_thread_ring();
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        if (tail - ring.head.load(std::memory_order_acquire) >= RING_CAPACITY) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Record& r = ring.slots[tail & (RING_CAPACITY - 1)];
+        r.seq   = m_seq.fetch_add(1, std::memory_order_relaxed);
+        r.level = level;
+        r.tag   = tag;
+        va_list args;
+        va_start(args, fmt);
+        int n = std::vsnprintf(r.text, sizeof(r.text), fmt, args);
+        va_end(args);
+        r.len = static_cast<uint16_t>(n < 0 ? 0 : std::min<size_t>(n, sizeof(r.text) - 1));
+        ring.tail.store(tail + 1, std::memory_order_release);
+        // Pairs with the fence in wait_for_records(): either the writer sees
+        // this record before it sleeps, or we see it sleeping.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false))
+            wake_writer();
+    }
+
+    /// Block until every record queued before this call has been written.
+    void flush() {
+        std::unique_lock<std::mutex> lk(m_flush_mutex);
+        if (!m_running) return;
+        uint64_t ticket = ++m_flush_requested;
+        lk.unlock();
+        wake_writer();
+        lk.lock();
+        m_flush_cv.wait(lk, [&] { return m_flush_done >= ticket || !m_running; });
+    }
+
+    /// Drain everything and stop the writer thread. Later records are lost.
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lk(m_flush_mutex);
+            if (!m_running) return;
+            m_stop = true;
+        }
+        wake_writer();
+        if (m_writer.joinable()) m_writer.join();
+    }
+
+    /// Parse "debug", "info", "warn", "error" or "off".
+    static std::optional<LogLevel> parse_level(const std::string& name) {
+        if (name == "debug") return LogLevel::DEBUG;
+        if (name == "info")  return LogLevel::INFO;
+        if (name == "warn")  return LogLevel::WARN;
+        if (name == "error") return LogLevel::ERROR;
+        if (name == "off")   return LogLevel::OFF;
+        return std::nullopt;
+    }
+
+private:
+    struct Record {
+        uint64_t    seq;
+        const char* tag;
+        LogLevel    level;
+        uint16_t    len;
+        char        text[MESSAGE_SIZE];
+    };
+
+    // One producer (the owning thread), one consumer (the writer thread).
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head{0};    // Next record to consume
+        alignas(64) std::atomic<uint64_t> tail{0};    // Next free slot
+        std::atomic<bool>                 closed{false};  // Owning thread has exited
+        std::array<Record, RING_CAPACITY> slots;
+    };
+
+    // Marks the ring closed when its thread exits; the writer reclaims it.
+    struct RingHandle {
+        std::shared_ptr<Ring> ring;
+        ~RingHandle() { if (ring) ring->closed.store(true, std::memory_order_release); }
+    };
+
+    Logger() : m_writer([this] { run_writer(); }) {}
+
+    Logger(const Logger&)            = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    Ring& this_thread_ring() {
+        thread_local RingHandle handle;
+        if (!handle.ring) {
+            handle.ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lk(m_rings_mutex);   // Once per thread
+            m_rings.push_back(handle.ring);
+        }
+        return *handle.ring;
+    }
+
+    void run_writer() {
+        std::vector<Record> batch;
+        uint64_t reported_drops = 0;
+        for (;;) {
+            uint64_t ticket;
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lk(m_flush_mutex);
+                ticket   = m_flush_requested;
+                stopping = m_stop;
+            }
+
+            std::vector<std::shared_ptr<Ring>> rings;
+            {
+                std::lock_guard<std::mutex> lk(m_rings_mutex);
+                rings = m_rings;
+            }
+            batch.clear();
+            for (auto& ring : rings) {
+                uint64_t head = ring->head.load(std::memory_order_relaxed);
+                uint64_t tail = ring->tail.load(std::memory_order_acquire);
+                for (; head != tail; ++head)
+                    batch.push_back(ring->slots[head & (RING_CAPACITY - 1)]);
+                ring->head.store(head, std::memory_order_release);
+            }
+            reclaim_closed_rings();
+
+            if (!batch.empty()) {
+                std::sort(batch.begin(), batch.end(),
+                          [](const Record& a, const Record& b) { return a.seq < b.seq; });
+                // Consecutive records for the same stream go out in one write;
+                // switching streams flushes, so stdout/stderr stay interleaved.
+                std::string pending;
+                FILE*       pending_stream = stdout;
+                auto emit = [&](FILE* stream, const char* tag, const char* text, size_t len) {
+                    if (stream != pending_stream && !pending.empty()) {
+                        std::fwrite(pending.data(), 1, pending.size(), pending_stream);
+                        std::fflush(pending_stream);
+                        pending.clear();
+                    }
+                    pending_stream = stream;
+                    if (tag && tag[0]) {
+                        pending += '[';
+                        pending += tag;
+                        pending += "] ";
+                    }
+                    pending.append(text, len);
+                    pending += '\n';
+                };
+                for (const Record& r : batch)
+                    emit(r.level >= LogLevel::WARN ? stderr : stdout, r.tag, r.text, r.len);
+                uint64_t drops = dropped();
+                if (drops != reported_drops) {
+                    std::string note = std::to_string(drops - reported_drops) + " record(s) dropped (ring full)";
+                    emit(stderr, "LOG", note.data(), note.size());
+                    reported_drops = drops;
+                }
+                std::fwrite(pending.data(), 1, pending.size(), pending_stream);
+                std::fflush(pending_stream);
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(m_flush_mutex);
+                m_flush_done = ticket;
+                if (stopping) m_running = false;
+            }
+            m_flush_cv.notify_all();
+            if (stopping) return;
+            if (batch.empty()) wait_for_records();
+        }
+    }
+
+    // Sleep until a producer, flush() or shutdown() wakes the writer, or
+    // IDLE_TIMEOUT passes (closed rings are reclaimed then).
+    void wait_for_records() {
+        std::unique_lock<std::mutex> lk(m_wake_mutex);
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool pending = false;
+        {
+            std::lock_guard<std::mutex> rings_lk(m_rings_mutex);
+            for (auto& ring : m_rings)
+                pending = pending || ring->head.load(std::memory_order_relaxed)
+                                     != ring->tail.load(std::memory_order_acquire);
+        }
+        if (!pending) m_wake_cv.wait_for(lk, IDLE_TIMEOUT, [this] { return m_wake_requested; });
+        m_wake_requested = false;
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    void wake_writer() {
+        {
+            std::lock_guard<std::mutex> lk(m_wake_mutex);
+            m_wake_requested = true;
+        }
+        m_wake_cv.notify_one();
+    }
+
+    void reclaim_closed_rings() {
+        std::lock_guard<std::mutex> lk(m_rings_mutex);
+        m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const std::shared_ptr<Ring>& r) {
+            return r->closed.load(std::memory_order_acquire)
+                && r->head.load(std::memory_order_relaxed) == r->tail.load(std::memory_order_acquire);
+        }), m_rings.end());
+    }
+
+    static constexpr std::chrono::milliseconds IDLE_TIMEOUT{200};
+
+    std::atomic<LogLevel> m_level{LogLevel::INFO};
+    std::atomic<uint64_t> m_seq{0};
+    std::atomic<uint64_t> m_dropped{0};
+
+    std::mutex                         m_rings_mutex;   // Registration / reclaim only
+    std::vector<std::shared_ptr<Ring>> m_rings;
+
+    std::atomic<bool>       m_sleeping{false};   // Writer is (about to be) waiting
+    std::mutex              m_wake_mutex;
+    std::condition_variable m_wake_cv;
+    bool                    m_wake_requested = false;
+
+    std::mutex              m_flush_mutex;
+    std::condition_variable m_flush_cv;
+    uint64_t                m_flush_requested = 0;
+    uint64_t                m_flush_done      = 0;
+    bool                    m_stop    = false;
+    bool                    m_running = true;
+
+    std::thread m_writer;   // Declared last: starts after everything above
+};
+
+// ---------------------------------------------------------------------------
+// Logging macros (printf-style). Below VECU_LOG_COMPILE_LEVEL they compile
+// to nothing; the dead call keeps format checking and silences unused-
+// variable warnings without evaluating the arguments.
+// ---------------------------------------------------------------------------
+#define VECU_LOG_DISABLED(level, tag, ...) \
+    do { if (false) Logger::instance().log(level, tag, __VA_ARGS__); } while (0)
+
+#if VECU_LOG_COMPILE_LEVEL <= 0
+#define LOG_DEBUG(tag, ...) Logger::instance().log(LogLevel::DEBUG, tag, __VA_ARGS__)
+#else
+#define LOG_DEBUG(tag, ...) VECU_LOG_DISABLED(LogLevel::DEBUG, tag, __VA_ARGS__)
+#endif
+
+#if VECU_LOG_COMPILE_LEVEL <= 1
+#define LOG_INFO(tag, ...)  Logger::instance().log(LogLevel::INFO, tag, __VA_ARGS__)
+#else
+#define LOG_INFO(tag, ...)  VECU_LOG_DISABLED(LogLevel::INFO, tag, __VA_ARGS__)
+#endif
+
+#if VECU_LOG_COMPILE_LEVEL <= 2
+#define LOG_WARN(tag, ...)  Logger::instance().log(LogLevel::WARN, tag, __VA_ARGS__)
+#else
+#define LOG_WARN(tag, ...)  VECU_LOG_DISABLED(LogLevel::WARN, tag, __VA_ARGS__)
+#endif
+
+#define LOG_ERROR(tag, ...) Logger::instance().log(LogLevel::ERROR, tag, __VA_ARGS__)
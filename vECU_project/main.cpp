@@ -9,26 +9,85 @@
 #include <sstream>
 #include <fstream>
 #include <cstdio>
-#include <mutex>
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
 
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 
 #include "ecu_state.hpp"
+#include "ecu_config.hpp"
 #include "nvram_manager.hpp"
 #include "dtc_manager.hpp"
+#include "streaming_digest.hpp"
+#include "download_registry.hpp"
+#include "slot_manager.hpp"
+#include "boot_verdict.hpp"
+#include "boot_timer.hpp"
+#include "merkle_hash.hpp"
+#include "thread_pool.hpp"
+#include "crypto_service.hpp"
+#include "did_registry.hpp"
+#include "response_cache.hpp"
+#include "dynamic_dids.hpp"
+#include "logger.hpp"
 #include "doip_server.hpp"
 
+#include <unistd.h>
+
 // ---------------------------------------------------------------------------
 // Global ECU state
+//
+// Thread-safety (DoIP handlers run concurrently on the I/O thread pool):
+//   g_ecu_state, g_running, g_engine_temp_c, g_fan_active
+//       std::atomic — safe to read/write from any thread.
+//   g_dtc_manager, g_nvram, g_download_registry
+//       Internally synchronized — every public member function may be
+//       called concurrently from the main thread and any session handler.
+//   g_executable_path, g_config, g_boot_args
+//       Written once in main() before the server starts; read-only after.
+//   g_slots, g_boot_cache
+//       Paths/policy fixed in main(); all their state lives in g_nvram.
+//   g_boot_timer
+//       Internally synchronized (written by the boot sequence, read by $22).
+//   g_workers
+//       Created in main() before the server starts; ThreadPool is
+//       internally synchronized. Sessions post $37 verification and
+//       apply_update() to it.
+//   g_crypto, g_key_rotation_requested
+//       Internally synchronized / atomic. The key is loaded in main() and
+//       reloaded by the main loop after SIGHUP.
+//   g_dids
+//       Internally synchronized; filled by register_data_identifiers()
+//       before the server starts. Encoders run on session threads.
+//   g_dynamic_dids
+//       Internally synchronized; $2C adds and removes its dDIDs in g_dids
+//       from session threads.
+//   g_responses
+//       Internally synchronized; defined before the server starts and
+//       rebuilt by whichever thread changes a watched NVRAM key.
 // ---------------------------------------------------------------------------
+EcuConfig             g_config;
 std::atomic<EcuState> g_ecu_state(EcuState::BOOT);
 std::atomic<bool>     g_running(true);
 
 NVRAMManager g_nvram("nvram.dat");
 DTCManager   g_dtc_manager(g_nvram);
+SlotManager  g_slots(g_nvram);
+BootVerdictCache g_boot_cache(g_nvram);
+BootTimer    g_boot_timer;
+std::unique_ptr<ThreadPool> g_workers;   // CPU-bound work (image hashing, $37)
+CryptoService     g_crypto;               // Firmware signing key ($37)
+std::atomic<bool> g_key_rotation_requested(false);
+DidRegistry       g_dids;                 // $22 ReadDataByIdentifier
+ResponseCache     g_responses(g_nvram);   // Prebuilt static responses (VIN, F189, F18C)
+DynamicDids       g_dynamic_dids(g_dids); // $2C dDIDs F200-F2FF
 std::string  g_executable_path;
+std::vector<std::string> g_boot_args;   // argv, replayed when switching slots
+
+// Interrupted OTA download kept for resume (internally synchronized)
+DownloadRegistry g_download_registry;
 
 // ---------------------------------------------------------------------------
 // Simulated sensor data (read by $22 RDBI handler in doip_session.hpp)
@@ -36,15 +95,12 @@ std::string  g_executable_path;
 std::atomic<int>  g_engine_temp_c(20);   // Degrees Celsius, starts at ambient
 std::atomic<bool> g_fan_active(false);    // Cooling fan state
 
-// Mutex protecting console output from main + server threads
-std::mutex g_console_mutex;
-
 // ---------------------------------------------------------------------------
 // Networking
 // ---------------------------------------------------------------------------
 boost::asio::io_context g_io_context;
 std::unique_ptr<DoIPServer> g_doip_server;
-std::thread g_server_thread;
+std::thread g_server_thread;   // Runs DoIPServer::run(), which owns the I/O pool
 
 // ---------------------------------------------------------------------------
 // Function Prototypes
@@ -55,7 +111,120 @@ void handle_signal(int signal);
 void start_network_server();
 void stop_network_server();
 std::optional<std::string> calculate_file_hash(const std::string& file_path);
-void apply_update(const std::string& current_executable_path);
+std::optional<std::string> calculate_merkle_root(const std::string& file_path);
+bool apply_update(const std::string& image_digest_hex, const std::string& merkle_root_hex);
+void reset_after_update();
+void reboot_into_slot(char slot);
+void hand_over_failed(const char* what, int err);
+void roll_back(const char* reason);
+void report_flash_wear();
+void register_data_identifiers();
+
+
+// ---------------------------------------------------------------------------
+// Emulated NVRAM flash: log this drive cycle's write cost, persist wear
+// ---------------------------------------------------------------------------
+void report_flash_wear() {
+    const FlashGeometry geo = g_nvram.flash().geometry();
+    const FlashDevice::Stats fs = g_nvram.flash().stats();
+    LOG_INFO("FLASH", "%u B pages, %u B erase blocks, %u blocks.",
+             geo.page_size, geo.block_size, geo.block_count());
+    LOG_INFO("FLASH", "This cycle: %llu NVRAM commit(s), %llu bytes -> %llu page program(s) + %llu by GC, "
+             "%llu erase(s), write amplification %.2f, busy %.1f ms.",
+             static_cast<unsigned long long>(g_nvram.stats().commits),
+             static_cast<unsigned long long>(fs.host_bytes),
+             static_cast<unsigned long long>(fs.host_programs),
+             static_cast<unsigned long long>(fs.gc_programs),
+             static_cast<unsigned long long>(fs.erases),
+             fs.write_amplification(geo.page_size), fs.busy_us / 1000.0);
+    LOG_INFO("FLASH", "Erase counts: min %u, mean %.2f, max %u; %u free block(s).",
+             fs.min_erase, fs.mean_erase, fs.max_erase, fs.free_blocks);
+    if (fs.overflows > 0)
+        LOG_WARN("FLASH", "%llu page write(s) did not fit the emulated flash.",
+                 static_cast<unsigned long long>(fs.overflows));
+    g_nvram.save_flash_wear();
+}
+
+
+// ---------------------------------------------------------------------------
+// $22 Data Identifiers (layouts in did_registry.hpp, all big-endian)
+// ---------------------------------------------------------------------------
+void register_data_identifiers() {
+    using Out = std::vector<uint8_t>;
+
+    // Simulated sensors, also as $2A periodic identifiers
+    auto engine_temp = [](Out& out) {
+        DidRegistry::push_be(out, static_cast<uint16_t>(static_cast<int16_t>(g_engine_temp_c.load())), 2);
+    };
+    auto fan_status = [](Out& out) {
+        out.push_back(g_fan_active.load() ? 0x01 : 0x00);
+    };
+    g_dids.add(DataID::ENGINE_TEMP, "ENGINE_TEMP", 2, engine_temp);
+    g_dids.add(DataID::FAN_STATUS, "FAN_STATUS", 1, fan_status);
+    g_dids.add(DataID::PERIODIC_ENGINE_TEMP, "ENGINE_TEMP", 2, engine_temp);
+    g_dids.add(DataID::PERIODIC_FAN_STATUS, "FAN_STATUS", 1, fan_status);
+
+    // ECU status
+    g_dids.add(DataID::DTC_COUNT, "DTC_COUNT", 2, [](Out& out) {
+        DidRegistry::push_be(out, std::min<size_t>(g_dtc_manager.size(), 0xFFFF), 2);
+    });
+    const auto started = std::chrono::steady_clock::now();
+    g_dids.add(DataID::UPTIME, "UPTIME", 4, [started](Out& out) {
+        auto up = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started);
+        DidRegistry::push_be(out, static_cast<uint64_t>(up.count()), 4);
+    });
+
+    // Identification: the value part of the prebuilt frames in g_responses
+    auto cached_value = [](CachedResponse which) {
+        return [which](Out& out) {
+            ResponseCache::Entry e = g_responses.get(which);
+            if (e.frame) out.insert(out.end(), e.frame->begin() + e.value_at, e.frame->end());
+        };
+    };
+    g_dids.add(DataID::FW_VERSION, "FW_VERSION", DidRegistry::VARIABLE, cached_value(CachedResponse::FW_VERSION));
+    g_dids.add(DataID::ECU_SERIAL, "ECU_SERIAL", DidRegistry::VARIABLE, cached_value(CachedResponse::ECU_SERIAL));
+
+    g_dids.add(DataID::FW_DIGEST, "FW_DIGEST", 32, [](Out& out) {
+        auto digest = StreamingDigest::from_hex(g_nvram.get_string("FIRMWARE_HASH_GOLDEN").value_or(""));
+        digest.resize(32);
+        out.insert(out.end(), digest.begin(), digest.end());
+    });
+
+    // Emulated NVRAM flash
+    g_dids.add(DataID::FLASH_STATS, "FLASH_STATS", 26, [](Out& out) {
+        const FlashGeometry geo = g_nvram.flash().geometry();
+        const FlashDevice::Stats fs = g_nvram.flash().stats();
+        double wa = fs.write_amplification(geo.page_size);
+        DidRegistry::push_be(out, g_nvram.stats().commits, 4);
+        DidRegistry::push_be(out, fs.host_bytes, 4);
+        DidRegistry::push_be(out, fs.host_programs, 4);
+        DidRegistry::push_be(out, fs.gc_programs, 4);
+        DidRegistry::push_be(out, fs.erases, 4);
+        DidRegistry::push_be(out, static_cast<uint64_t>(std::min(wa * 100.0, 65535.0)), 2);
+        DidRegistry::push_be(out, fs.busy_us / 1000, 4);
+    });
+    g_dids.add(DataID::FLASH_WEAR, "FLASH_WEAR", 22, [](Out& out) {
+        const FlashGeometry geo = g_nvram.flash().geometry();
+        const FlashDevice::Stats fs = g_nvram.flash().stats();
+        DidRegistry::push_be(out, geo.page_size, 2);
+        DidRegistry::push_be(out, geo.block_size, 4);
+        DidRegistry::push_be(out, geo.block_count(), 2);
+        DidRegistry::push_be(out, fs.free_blocks, 2);
+        DidRegistry::push_be(out, fs.min_erase, 4);
+        DidRegistry::push_be(out, fs.max_erase, 4);
+        DidRegistry::push_be(out, static_cast<uint64_t>(fs.mean_erase * 100.0), 4);
+    });
+
+    // Boot timing
+    g_dids.add(DataID::BOOT_TIMING, "BOOT_TIMING", 21, [](Out& out) {
+        const BootTimer::Report boot = g_boot_timer.last();
+        out.push_back(!boot.valid ? 0x00 : boot.warm ? 0x02 : 0x01);
+        DidRegistry::push_be(out, boot.total_us, 4);
+        for (uint64_t us : boot.phase_us) DidRegistry::push_be(out, us, 4);
+    });
+
+    LOG_INFO("UDS", "%zu data identifier(s) registered.", g_dids.table()->count());
+}
 
 
 // ---------------------------------------------------------------------------
@@ -64,36 +233,26 @@ void apply_update(const std::string& current_executable_path);
 std::optional<std::string> calculate_file_hash(const std::string& file_path) {
     std::ifstream file(file_path, std::ios::binary);
     if (!file.is_open()) {
-        std::cerr << "[HASH] ERROR: Could not open file: " << file_path << std::endl;
-        return std::nullopt;
-    }
-
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    if (!ctx || 1 != EVP_DigestInit_ex(ctx, EVP_sha256(), NULL)) {
-        if (ctx) EVP_MD_CTX_free(ctx);
+        LOG_ERROR("HASH", "ERROR: Could not open file: %s", file_path.c_str());
         return std::nullopt;
     }
 
+    StreamingDigest digest;
     char buf[4096];
     while (file.read(buf, sizeof(buf)) || file.gcount() > 0) {
-        if (1 != EVP_DigestUpdate(ctx, buf, file.gcount())) {
-            EVP_MD_CTX_free(ctx);
+        if (!digest.update(buf, file.gcount()))
             return std::nullopt;
-        }
     }
 
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int  hash_len = 0;
-    if (1 != EVP_DigestFinal_ex(ctx, hash, &hash_len)) {
-        EVP_MD_CTX_free(ctx);
-        return std::nullopt;
-    }
-    EVP_MD_CTX_free(ctx);
+    if (!digest.finalize()) return std::nullopt;
+    return digest.hex();
+}
 
-    std::ostringstream ss;
-    for (unsigned int i = 0; i < hash_len; ++i)
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    return ss.str();
+// Merkle root (--boot-hash merkle): leaves hashed on every worker thread
+std::optional<std::string> calculate_merkle_root(const std::string& file_path) {
+    auto root = MerkleHash::hash_file(file_path, g_workers.get());
+    if (!root) LOG_ERROR("HASH", "ERROR: Could not read file: %s", file_path.c_str());
+    return root;
 }
 
 
@@ -103,17 +262,32 @@ std::optional<std::string> calculate_file_hash(const std::string& file_path) {
 int main(int argc, char* argv[]) {
     if (argc < 1) return 1;
     g_executable_path = argv[0];
+    g_boot_args.assign(argv, argv + argc);
+    g_config = parse_ecu_config(argc, argv);
+    Logger::instance().set_level(g_config.log_level);
+    g_dtc_manager.set_flush_interval(std::chrono::milliseconds(g_config.dtc_flush_ms));
+    g_nvram.set_format(g_config.nvram_format);
+    g_nvram.flash().configure(g_config.flash);
+    g_slots.init(g_executable_path);
+    g_boot_cache.set_rehash_every(g_config.boot_rehash_every);
+    g_workers = std::make_unique<ThreadPool>(g_config.worker_threads);
+    if (!g_crypto.load_key(g_config.signing_key))
+        LOG_WARN("CRYPTO", "No signing key; signed updates will be rejected until SIGHUP reloads it.");
+    register_data_identifiers();
+    DoIPSession::define_cached_responses(g_responses);
 
     signal(SIGINT, handle_signal);
+    signal(SIGHUP, handle_signal);   // Signing-key rotation
 
-    std::cout << "============================================" << std::endl;
-    std::cout << "   Virtual ECU Simulation V2 Started" << std::endl;
-    std::cout << "   Press Ctrl+C to shut down." << std::endl;
-    std::cout << "============================================" << std::endl;
+    LOG_INFO("", "============================================");
+    LOG_INFO("", "   Virtual ECU Simulation V2 Started");
+    LOG_INFO("", "   Press Ctrl+C to shut down.");
+    LOG_INFO("", "============================================");
 
     start_network_server();
 
     while (g_running) {
+        if (g_key_rotation_requested.exchange(false)) g_crypto.rotate_key();
         switch (g_ecu_state.load()) {
             case EcuState::BOOT:
                 run_boot_sequence(g_executable_path);
@@ -122,21 +296,24 @@ int main(int argc, char* argv[]) {
                 run_application_mode();
                 break;
             case EcuState::UPDATE_PENDING:
-                {
-                    std::lock_guard<std::mutex> lk(g_console_mutex);
-                    std::cout << "[STATE] UPDATE_PENDING — waiting for firmware transfer..." << std::endl;
-                }
+                LOG_INFO("STATE", "UPDATE_PENDING — waiting for firmware transfer...");
                 std::this_thread::sleep_for(std::chrono::seconds(2));
                 break;
             case EcuState::BRICKED:
-                std::cerr << "[STATE] ECU is BRICKED. Halting." << std::endl;
+                LOG_ERROR("STATE", "ECU is BRICKED. Halting.");
                 g_running = false;
                 break;
         }
     }
 
     stop_network_server();
-    std::cout << "--- Virtual ECU Simulation Shutting Down ---" << std::endl;
+    g_dtc_manager.flush();
+    LOG_INFO("DTC", "%llu DTC change(s) persisted in %llu NVRAM commit(s).",
+             static_cast<unsigned long long>(g_dtc_manager.change_count()),
+             static_cast<unsigned long long>(g_dtc_manager.commit_count()));
+    report_flash_wear();
+    LOG_INFO("", "--- Virtual ECU Simulation Shutting Down ---");
+    Logger::instance().shutdown();
     return 0;
 }
 
@@ -146,10 +323,10 @@ int main(int argc, char* argv[]) {
 // ---------------------------------------------------------------------------
 void start_network_server() {
     try {
-        g_doip_server = std::make_unique<DoIPServer>(g_io_context, 13400);
+        g_doip_server = std::make_unique<DoIPServer>(g_io_context, 13400, g_config.io_threads);
         g_server_thread = std::thread([]() { g_doip_server->run(); });
     } catch (const std::exception& e) {
-        std::cerr << "[NET] Failed to start server: " << e.what() << std::endl;
+        LOG_ERROR("NET", "Failed to start server: %s", e.what());
         g_ecu_state = EcuState::BRICKED;
     }
 }
@@ -160,15 +337,72 @@ void stop_network_server() {
 }
 
 
+// ---------------------------------------------------------------------------
+// A/B slot hand-over: "reset" into another slot's image (exec in place)
+//
+// Returns only if the hand-over failed. A trial slot is then rolled back;
+// the ECU goes BRICKED only if there is no previous slot to fall back to.
+// ---------------------------------------------------------------------------
+void hand_over_failed(const char* what, int err) {
+    LOG_ERROR("BOOT", "CRITICAL: %s: %s", what, std::strerror(err));
+    if (g_slots.trial_pending()) roll_back("Slot hand-over failed");
+    else                         g_ecu_state = EcuState::BRICKED;
+}
+
+void reboot_into_slot(char slot) {
+    const std::string& path = g_slots.slot_path(slot);
+    LOG_INFO("BOOT", "Slot %c is active — handing over to %s", slot, path.c_str());
+    if (::access(path.c_str(), X_OK) != 0) {
+        hand_over_failed("Slot image not executable", errno);
+        return;
+    }
+
+    // Release port 13400 for the new image.
+    if (g_doip_server) g_doip_server->stop();
+    stop_network_server();
+    g_doip_server.reset();
+
+    std::vector<char*> args;
+    args.push_back(const_cast<char*>(path.c_str()));
+    for (size_t i = 1; i < g_boot_args.size(); ++i)
+        args.push_back(const_cast<char*>(g_boot_args[i].c_str()));
+    args.push_back(nullptr);
+    g_dtc_manager.flush();          // Pending DTCs would die with this image
+    g_nvram.checkpoint();           // Older images read nvram.dat only
+    Logger::instance().flush();     // exec discards anything still queued
+    ::execv(path.c_str(), args.data());
+
+    const int err = errno;
+    g_io_context.restart();         // Still this image: serve testers again
+    start_network_server();
+    hand_over_failed("Slot hand-over failed", err);
+}
+
+// Switch back to the previous slot; boots it right away.
+void roll_back(const char* reason) {
+    char failed = g_slots.active_slot();
+    auto prev   = g_slots.rollback();
+    if (!prev) {
+        LOG_ERROR("BOOT", "%s — no slot to roll back to. Entering BRICKED state.", reason);
+        g_ecu_state = EcuState::BRICKED;
+        return;
+    }
+    LOG_WARN("BOOT", "%s — rolling back from slot %c to slot %c.", reason, failed, *prev);
+    // Already running the previous image: just boot again (state stays BOOT).
+    if (!g_slots.is_running(*prev)) reboot_into_slot(*prev);
+}
+
+
 // ---------------------------------------------------------------------------
 // Boot sequence (Phase 3: Secure Boot)
 // ---------------------------------------------------------------------------
 void run_boot_sequence(const std::string& executable_path) {
-    std::cout << "[BOOT] Entering BOOT sequence..." << std::endl;
+    LOG_INFO("BOOT", "Entering BOOT sequence...");
+    g_boot_timer.start();
 
     // Load NVRAM
     if (!g_nvram.load()) {
-        std::cerr << "[BOOT] CRITICAL: Failed to load NVRAM." << std::endl;
+        LOG_ERROR("BOOT", "CRITICAL: Failed to load NVRAM.");
         g_dtc_manager.set_dtc(DTC::NVRAM_LOAD_FAILURE);
         g_ecu_state = EcuState::BRICKED;
         return;
@@ -176,51 +410,113 @@ void run_boot_sequence(const std::string& executable_path) {
 
     // Load persisted DTCs
     g_dtc_manager.load();
+    g_boot_timer.end_phase(BootPhase::NVRAM);
+
+    // A/B slot selection: boot whichever slot NVRAM marks active.
+    char slot = g_slots.active_slot();
+    if (!g_slots.is_running(slot)) {
+        reboot_into_slot(slot);    // Returns only on failure
+        return;
+    }
+    if (g_slots.trial_pending()) {
+        int attempts = g_slots.note_trial_attempt();
+        LOG_INFO("BOOT", "Trial boot of slot %c (attempt %d/%d).", slot, attempts, SlotManager::MAX_TRIAL_BOOTS);
+        if (attempts > SlotManager::MAX_TRIAL_BOOTS) {
+            roll_back("Trial slot never reached the application");
+            return;
+        }
+    }
+    g_boot_timer.end_phase(BootPhase::SLOT);
 
     // Secure Boot integrity check
-    std::cout << "[BOOT] Performing Secure Boot integrity check..." << std::endl;
+    LOG_INFO("BOOT", "Performing Secure Boot integrity check of slot %c...", slot);
 
-    auto golden_opt = g_nvram.get_string("FIRMWARE_HASH_GOLDEN");
+    auto golden_opt = g_slots.expected_hash(slot);
     if (!golden_opt) {
-        std::cerr << "[BOOT] CRITICAL: Golden hash not in NVRAM." << std::endl;
+        LOG_ERROR("BOOT", "CRITICAL: Golden hash not in NVRAM.");
         g_dtc_manager.set_dtc(DTC::SECURE_BOOT_FAILURE);
         g_ecu_state = EcuState::BRICKED;
         return;
     }
 
-    auto calc_opt = calculate_file_hash(executable_path);
+    // --boot-hash merkle checks the recorded Merkle root. A slot without
+    // one is checked with SHA-256 this time, and its root recorded.
+    const bool want_merkle = g_config.boot_hash == ImageHash::MERKLE;
+    auto merkle_golden = want_merkle ? g_slots.expected_merkle(slot) : std::nullopt;
+    const bool use_merkle = merkle_golden.has_value();
+    if (use_merkle) golden_opt = merkle_golden;
+    else if (want_merkle) LOG_INFO("BOOT", "No Merkle root recorded for slot %c; checking SHA-256.", slot);
+
+    // An image unchanged since its last full hash reuses that digest.
+    auto identity = ImageIdentity::of(executable_path);
+    const char* why = "image unreadable";
+    std::optional<std::string> calc_opt;
+    if (identity) calc_opt = g_boot_cache.lookup(*identity, why);
+    bool warm = calc_opt.has_value();
+    if (warm && *calc_opt != *golden_opt) {
+        LOG_INFO("BOOT", "Cached verdict is for another golden hash.");
+        g_boot_cache.forget();
+        warm = false;
+        why  = "cached verdict rejected";
+    }
+    if (warm) {
+        LOG_INFO("BOOT", "Image unchanged since its last full hash — using the cached verdict.");
+    } else {
+        LOG_INFO("BOOT", "Hashing the full image (%s%s).", why,
+                 use_merkle ? ", Merkle tree" : "");
+        calc_opt = use_merkle ? calculate_merkle_root(executable_path)
+                              : calculate_file_hash(executable_path);
+    }
     if (!calc_opt) {
-        std::cerr << "[BOOT] CRITICAL: Could not hash executable." << std::endl;
+        LOG_ERROR("BOOT", "CRITICAL: Could not hash executable.");
         g_dtc_manager.set_dtc(DTC::SECURE_BOOT_FAILURE);
-        g_ecu_state = EcuState::BRICKED;
+        roll_back("Slot image unreadable");
         return;
     }
 
-    std::cout << "  -> Golden Hash:     " << *golden_opt << std::endl;
-    std::cout << "  -> Calculated Hash: " << *calc_opt   << std::endl;
+    LOG_INFO("", "  -> Golden %s:     %s", use_merkle ? "Root" : "Hash", golden_opt->c_str());
+    LOG_INFO("", "  -> Calculated %s: %s", use_merkle ? "Root" : "Hash", calc_opt->c_str());
 
     if (*golden_opt != *calc_opt) {
-        std::cerr << "[BOOT] !!! INTEGRITY CHECK FAILED — entering BRICKED state." << std::endl;
+        LOG_ERROR("BOOT", "!!! INTEGRITY CHECK FAILED on slot %c.", slot);
         g_dtc_manager.set_dtc(DTC::SECURE_BOOT_FAILURE);
-        g_ecu_state = EcuState::BRICKED;
+        roll_back("Secure boot failed");
         return;
     }
 
-    std::cout << "[BOOT] Integrity check PASSED." << std::endl;
+    LOG_INFO("BOOT", "Integrity check PASSED.");
+    std::string verified = *calc_opt;
+    if (want_merkle && !use_merkle) {
+        if (auto root = calculate_merkle_root(executable_path)) {
+            g_slots.record_merkle(slot, *root);
+            LOG_INFO("BOOT", "Recorded Merkle root of slot %c.", slot);
+            verified = *root;   // What the next boot compares against
+        }
+    }
+    if (!warm && identity) g_boot_cache.store(*identity, verified);
+    g_boot_timer.end_phase(BootPhase::INTEGRITY);
 
     auto fw_ver = g_nvram.get_string("FIRMWARE_VERSION");
-    if (fw_ver) std::cout << "[BOOT] Firmware Version: " << *fw_ver << std::endl;
+    if (fw_ver) LOG_INFO("BOOT", "Firmware Version: %s", fw_ver->c_str());
 
-    std::cout << "[BOOT] Initializing peripherals (simulated)..." << std::endl;
+    LOG_INFO("BOOT", "Initializing peripherals (simulated)...");
     std::this_thread::sleep_for(std::chrono::milliseconds(400));
-    std::cout << "[BOOT] Power-On Self-Test (POST) complete." << std::endl;
+    LOG_INFO("BOOT", "Power-On Self-Test (POST) complete.");
     std::this_thread::sleep_for(std::chrono::milliseconds(400));
 
     // Reset transient sensor state
     g_engine_temp_c = 20;
     g_fan_active    = false;
+    g_boot_timer.end_phase(BootPhase::INIT);
+
+    const BootTimer::Report boot = g_boot_timer.finish(warm);
+    LOG_INFO("BOOT", "%s start in %.1f ms: nvram %.1f, slot %.1f, integrity %.1f, init %.1f ms.",
+             boot.warm ? "Warm" : "Cold", boot.total_us / 1000.0,
+             boot.phase_us[0] / 1000.0, boot.phase_us[1] / 1000.0,
+             boot.phase_us[2] / 1000.0, boot.phase_us[3] / 1000.0);
 
-    std::cout << "[BOOT] Boot successful. -> APPLICATION state." << std::endl;
+    g_slots.confirm_boot();
+    LOG_INFO("BOOT", "Boot successful. -> APPLICATION state.");
     g_ecu_state = EcuState::APPLICATION;
 }
 
@@ -250,12 +546,10 @@ void run_application_mode() {
     // Fan control with hysteresis
     if (!fan && temp >= 90) {
         fan = true;
-        std::lock_guard<std::mutex> lk(g_console_mutex);
-        std::cout << "[APP] Cooling fan ACTIVATED at " << temp << "°C" << std::endl;
+        LOG_INFO("APP", "Cooling fan ACTIVATED at %d°C", temp);
     } else if (fan && temp <= 70) {
         fan = false;
-        std::lock_guard<std::mutex> lk(g_console_mutex);
-        std::cout << "[APP] Cooling fan DEACTIVATED at " << temp << "°C" << std::endl;
+        LOG_INFO("APP", "Cooling fan DEACTIVATED at %d°C", temp);
     }
 
     // Fault detection
@@ -271,13 +565,7 @@ void run_application_mode() {
     g_engine_temp_c = temp;
     g_fan_active    = fan;
 
-    {
-        std::lock_guard<std::mutex> lk(g_console_mutex);
-        std::cout << "[APP] Tick — Temp: " << temp << "°C"
-                  << "  Fan: " << (fan ? "ON" : "OFF")
-                  << (fault ? "  [FAULT]" : "")
-                  << std::endl;
-    }
+    LOG_INFO("APP", "Tick — Temp: %d°C  Fan: %s%s", temp, fan ? "ON" : "OFF", fault ? "  [FAULT]" : "");
 
     std::this_thread::sleep_for(std::chrono::seconds(2));
 }
@@ -291,27 +579,37 @@ void handle_signal(int signal) {
         std::cout << "\n[INFO] Shutdown signal received." << std::endl;
         if (g_doip_server) g_doip_server->stop();
         g_running = false;
+    } else if (signal == SIGHUP) {
+        g_key_rotation_requested = true;
     }
 }
 
 
 // ---------------------------------------------------------------------------
 // OTA update application (Phase 4)
+//
+// The verified image already sits in the inactive slot; switching is one
+// NVRAM save. The running image is left alone, so a bad new slot can be
+// rolled back to without another download.
+//
+// apply_update() runs on a g_workers thread while the session answers
+// 7F 37 78; the session calls reset_after_update() once $77 has been sent.
 // ---------------------------------------------------------------------------
-void apply_update(const std::string& current_executable_path) {
-    std::cout << "[OTA] Applying update..." << std::endl;
-    if (std::rename("update.bin", current_executable_path.c_str()) != 0) {
-        perror("[OTA] CRITICAL: Failed to apply update");
-    } else {
-        // Set execute permissions via C++17 filesystem
-        namespace fs = std::filesystem;
-        try {
-            fs::permissions(current_executable_path,
-                fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec,
-                fs::perm_options::add);
-        } catch (...) {}
-        std::cout << "[OTA] Update applied. ECU will reboot." << std::endl;
+bool apply_update(const std::string& image_digest_hex, const std::string& merkle_root_hex) {
+    char next = g_slots.inactive_slot();
+    LOG_INFO("OTA", "Applying update: switching to slot %c...", next);
+    g_dtc_manager.flush();    // Pending DTCs must be on disk before the reboot
+    if (!g_slots.commit_switch(image_digest_hex, merkle_root_hex)) {
+        LOG_ERROR("OTA", "CRITICAL: Failed to switch to slot %c; slot %c stays active.",
+                  next, g_slots.active_slot());
+        g_dtc_manager.set_dtc(DTC::OTA_FILE_WRITE_ERROR);
+        return false;
     }
+    LOG_INFO("OTA", "Slot %c active (trial boot). ECU will reboot.", next);
+    return true;
+}
+
+void reset_after_update() {
     if (g_doip_server) g_doip_server->stop();
     g_running = false;
 }
@@ -0,0 +1,180 @@
+#pragma once
+
+/**
+ * @file merkle_hash.hpp
+ * @brief Tree-hash image digest whose leaves can be hashed on every core.
+ *
+ * A plain SHA-256 over the image is one sequential stream, so secure boot
+ * of a large image is bound to one core. The Merkle root instead splits
+ * the image into fixed LEAF_SIZE leaves, hashes them independently and
+ * combines the leaf digests pairwise:
+ *
+ *   leaf = SHA-256(0x00 || leaf bytes)
+ *   node = SHA-256(0x01 || left || right)     (an odd node moves up as is)
+ *
+ * The 0x00/0x01 prefixes keep a leaf from ever being taken for a node.
+ * An empty image has the root SHA-256(0x00).
+ *
+ * MerkleHash::hash_file() hashes a file's leaves in parallel on a
+ * ThreadPool; MerkleBuilder computes the same root incrementally from
+ * data arriving in order (OTA $36 blocks).
+ */
+
+#include <array>
+#include <vector>
+#include <string>
+#include <optional>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "streaming_digest.hpp"
+#include "thread_pool.hpp"
+
+class MerkleHash {
+public:
+    static constexpr size_t LEAF_SIZE = 1024 * 1024;
+
+    using Digest = std::array<uint8_t, 32>;
+
+    static Digest leaf(const void* data, size_t len) {
+        static const uint8_t PREFIX = 0x00;
+        StreamingDigest d;
+        d.update(&PREFIX, 1);
+        d.update(data, len);
+        return finish(d);
+    }
+
+    static Digest node(const Digest& left, const Digest& right) {
+        static const uint8_t PREFIX = 0x01;
+        StreamingDigest d;
+        d.update(&PREFIX, 1);
+        d.update(left.data(), left.size());
+        d.update(right.data(), right.size());
+        return finish(d);
+    }
+
+    /// Combine leaf digests (in image order) into the root.
+    static Digest root(std::vector<Digest> level) {
+        if (level.empty()) return leaf(nullptr, 0);
+        while (level.size() > 1) {
+            std::vector<Digest> up;
+            up.reserve((level.size() + 1) / 2);
+            for (size_t i = 0; i + 1 < level.size(); i += 2) up.push_back(node(level[i], level[i + 1]));
+            if (level.size() % 2) up.push_back(level.back());
+            level = std::move(up);
+        }
+        return level.front();
+    }
+
+    static std::string hex(const Digest& d) {
+        return StreamingDigest::to_hex(std::vector<uint8_t>(d.begin(), d.end()));
+    }
+
+    /**
+     * @brief Merkle root (hex) of the file at @p path.
+     * @param pool Leaves are spread over its workers and the calling
+     *             thread; nullptr hashes them all on the calling thread.
+     * @return std::nullopt if the file cannot be read.
+     */
+    static std::optional<std::string> hash_file(const std::string& path, ThreadPool* pool) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::nullopt;
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        const uint64_t size   = static_cast<uint64_t>(st.st_size);
+        const size_t   leaves = static_cast<size_t>((size + LEAF_SIZE - 1) / LEAF_SIZE);
+        std::vector<Digest> digests(leaves);
+        std::atomic<bool> failed{false};
+
+        auto hash_leaf = [&](size_t i) {
+            thread_local std::vector<char> buf(LEAF_SIZE);
+            const uint64_t offset = static_cast<uint64_t>(i) * LEAF_SIZE;
+            const size_t   len    = static_cast<size_t>(std::min<uint64_t>(LEAF_SIZE, size - offset));
+            size_t got = 0;
+            while (got < len) {
+                ssize_t n = ::pread(fd, buf.data() + got, len - got, static_cast<off_t>(offset + got));
+                if (n <= 0) {
+                    failed = true;
+                    return;
+                }
+                got += static_cast<size_t>(n);
+            }
+            digests[i] = leaf(buf.data(), len);
+        };
+        if (pool) {
+            pool->parallel_for(leaves, hash_leaf);
+        } else {
+            for (size_t i = 0; i < leaves; ++i) hash_leaf(i);
+        }
+        ::close(fd);
+        if (failed) return std::nullopt;
+        return hex(root(std::move(digests)));
+    }
+
+private:
+    static Digest finish(StreamingDigest& d) {
+        Digest out{};
+        if (d.finalize() && d.digest().size() == out.size())
+            std::copy(d.digest().begin(), d.digest().end(), out.begin());
+        return out;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// MerkleBuilder — the same root from data fed in order
+// ---------------------------------------------------------------------------
+class MerkleBuilder {
+public:
+    void update(const uint8_t* data, size_t len) {
+        while (len > 0) {
+            if (!m_leaf) start_leaf();
+            size_t take = std::min(len, MerkleHash::LEAF_SIZE - m_leaf_bytes);
+            m_leaf->update(data, take);
+            m_leaf_bytes += take;
+            data += take;
+            len  -= take;
+            if (m_leaf_bytes == MerkleHash::LEAF_SIZE) flush_leaf();
+        }
+    }
+
+    /// Hash the last partial leaf and compute the root. Idempotent.
+    void finalize() {
+        if (m_finalized) return;
+        m_finalized = true;
+        if (m_leaf) flush_leaf();
+        m_root = MerkleHash::root(std::move(m_leaves));
+    }
+
+    /// Root (hex); empty until finalize().
+    std::string hex() const { return m_finalized ? MerkleHash::hex(m_root) : std::string(); }
+
+private:
+    std::optional<StreamingDigest>   m_leaf;         // Leaf being filled
+    size_t                           m_leaf_bytes = 0;
+    std::vector<MerkleHash::Digest>  m_leaves;
+    MerkleHash::Digest               m_root{};
+    bool                             m_finalized = false;
+
+    void start_leaf() {
+        static const uint8_t PREFIX = 0x00;
+        m_leaf.emplace();
+        m_leaf->update(&PREFIX, 1);
+        m_leaf_bytes = 0;
+    }
+
+    void flush_leaf() {
+        MerkleHash::Digest d{};
+        if (m_leaf->finalize() && m_leaf->digest().size() == d.size())
+            std::copy(m_leaf->digest().begin(), m_leaf->digest().end(), d.begin());
+        m_leaves.push_back(d);
+        m_leaf.reset();
+    }
+};
@@ -0,0 +1,362 @@
+#pragma once
+
+/**
+ * @file nvram_image.hpp
+ * @brief Memory-mapped binary NVRAM image with typed values.
+ *
+ * The text NVRAM file ("KEY=VALUE" lines) has to be parsed in full at boot,
+ * and every consumer then converts strings again (hex hashes, the DTC
+ * list). The binary image is laid out so a lookup is a binary search over a
+ * fixed-size directory and a pointer into the mapping:
+ *
+ *   Header (24 bytes):
+ *     magic "VNI1" | version (2) | reserved (2) | entryCount (4)
+ *     | dataOffset (4) | fileSize (4) | crc32 of bytes [24, fileSize) (4)
+ *   Directory (entryCount x 16 bytes, sorted by key):
+ *     keyOffset (4) | keyLen (2) | type (1) | reserved (1)
+ *     | valueOffset (4) | valueLen (4)
+ *   Data: keys and values, back to back.
+ *   (integers little-endian)
+ *
+ * Values are stored natively: a U32 as 4 bytes, a hash as its raw bytes,
+ * the DTC list as packed 4-byte records. The text form of each value is
+ * fixed by its type (see NVRAMValue::to_text()), so an image converts to
+ * the text file and back without loss. Which type a key gets when read
+ * from text is decided by the schema in nvram_field_spec(); keys it does
+ * not list, and values that do not parse as their type, stay STRING.
+ */
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <optional>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+enum class NVRAMType : uint8_t {
+    STRING = 0,   // Free text, stored as is
+    U32    = 1,   // Unsigned integer; decimal in text
+    BYTES  = 2,   // Raw bytes (e.g. a SHA-256 digest); lowercase hex in text
+    BLOB   = 3,   // Array of fixed-size records; "HEX,HEX,..." in text, "NONE" if empty
+};
+
+/// On-disk format of the NVRAM base file.
+enum class NVRAMFormat { TEXT, BINARY };
+
+struct NVRAMFieldSpec {
+    const char* key;
+    NVRAMType   type;
+    uint16_t    record_size;   // BLOB only
+};
+
+/// Schema: the type each known key is stored as.
+inline const NVRAMFieldSpec* nvram_field_spec(std::string_view key) {
+    static const NVRAMFieldSpec SPECS[] = {
+        {"ACTIVE_DTCS",          NVRAMType::BLOB,  4},   // Code (3) + status (1)
+        {"BOOT_VERDICT",         NVRAMType::BYTES, 0},   // See boot_verdict.hpp
+        {"FIRMWARE_HASH_GOLDEN", NVRAMType::BYTES, 0},
+        {"FIRMWARE_MERKLE_GOLDEN", NVRAMType::BYTES, 0}, // See merkle_hash.hpp
+        {"SLOT_A_HASH",          NVRAMType::BYTES, 0},
+        {"SLOT_A_MERKLE",        NVRAMType::BYTES, 0},
+        {"SLOT_B_HASH",          NVRAMType::BYTES, 0},
+        {"SLOT_B_MERKLE",        NVRAMType::BYTES, 0},
+        {"TRIAL_BOOT",           NVRAMType::U32,   0},
+        {"TRIAL_BOOT_ATTEMPTS",  NVRAMType::U32,   0},
+    };
+    for (const auto& spec : SPECS)
+        if (key == spec.key) return &spec;
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// NVRAMValue — one typed value in its native encoding
+// ---------------------------------------------------------------------------
+struct NVRAMValue {
+    NVRAMType   type = NVRAMType::STRING;
+    std::string data;
+
+    bool operator==(const NVRAMValue& o) const { return type == o.type && data == o.data; }
+    bool operator!=(const NVRAMValue& o) const { return !(*this == o); }
+
+    static NVRAMValue from_u32(uint32_t v) {
+        NVRAMValue out{NVRAMType::U32, std::string(4, '\0')};
+        for (int i = 0; i < 4; ++i) out.data[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+        return out;
+    }
+
+    static std::optional<uint32_t> decode_u32(std::string_view data) {
+        if (data.size() != 4) return std::nullopt;
+        uint32_t v = 0;
+        for (int i = 3; i >= 0; --i) v = (v << 8) | static_cast<uint8_t>(data[i]);
+        return v;
+    }
+
+    /// Text form of a value of @p type stored under @p key.
+    static std::string to_text(std::string_view key, NVRAMType type, std::string_view data) {
+        static const char HEX_LOWER[] = "0123456789abcdef";
+        static const char HEX_UPPER[] = "0123456789ABCDEF";
+        switch (type) {
+            case NVRAMType::U32:
+                if (auto v = decode_u32(data)) return std::to_string(*v);
+                return std::string(data);
+            case NVRAMType::BYTES: {
+                std::string out;
+                out.reserve(data.size() * 2);
+                for (unsigned char c : data) {
+                    out.push_back(HEX_LOWER[c >> 4]);
+                    out.push_back(HEX_LOWER[c & 0x0F]);
+                }
+                return out;
+            }
+            case NVRAMType::BLOB: {
+                if (data.empty()) return "NONE";
+                const NVRAMFieldSpec* spec = nvram_field_spec(key);
+                size_t record = spec && spec->record_size ? spec->record_size : data.size();
+                std::string out;
+                out.reserve(data.size() * 2 + data.size() / record);
+                for (size_t i = 0; i < data.size(); ++i) {
+                    if (i > 0 && i % record == 0) out.push_back(',');
+                    unsigned char c = static_cast<unsigned char>(data[i]);
+                    out.push_back(HEX_UPPER[c >> 4]);
+                    out.push_back(HEX_UPPER[c & 0x0F]);
+                }
+                return out;
+            }
+            case NVRAMType::STRING:
+            default:
+                return std::string(data);
+        }
+    }
+
+    std::string to_text(std::string_view key) const { return to_text(key, type, data); }
+
+    /// Parse the text form of @p key's value according to the schema.
+    static NVRAMValue from_text(std::string_view key, const std::string& text) {
+        const NVRAMFieldSpec* spec = nvram_field_spec(key);
+        if (!spec) return {NVRAMType::STRING, text};
+        switch (spec->type) {
+            case NVRAMType::U32: {
+                char* end = nullptr;
+                unsigned long v = std::strtoul(text.c_str(), &end, 10);
+                if (text.empty() || *end != '\0' || v > 0xFFFFFFFFul) break;
+                return from_u32(static_cast<uint32_t>(v));
+            }
+            case NVRAMType::BYTES: {
+                std::string raw;
+                if (!decode_hex(text, raw)) break;
+                return {NVRAMType::BYTES, std::move(raw)};
+            }
+            case NVRAMType::BLOB: {
+                // Malformed records are skipped, not fatal: one bad DTC
+                // must not cost the rest of the list.
+                NVRAMValue out{NVRAMType::BLOB, {}};
+                if (text == "NONE") return out;
+                size_t pos = 0;
+                while (pos <= text.size()) {
+                    size_t comma = text.find(',', pos);
+                    if (comma == std::string::npos) comma = text.size();
+                    std::string raw;
+                    if (comma - pos == 2u * spec->record_size
+                        && decode_hex(text.substr(pos, comma - pos), raw))
+                        out.data += raw;
+                    pos = comma + 1;
+                }
+                return out;
+            }
+            case NVRAMType::STRING:
+                break;
+        }
+        return {NVRAMType::STRING, text};
+    }
+
+private:
+    static bool decode_hex(const std::string& text, std::string& out) {
+        if (text.size() % 2 != 0) return false;
+        auto nibble = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+        out.resize(text.size() / 2);
+        for (size_t i = 0; i < out.size(); ++i) {
+            int hi = nibble(text[2 * i]), lo = nibble(text[2 * i + 1]);
+            if (hi < 0 || lo < 0) return false;
+            out[i] = static_cast<char>((hi << 4) | lo);
+        }
+        return true;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// NVRAMImage — read-only mapping of a binary image
+// ---------------------------------------------------------------------------
+class NVRAMImage {
+public:
+    static constexpr char     MAGIC[4]    = {'V', 'N', 'I', '1'};
+    static constexpr uint16_t VERSION     = 1;
+    static constexpr size_t   HEADER_SIZE = 24;
+    static constexpr size_t   ENTRY_SIZE  = 16;
+
+    /// A field as it sits in the mapping.
+    struct Field {
+        std::string_view key;
+        NVRAMType        type;
+        std::string_view value;
+    };
+
+    NVRAMImage() = default;
+    ~NVRAMImage() { close(); }
+
+    NVRAMImage(const NVRAMImage&)            = delete;
+    NVRAMImage& operator=(const NVRAMImage&) = delete;
+
+    /// True if @p data (at least the first 4 bytes of a file) is an image.
+    static bool has_magic(std::string_view data) {
+        return data.size() >= sizeof(MAGIC) && std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    /**
+     * @brief Map @p path and validate it.
+     *
+     * Every offset is checked here, so lookups afterwards need no bounds
+     * checks. @return false if the file is missing, truncated or corrupt.
+     */
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+            ::close(fd);
+            return false;
+        }
+        void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        m_base = static_cast<const char*>(p);
+        m_size = static_cast<size_t>(st.st_size);
+        if (!validate()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (m_base) ::munmap(const_cast<char*>(m_base), m_size);
+        m_base  = nullptr;
+        m_size  = 0;
+        m_count = 0;
+    }
+
+    bool   is_open()   const { return m_base != nullptr; }
+    size_t size()      const { return m_count; }
+    size_t file_size() const { return m_size; }
+    uint32_t checksum() const { return is_open() ? le32(m_base + 20) : 0; }
+
+    /// i-th field in key order.
+    Field at(size_t i) const {
+        const char* e = m_base + HEADER_SIZE + i * ENTRY_SIZE;
+        return {std::string_view(m_base + le32(e), le16(e + 4)),
+                static_cast<NVRAMType>(static_cast<uint8_t>(e[6])),
+                std::string_view(m_base + le32(e + 8), le32(e + 12))};
+    }
+
+    std::optional<Field> find(std::string_view key) const {
+        size_t lo = 0, hi = m_count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            Field f = at(mid);
+            int c = f.key.compare(key);
+            if (c == 0) return f;
+            if (c < 0) lo = mid + 1;
+            else       hi = mid;
+        }
+        return std::nullopt;
+    }
+
+    /// Serialize @p fields as an image.
+    static std::string build(const std::map<std::string, NVRAMValue>& fields) {
+        const size_t count = fields.size();
+        size_t data_offset = HEADER_SIZE + count * ENTRY_SIZE;
+        size_t total = data_offset;
+        for (const auto& [key, value] : fields) total += key.size() + value.data.size();
+
+        std::string out(total, '\0');
+        std::memcpy(&out[0], MAGIC, sizeof(MAGIC));
+        put_le(out, 4, VERSION, 2);
+        put_le(out, 8, count, 4);
+        put_le(out, 12, data_offset, 4);
+        put_le(out, 16, total, 4);
+
+        size_t entry = HEADER_SIZE, pos = data_offset;
+        for (const auto& [key, value] : fields) {
+            put_le(out, entry, pos, 4);
+            put_le(out, entry + 4, key.size(), 2);
+            out[entry + 6] = static_cast<char>(value.type);
+            out.replace(pos, key.size(), key);
+            pos += key.size();
+            put_le(out, entry + 8, pos, 4);
+            put_le(out, entry + 12, value.data.size(), 4);
+            out.replace(pos, value.data.size(), value.data);
+            pos += value.data.size();
+            entry += ENTRY_SIZE;
+        }
+        put_le(out, 20, body_crc(out.data(), out.size()), 4);
+        return out;
+    }
+
+    /// The checksum an image built by build() carries in its header.
+    static uint32_t checksum_of(const std::string& image) {
+        return image.size() >= HEADER_SIZE ? le32(image.data() + 20) : 0;
+    }
+
+private:
+    const char* m_base  = nullptr;
+    size_t      m_size  = 0;
+    size_t      m_count = 0;
+
+    static uint16_t le16(const char* p) {
+        return static_cast<uint16_t>(static_cast<uint8_t>(p[0]) | (static_cast<uint8_t>(p[1]) << 8));
+    }
+    static uint32_t le32(const char* p) {
+        return  static_cast<uint32_t>(static_cast<uint8_t>(p[0]))
+             | (static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 8)
+             | (static_cast<uint32_t>(static_cast<uint8_t>(p[2])) << 16)
+             | (static_cast<uint32_t>(static_cast<uint8_t>(p[3])) << 24);
+    }
+    static void put_le(std::string& out, size_t at, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i) out[at + i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+    static uint32_t body_crc(const char* image, size_t size) {
+        return static_cast<uint32_t>(::crc32(0L, reinterpret_cast<const Bytef*>(image + HEADER_SIZE),
+                                             static_cast<uInt>(size - HEADER_SIZE)));
+    }
+
+    bool validate() {
+        if (!has_magic(std::string_view(m_base, m_size)) || le16(m_base + 4) != VERSION) return false;
+        if (le32(m_base + 16) != m_size || body_crc(m_base, m_size) != le32(m_base + 20)) return false;
+        size_t count = le32(m_base + 8);
+        if (count > (m_size - HEADER_SIZE) / ENTRY_SIZE) return false;
+        m_count = count;
+        std::string_view prev;
+        for (size_t i = 0; i < count; ++i) {
+            const char* e = m_base + HEADER_SIZE + i * ENTRY_SIZE;
+            uint64_t key_end   = uint64_t(le32(e)) + le16(e + 4);
+            uint64_t value_end = uint64_t(le32(e + 8)) + le32(e + 12);
+            if (key_end > m_size || value_end > m_size || static_cast<uint8_t>(e[6]) > 3) return false;
+            Field f = at(i);
+            if (i > 0 && !(prev < f.key)) return false;   // find() relies on the order
+            prev = f.key;
+        }
+        return true;
+    }
+};
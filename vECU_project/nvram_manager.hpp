@@ -1,69 +1,200 @@
 #pragma once // Ensures this file is included only once per compilation.
 
-#include <iostream>
-#include <fstream>
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 #include <optional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "logger.hpp"
+#include "nvram_image.hpp"
+#include "flash_device.hpp"
 
 /**
  * @class NVRAMManager
  * @brief Simulates a simple Non-Volatile RAM by reading from and writing to a file.
  *
- * This class provides a basic key-value store that persists data in a plain text file,
+ * This class provides a basic key-value store that persists data in a file,
  * mimicking how an ECU might store configuration data in its flash memory.
+ * Values are typed (see nvram_image.hpp): get_u32()/get_bytes() return them
+ * natively, get_string()/set_string() use their text form.
+ *
+ * Storage is log-structured, so a save costs O(changed bytes) and survives
+ * a crash at any point:
+ *
+ *   nvram.dat          Base: either "KEY=VALUE" lines (may be written by
+ *                      hand) or a binary NVRAMImage, told apart by its magic.
+ *   nvram.dat.journal  Append-only log of changes since the base was written:
+ *
+ *     Header:  "VNJ1" | baseSize (4) | baseChecksum (4)
+ *     Record:  payloadLen (4) | crc32(payload) (4) | payload
+ *     Payload: { keyLen (2) | key | type (1) | valueLen (4) | value } ...
+ *     (integers big-endian)
+ *
+ * A binary base is mapped rather than read: load() validates it and replays
+ * the journal, lookups go to the changed keys first and then straight into
+ * the mapping. With set_format(BINARY) a text base is converted on load.
+ *
+ * set_string() only changes memory. save() appends one record holding every
+ * key changed since the last save and fdatasync()s it, so the keys of one
+ * save land together or not at all. Concurrent save() calls are group-
+ * committed: whoever arrives while a commit is in flight is carried by the
+ * next one, sharing a single write + fsync.
+ *
+ * load() reads the base and replays the journal, stopping at the first torn
+ * or corrupt record (the tail of a crashed append), which is cut off. The
+ * header names the base the journal applies to; a journal left over from
+ * another base (a hand-written nvram.dat, or a crash mid-compaction) is
+ * ignored, since the base then already holds everything it recorded.
+ *
+ * Once the journal outgrows the compaction threshold, the committed state
+ * is rewritten as a new base (tmp + fsync + rename), in the format chosen
+ * with set_format(), and the journal starts over.
+ *
+ * watch() registers a callback for one key, run whenever its value
+ * changes and after every load(). Caches derived from a key use it to
+ * rebuild only when that key changes.
+ *
+ * Every write is also replayed against an emulated flash device (flash(),
+ * see flash_device.hpp) to measure the page programs, erases and wear it
+ * would cost on the ECU. Its erase counters are kept in nvram.dat.wear.
+ *
+ * All public members are guarded by an internal mutex, so a single instance
+ * can be shared between the main thread and concurrent DoIP session handlers.
  */
 class NVRAMManager {
 public:
+    static constexpr uint64_t DEFAULT_COMPACTION_BYTES = 64 * 1024;
+
+    /// I/O counters since construction.
+    struct Stats {
+        uint64_t commits       = 0;   // Journal records written
+        uint64_t bytes_written = 0;   // Journal + base bytes written
+        uint64_t fsyncs        = 0;
+        uint64_t compactions   = 0;
+        uint64_t journal_bytes = 0;   // Current journal size
+    };
+
     /**
      * @brief Constructor.
      * @param filename The path to the file to be used for persistent storage.
      */
-    explicit NVRAMManager(const std::string& filename) : m_filename(filename) {}
+    explicit NVRAMManager(const std::string& filename)
+        : m_filename(filename), m_journal_path(filename + ".journal"), m_wear_path(filename + ".wear") {}
+
+    ~NVRAMManager() {
+        if (m_journal_fd >= 0) ::close(m_journal_fd);
+    }
+
+    NVRAMManager(const NVRAMManager&)            = delete;
+    NVRAMManager& operator=(const NVRAMManager&) = delete;
 
     /**
      * @brief Loads the key-value data from the NVRAM file.
      *
      * If the file doesn't exist, it creates a default configuration.
+     * Every watcher runs afterwards, since any key may have changed.
      * @return True if loading was successful, false otherwise.
      */
     bool load() {
-        std::ifstream file(m_filename);
-        if (!file.is_open()) {
-            std::cout << "[NVRAM] No existing NVRAM file found. Creating default." << std::endl;
-            return create_default_nvram();
+        bool ok = load_base_and_journal();
+        std::vector<std::function<void()>> all;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            for (const auto& [key, callbacks] : m_watchers)
+                all.insert(all.end(), callbacks.begin(), callbacks.end());
         }
+        for (const auto& callback : all) callback();
+        return ok;
+    }
 
-        std::string line;
-        while (std::getline(file, line)) {
-            // Simple parsing for "KEY=VALUE" format
-            size_t delimiter_pos = line.find('=');
-            if (delimiter_pos != std::string::npos) {
-                std::string key = line.substr(0, delimiter_pos);
-                std::string value = line.substr(delimiter_pos + 1);
-                m_data[key] = value;
-            }
-        }
-        std::cout << "[NVRAM] Successfully loaded data from " << m_filename << std::endl;
-        return true;
+    /**
+     * @brief Call @p on_change whenever the value of @p key changes.
+     *
+     * It runs on the thread that changed the value (or called load()),
+     * after the new value is visible to get_*(), and without any NVRAM
+     * lock held, so it may read NVRAM itself. Register before load().
+     */
+    void watch(const std::string& key, std::function<void()> on_change) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_watchers[key].push_back(std::move(on_change));
     }
 
     /**
      * @brief Saves the current key-value data to the NVRAM file.
+     *
+     * Appends the keys changed since the last save as one journal record.
      * @return True if saving was successful, false otherwise.
      */
     bool save() {
-        std::ofstream file(m_filename);
-        if (!file.is_open()) {
-            std::cerr << "[NVRAM] ERROR: Could not open file for writing: " << m_filename << std::endl;
-            return false;
+        std::unique_lock<std::mutex> lk(m_mutex);
+        const uint64_t ticket = ++m_save_ticket;   // Covers every change made so far
+        for (;;) {
+            if (m_durable_ticket >= ticket) return true;
+            if (m_failed_ticket  >= ticket) return false;
+            if (!m_commit_in_progress) break;
+            m_commit_cv.wait(lk);
         }
 
-        for (const auto& pair : m_data) {
-            file << pair.first << "=" << pair.second << std::endl;
+        // Leader: commit everything changed up to now, including the
+        // changes of callers that queued up behind the previous commit.
+        const uint64_t covers = m_save_ticket;
+        std::vector<std::pair<std::string, NVRAMValue>> changes;
+        changes.reserve(m_dirty.size());
+        for (const auto& key : m_dirty) changes.emplace_back(key, m_data[key]);
+        m_dirty.clear();
+        m_commit_in_progress = true;
+        lk.unlock();
+
+        bool ok = changes.empty() || commit(changes);
+
+        lk.lock();
+        m_commit_in_progress = false;
+        if (ok) {
+            m_durable_ticket = covers;
+        } else {
+            m_failed_ticket = covers;
+            for (const auto& c : changes) m_dirty.insert(c.first);
         }
-        std::cout << "[NVRAM] Data saved to " << m_filename << std::endl;
-        return true;
+        m_commit_cv.notify_all();
+        return ok;
+    }
+
+    /**
+     * @brief Save, then fold the journal into a text base file.
+     *
+     * Afterwards nvram.dat alone holds the full state, in the text format,
+     * as an image that predates the journal and the binary format expects.
+     * Call before handing over to another slot's image.
+     */
+    bool checkpoint() {
+        if (!save()) return false;
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_commit_cv.wait(lk, [this] { return !m_commit_in_progress; });
+        m_commit_in_progress = true;
+        lk.unlock();
+
+        bool ok = compact(NVRAMFormat::TEXT);
+        save_flash_wear();
+
+        lk.lock();
+        m_commit_in_progress = false;
+        m_commit_cv.notify_all();
+        return ok;
     }
 
     /**
@@ -72,34 +203,458 @@ public:
      * @return An std::optional containing the value if the key exists, otherwise std::nullopt.
      */
     std::optional<std::string> get_string(const std::string& key) const {
-        auto it = m_data.find(key);
-        if (it != m_data.end()) {
-            return it->second;
-        }
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (auto f = find_locked(key)) return NVRAMValue::to_text(key, f->type, f->value);
         return std::nullopt;
     }
 
+    /// A U32 value; std::nullopt if missing or of another type.
+    std::optional<uint32_t> get_u32(const std::string& key) const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto f = find_locked(key);
+        if (!f || f->type != NVRAMType::U32) return std::nullopt;
+        return NVRAMValue::decode_u32(f->value);
+    }
+
+    /// The raw bytes of a BYTES or BLOB value.
+    std::optional<std::vector<uint8_t>> get_bytes(const std::string& key) const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto f = find_locked(key);
+        if (!f || (f->type != NVRAMType::BYTES && f->type != NVRAMType::BLOB)) return std::nullopt;
+        return std::vector<uint8_t>(f->value.begin(), f->value.end());
+    }
+
     /**
      * @brief Sets a string value for a given key.
+     *
+     * The text is stored as the key's schema type when it parses as one.
      * @param key The key to set.
      * @param value The value to associate with the key.
      */
     void set_string(const std::string& key, const std::string& value) {
-        m_data[key] = value;
+        set(key, NVRAMValue::from_text(key, value));
+    }
+
+    void set_u32(const std::string& key, uint32_t value) {
+        set(key, NVRAMValue::from_u32(value));
+    }
+
+    /// Store raw bytes (as a BLOB if the schema says so, else as BYTES).
+    void set_bytes(const std::string& key, const std::vector<uint8_t>& value) {
+        const NVRAMFieldSpec* spec = nvram_field_spec(key);
+        NVRAMType type = spec && spec->type == NVRAMType::BLOB ? NVRAMType::BLOB : NVRAMType::BYTES;
+        set(key, {type, std::string(value.begin(), value.end())});
+    }
+
+    /// Format written when the base is (re)written. TEXT by default.
+    void set_format(NVRAMFormat format) { m_format.store(format); }
+
+    /// The current contents (including unsaved changes) as a base file.
+    std::string serialize(NVRAMFormat format) const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return encode(merged_with(m_data), format);
+    }
+
+    /// Journal size that triggers a rewrite of the base file.
+    void set_compaction_threshold(uint64_t bytes) { m_compaction_bytes.store(bytes); }
+
+    /// The emulated flash beneath this NVRAM (configure before load()).
+    FlashDevice&       flash()       { return m_flash; }
+    const FlashDevice& flash() const { return m_flash; }
+
+    /// Persist the flash erase counters (at shutdown).
+    bool save_flash_wear() const { return m_flash.save_wear(m_wear_path); }
+
+    Stats stats() const {
+        Stats s;
+        s.commits       = m_commits.load();
+        s.bytes_written = m_bytes_written.load();
+        s.fsyncs        = m_fsyncs.load();
+        s.compactions   = m_compactions.load();
+        s.journal_bytes = m_journal_size.load();
+        return s;
     }
 
 private:
     std::string m_filename;
-    std::map<std::string, std::string> m_data;
+    std::string m_journal_path;
+    std::string m_wear_path;
+    FlashDevice m_flash;
+    bool        m_wear_loaded = false;
+    NVRAMImage                        m_image;     // Mapped binary base, if any
+    std::map<std::string, NVRAMValue> m_data;      // Overrides m_image
+    std::set<std::string>             m_dirty;     // Keys changed since the last save
+    std::atomic<NVRAMFormat>          m_format{NVRAMFormat::TEXT};
+    std::map<std::string, std::vector<std::function<void()>>> m_watchers;   // See watch()
+    mutable std::mutex m_mutex;
+
+    // Group commit (guarded by m_mutex)
+    std::condition_variable m_commit_cv;
+    bool     m_commit_in_progress = false;
+    uint64_t m_save_ticket        = 0;
+    uint64_t m_durable_ticket     = 0;
+    uint64_t m_failed_ticket      = 0;
+
+    // Owned by whoever holds the commit (m_commit_in_progress) or by load()
+    std::map<std::string, NVRAMValue> m_durable;   // State on disk, over m_image
+    int      m_journal_fd    = -1;
+    uint64_t m_journal_bytes = 0;
+    uint64_t m_base_size     = 0;
+    uint32_t m_base_crc      = 0;
+
+    // Counters (read by stats() from any thread)
+    std::atomic<uint64_t> m_compaction_bytes{DEFAULT_COMPACTION_BYTES};
+    std::atomic<uint64_t> m_commits{0};
+    std::atomic<uint64_t> m_bytes_written{0};
+    std::atomic<uint64_t> m_fsyncs{0};
+    std::atomic<uint64_t> m_compactions{0};
+    std::atomic<uint64_t> m_journal_size{0};
+
+    static constexpr char   JOURNAL_MAGIC[4]    = {'V', 'N', 'J', '1'};
+    static constexpr size_t JOURNAL_HEADER_SIZE = 12;
+    static constexpr size_t RECORD_HEADER_SIZE  = 8;
+
+    // --- Encoding helpers -----------------------------------------------------
+
+    static uint32_t crc32_of(const void* data, size_t len) {
+        return static_cast<uint32_t>(::crc32(0L, static_cast<const Bytef*>(data), static_cast<uInt>(len)));
+    }
+
+    static void put_be(std::string& out, uint64_t v, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+
+    static uint64_t get_be(const std::string& in, size_t at, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; ++i) v = (v << 8) | static_cast<uint8_t>(in[at + i]);
+        return v;
+    }
+
+    // load() without the watchers: read the base, replay the journal.
+    bool load_base_and_journal() {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_commit_cv.wait(lk, [this] { return !m_commit_in_progress; });
+        m_data.clear();
+        m_dirty.clear();
+        m_durable.clear();
+        m_image.close();
+        m_flash.forget_files();
+        if (!m_wear_loaded) {
+            m_flash.load_wear(m_wear_path);
+            m_wear_loaded = true;
+        }
+
+        std::string magic;
+        if (!read_file(m_filename, magic, sizeof(NVRAMImage::MAGIC))) {
+            LOG_INFO("NVRAM", "No existing NVRAM file found. Creating default.");
+            return create_default_nvram();
+        }
+
+        const bool binary = NVRAMImage::has_magic(magic);
+        if (binary) {
+            if (!m_image.open(m_filename)) {
+                LOG_ERROR("NVRAM", "ERROR: Corrupt NVRAM image: %s", m_filename.c_str());
+                return false;
+            }
+            m_base_size = m_image.file_size();
+            m_base_crc  = m_image.checksum();
+            m_flash.adopt(m_filename, m_base_size);
+        } else {
+            std::string base;
+            read_file(m_filename, base);
+            size_t pos = 0;
+            while (pos < base.size()) {
+                // Simple parsing for "KEY=VALUE" format
+                size_t eol = base.find('\n', pos);
+                if (eol == std::string::npos) eol = base.size();
+                std::string line = base.substr(pos, eol - pos);
+                size_t delimiter_pos = line.find('=');
+                if (delimiter_pos != std::string::npos) {
+                    std::string key = line.substr(0, delimiter_pos);
+                    m_data[key] = NVRAMValue::from_text(key, line.substr(delimiter_pos + 1));
+                }
+                pos = eol + 1;
+            }
+            m_base_size = base.size();
+            m_base_crc  = crc32_of(base.data(), base.size());
+            m_flash.adopt(m_filename, m_base_size);
+        }
+
+        size_t replayed = replay_journal();
+        m_durable = m_data;
+        LOG_INFO("NVRAM", "Successfully loaded data from %s (%s, %zu journal record(s) replayed)",
+                 m_filename.c_str(), binary ? "binary image" : "text", replayed);
+
+        if (!binary && m_format.load() == NVRAMFormat::BINARY) {
+            LOG_INFO("NVRAM", "Converting %s to a binary image.", m_filename.c_str());
+            compact(NVRAMFormat::BINARY);
+        }
+        return true;
+    }
+
+    // Look up @p key in the changes, then in the mapped base. The views
+    // stay valid while m_mutex is held.
+    std::optional<NVRAMImage::Field> find_locked(const std::string& key) const {
+        auto it = m_data.find(key);
+        if (it != m_data.end()) return NVRAMImage::Field{it->first, it->second.type, it->second.data};
+        return m_image.find(key);
+    }
+
+    void set(const std::string& key, NVRAMValue value) {
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            auto f = find_locked(key);
+            if (f && f->type == value.type && f->value == value.data) return;
+            m_data[key] = std::move(value);
+            m_dirty.insert(key);
+            auto w = m_watchers.find(key);
+            if (w != m_watchers.end()) callbacks = w->second;
+        }
+        for (const auto& callback : callbacks) callback();
+    }
+
+    // The mapped base with @p changes applied.
+    std::map<std::string, NVRAMValue> merged_with(const std::map<std::string, NVRAMValue>& changes) const {
+        std::map<std::string, NVRAMValue> all;
+        for (size_t i = 0; i < m_image.size(); ++i) {
+            NVRAMImage::Field f = m_image.at(i);
+            all.emplace(std::string(f.key), NVRAMValue{f.type, std::string(f.value)});
+        }
+        for (const auto& [key, value] : changes) all[key] = value;
+        return all;
+    }
+
+    static std::string encode(const std::map<std::string, NVRAMValue>& all, NVRAMFormat format) {
+        if (format == NVRAMFormat::BINARY) return NVRAMImage::build(all);
+        std::string out;
+        for (const auto& [key, value] : all) out += key + "=" + value.to_text(key) + "\n";
+        return out;
+    }
+
+    // --- File helpers ---------------------------------------------------------
+
+    /// Read @p path (at most @p limit bytes) into @p out.
+    static bool read_file(const std::string& path, std::string& out, size_t limit = SIZE_MAX) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        out.clear();
+        char buf[8192];
+        while (out.size() < limit) {
+            ssize_t n = ::read(fd, buf, std::min(sizeof(buf), limit - out.size()));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            out.append(buf, static_cast<size_t>(n));
+        }
+        ::close(fd);
+        return true;
+    }
+
+    static bool write_all(int fd, const std::string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool sync(int fd) {
+        ++m_fsyncs;
+        return ::fdatasync(fd) == 0;
+    }
+
+    // Make a rename in the NVRAM directory durable.
+    void sync_directory() {
+        size_t slash = m_filename.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : m_filename.substr(0, slash + 1);
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+        sync(fd);
+        ::close(fd);
+    }
+
+    /// Write @p data to @p path via a synced temporary file and rename.
+    bool replace_file(const std::string& path, const std::string& data) {
+        const std::string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOG_ERROR("NVRAM", "ERROR: Could not open file for writing: %s", tmp.c_str());
+            return false;
+        }
+        bool ok = write_all(fd, data) && sync(fd);
+        ::close(fd);
+        if (!ok) {
+            LOG_ERROR("NVRAM", "ERROR: Write failed: %s", tmp.c_str());
+            return false;
+        }
+        m_flash.program(tmp, 0, data.size());
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            LOG_ERROR("NVRAM", "ERROR: Could not replace %s", path.c_str());
+            return false;
+        }
+        m_flash.rename(tmp, path);
+        sync_directory();
+        m_bytes_written += data.size();
+        return true;
+    }
+
+    // --- Journal --------------------------------------------------------------
+
+    /// Apply the journal on top of m_data. @return records replayed.
+    size_t replay_journal() {
+        if (m_journal_fd >= 0) {
+            ::close(m_journal_fd);
+            m_journal_fd = -1;
+        }
+        m_journal_bytes = 0;
+        m_journal_size  = 0;
+
+        std::string log;
+        if (!read_file(m_journal_path, log)) return 0;
+        m_flash.adopt(m_journal_path, log.size());
+        if (log.size() < JOURNAL_HEADER_SIZE || std::memcmp(log.data(), JOURNAL_MAGIC, 4) != 0
+            || get_be(log, 4, 4) != (m_base_size & 0xFFFFFFFF) || get_be(log, 8, 4) != m_base_crc) {
+            LOG_WARN("NVRAM", "Ignoring journal %s: written for a different base file.", m_journal_path.c_str());
+            return 0;   // Replaced by a fresh journal on the next commit
+        }
+
+        size_t pos = JOURNAL_HEADER_SIZE, records = 0;
+        while (pos + RECORD_HEADER_SIZE <= log.size()) {
+            size_t   len = static_cast<size_t>(get_be(log, pos, 4));
+            uint32_t crc = static_cast<uint32_t>(get_be(log, pos + 4, 4));
+            if (pos + RECORD_HEADER_SIZE + len > log.size()
+                || crc32_of(log.data() + pos + RECORD_HEADER_SIZE, len) != crc)
+                break;
+            std::map<std::string, NVRAMValue> changes;
+            if (!decode_record(log, pos + RECORD_HEADER_SIZE, len, changes)) break;
+            for (auto& kv : changes) m_data[kv.first] = std::move(kv.second);
+            pos += RECORD_HEADER_SIZE + len;
+            ++records;
+        }
+
+        if (pos != log.size()) {
+            LOG_WARN("NVRAM", "Discarding %zu byte(s) of torn journal tail.", log.size() - pos);
+            if (::truncate(m_journal_path.c_str(), static_cast<off_t>(pos)) != 0) return records;
+            m_flash.trim(m_journal_path, pos);
+        }
+        m_journal_fd = ::open(m_journal_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (m_journal_fd >= 0) m_journal_bytes = m_journal_size = pos;
+        return records;
+    }
+
+    static bool decode_record(const std::string& log, size_t at, size_t len,
+                              std::map<std::string, NVRAMValue>& out) {
+        size_t end = at + len;
+        while (at < end) {
+            if (at + 2 > end) return false;
+            size_t klen = static_cast<size_t>(get_be(log, at, 2));
+            at += 2;
+            if (at + klen + 5 > end) return false;
+            std::string key = log.substr(at, klen);
+            at += klen;
+            uint8_t type = static_cast<uint8_t>(log[at++]);
+            if (type > static_cast<uint8_t>(NVRAMType::BLOB)) return false;
+            size_t vlen = static_cast<size_t>(get_be(log, at, 4));
+            at += 4;
+            if (at + vlen > end) return false;
+            out[std::move(key)] = NVRAMValue{static_cast<NVRAMType>(type), log.substr(at, vlen)};
+            at += vlen;
+        }
+        return true;
+    }
+
+    /// Start an empty journal for the current base.
+    bool reset_journal() {
+        std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        put_be(header, m_base_size & 0xFFFFFFFF, 4);
+        put_be(header, m_base_crc, 4);
+        if (m_journal_fd >= 0) {
+            ::close(m_journal_fd);
+            m_journal_fd = -1;
+        }
+        if (!replace_file(m_journal_path, header)) return false;
+        m_journal_fd = ::open(m_journal_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        m_journal_bytes = m_journal_size = header.size();
+        return m_journal_fd >= 0;
+    }
+
+    /// Append one record with @p changes and make it durable. Committer only.
+    bool commit(const std::vector<std::pair<std::string, NVRAMValue>>& changes) {
+        // Without an open journal, records replayed at load may exist only
+        // in memory; fold them into the base before starting a new journal.
+        if (m_journal_fd < 0 && !compact(m_format.load())) return false;
+
+        std::string record;
+        put_be(record, 0, 4);   // Length and CRC, filled in below
+        put_be(record, 0, 4);
+        for (const auto& [key, value] : changes) {
+            put_be(record, key.size(), 2);
+            record += key;
+            record.push_back(static_cast<char>(value.type));
+            put_be(record, value.data.size(), 4);
+            record += value.data;
+        }
+        size_t len = record.size() - RECORD_HEADER_SIZE;
+        std::string header;
+        put_be(header, len, 4);
+        put_be(header, crc32_of(record.data() + RECORD_HEADER_SIZE, len), 4);
+        record.replace(0, RECORD_HEADER_SIZE, header);
+
+        if (!write_all(m_journal_fd, record) || !sync(m_journal_fd)) {
+            LOG_ERROR("NVRAM", "ERROR: Journal append failed: %s", m_journal_path.c_str());
+            // A partial record would hide every record appended after it,
+            // so the next commit starts a fresh journal (after compaction).
+            ::close(m_journal_fd);
+            m_journal_fd = -1;
+            return false;
+        }
+        m_flash.program(m_journal_path, m_journal_bytes, record.size());
+        for (const auto& [key, value] : changes) m_durable[key] = value;
+        m_journal_bytes += record.size();
+        m_journal_size   = m_journal_bytes;
+        m_bytes_written += record.size();
+        ++m_commits;
+        LOG_DEBUG("NVRAM", "Committed %zu key(s) (%zu bytes) to %s",
+                  changes.size(), record.size(), m_journal_path.c_str());
+
+        if (m_journal_bytes > m_compaction_bytes.load()) compact(m_format.load());
+        return true;
+    }
+
+    /// Rewrite the committed state as the new base and empty the journal.
+    bool compact(NVRAMFormat format) {
+        // The old mapping stays valid after the rename; m_durable keeps
+        // overriding it, so it is not remapped.
+        std::string base = encode(merged_with(m_durable), format);
+        if (!replace_file(m_filename, base)) return false;
+        // A crash from here until the new journal is in place leaves the old
+        // journal naming the old base; load() ignores it. Nothing is lost:
+        // the new base holds everything it recorded.
+        m_base_size = base.size();
+        m_base_crc  = format == NVRAMFormat::BINARY ? NVRAMImage::checksum_of(base)
+                                                    : crc32_of(base.data(), base.size());
+        ++m_compactions;
+        LOG_INFO("NVRAM", "Compacted journal into %s (%zu bytes, %s)", m_filename.c_str(), base.size(),
+                 format == NVRAMFormat::BINARY ? "binary" : "text");
+        return reset_journal();
+    }
 
     /**
      * @brief Creates a default NVRAM file with initial values.
      */
     bool create_default_nvram() {
-        m_data["FIRMWARE_VERSION"] = "1.0.0";
-        m_data["ECU_SERIAL_NUMBER"] = "VECU-2023-001";
+        auto put = [this](const std::string& key, const std::string& text) {
+            m_data[key] = NVRAMValue::from_text(key, text);
+        };
+        put("FIRMWARE_VERSION", "1.0.0");
+        put("ECU_SERIAL_NUMBER", "VECU-2023-001");
+        put("VIN", "VECU-SIM-1234567");
         // In Phase 4, this hash will be critical for secure boot.
-        m_data["FIRMWARE_HASH_GOLDEN"] = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"; // SHA-256 of an empty file
-        return save();
+        put("FIRMWARE_HASH_GOLDEN", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"); // SHA-256 of an empty file
+        m_durable = m_data;
+        return compact(m_format.load());
     }
 };
@@ -0,0 +1,63 @@
+/**
+ * @file nvram_tool.cpp
+ * @brief Inspect an NVRAM file and convert it between the text and binary formats.
+ *
+ * The input may be either format; its journal (<file>.journal), if any, is
+ * applied. The input is never rewritten.
+ *
+ * Usage:
+ *   ./nvram_tool <nvram_file>                      Print as KEY=VALUE text
+ *   ./nvram_tool <nvram_file> --to-text <out>      Write a text file
+ *   ./nvram_tool <nvram_file> --to-binary <out>    Write a binary image
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "nvram_manager.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc != 2 && argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <nvram_file> [--to-text <out> | --to-binary <out>]\n";
+        return 2;
+    }
+    const std::string in = argv[1];
+    if (::access(in.c_str(), R_OK) != 0) {   // load() would create a default file
+        std::cerr << "Cannot read " << in << "\n";
+        return 1;
+    }
+
+    Logger::instance().set_level(LogLevel::WARN);
+    NVRAMManager nvram(in);
+    if (!nvram.load()) {
+        Logger::instance().flush();
+        std::cerr << "Cannot load " << in << "\n";
+        return 1;
+    }
+
+    if (argc == 2) {
+        std::cout << nvram.serialize(NVRAMFormat::TEXT);
+        return 0;
+    }
+
+    const std::string mode = argv[2], out = argv[3];
+    NVRAMFormat format;
+    if (mode == "--to-text")        format = NVRAMFormat::TEXT;
+    else if (mode == "--to-binary") format = NVRAMFormat::BINARY;
+    else {
+        std::cerr << "Unknown option: " << mode << "\n";
+        return 2;
+    }
+
+    std::ofstream file(out, std::ios::binary | std::ios::trunc);
+    file << nvram.serialize(format);
+    if (!file) {
+        std::cerr << "Cannot write " << out << "\n";
+        return 1;
+    }
+    std::cout << "Wrote " << out << "\n";
+    return 0;
+}
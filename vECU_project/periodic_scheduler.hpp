@@ -0,0 +1,182 @@
+#pragma once
+
+/**
+ * @file periodic_scheduler.hpp
+ * @brief $2A ReadDataByPeriodicIdentifier: per-session periodic DID push.
+ *
+ * A tester subscribes periodic identifiers (pDIDs) at one of three rates.
+ * A pDID is one byte, and names the DID 0xF200 | pDID in g_dids. After
+ * that, the session sends the values unprompted instead of the tester
+ * polling $22.
+ *
+ *   rate    period
+ *   SLOW    1000 ms
+ *   MEDIUM   200 ms
+ *   FAST      50 ms
+ *
+ * Each rate has one Asio timer on the session's strand. It runs to
+ * absolute deadlines, so the period does not drift with the time a tick
+ * takes, and a tick that falls behind is skipped rather than bunched up.
+ * A tick encodes every pDID due at that rate into as few messages as
+ * possible:
+ *
+ *   [0x6A, pDID, data, pDID, data, ...]
+ *
+ * Fixed-size DIDs share one message. A variable-length one is sent on its
+ * own, because a reader could not tell where its data ends.
+ *
+ * The scheduler holds the session only weakly: when the connection goes
+ * away, its pending ticks are dropped with it.
+ */
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <boost/asio.hpp>
+
+#include "did_registry.hpp"
+
+/// transmissionMode of $2A (0x04 = stopSending is not a rate).
+enum class PeriodicRate : uint8_t {
+    SLOW   = 0x01,
+    MEDIUM = 0x02,
+    FAST   = 0x03
+};
+
+class PeriodicScheduler {
+public:
+    static constexpr uint16_t PDID_BASE     = 0xF200;   // pDID xx = DID 0xF2xx
+    static constexpr size_t   MAX_SCHEDULED = 16;       // pDIDs per session, all rates
+
+    /// Sends one UDS payload (0x6A ...) to the tester; may drop it under backpressure.
+    using Send = std::function<void(std::vector<uint8_t> payload)>;
+
+    static std::chrono::milliseconds period(PeriodicRate rate) {
+        switch (rate) {
+            case PeriodicRate::SLOW:   return std::chrono::milliseconds(1000);
+            case PeriodicRate::MEDIUM: return std::chrono::milliseconds(200);
+            default:                   return std::chrono::milliseconds(50);
+        }
+    }
+
+    PeriodicScheduler(const boost::asio::any_io_executor& executor, const DidRegistry& dids, Send send)
+        : m_dids(dids), m_send(std::move(send)),
+          m_rates{{Rate(executor), Rate(executor), Rate(executor)}}
+    {}
+
+    PeriodicScheduler(const PeriodicScheduler&)            = delete;
+    PeriodicScheduler& operator=(const PeriodicScheduler&) = delete;
+
+    /**
+     * @brief Schedule @p pdids at @p rate. A pDID already scheduled moves to this rate.
+     * @param owner Kept weakly; ticks stop once it is gone.
+     * @return false (and nothing changed) if it would exceed MAX_SCHEDULED.
+     */
+    bool start(PeriodicRate rate, const std::vector<uint8_t>& pdids, std::weak_ptr<void> owner) {
+        size_t after = scheduled();
+        for (uint8_t p : pdids)
+            if (!is_scheduled(p)) ++after;
+        if (after > MAX_SCHEDULED) return false;
+
+        m_owner = std::move(owner);
+        stop(pdids);
+        Rate& r = m_rates[index(rate)];
+        for (uint8_t p : pdids)
+            if (std::find(r.pdids.begin(), r.pdids.end(), p) == r.pdids.end()) r.pdids.push_back(p);
+        if (!r.armed) {
+            r.armed = true;
+            ++r.generation;
+            r.next  = Clock::now();
+            arm(rate);
+        }
+        return true;
+    }
+
+    /// Unschedule @p pdids; all of them if empty. A rate left with none stops.
+    void stop(const std::vector<uint8_t>& pdids) {
+        for (Rate& r : m_rates) {
+            if (pdids.empty()) {
+                r.pdids.clear();
+            } else {
+                r.pdids.erase(std::remove_if(r.pdids.begin(), r.pdids.end(), [&](uint8_t p) {
+                    return std::find(pdids.begin(), pdids.end(), p) != pdids.end();
+                }), r.pdids.end());
+            }
+            if (r.pdids.empty() && r.armed) {
+                r.armed = false;
+                ++r.generation;   // A tick already queued must not re-arm
+                r.timer.cancel();
+            }
+        }
+    }
+
+    size_t scheduled() const {
+        size_t n = 0;
+        for (const Rate& r : m_rates) n += r.pdids.size();
+        return n;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Rate {
+        explicit Rate(const boost::asio::any_io_executor& executor) : timer(executor) {}
+        boost::asio::steady_timer timer;
+        std::vector<uint8_t>      pdids;   // In subscription order
+        bool                      armed = false;
+        uint32_t                  generation = 0;
+        Clock::time_point         next;
+    };
+
+    const DidRegistry&   m_dids;
+    Send                 m_send;
+    std::array<Rate, 3>  m_rates;
+    std::weak_ptr<void>  m_owner;
+
+    static size_t index(PeriodicRate rate) { return static_cast<size_t>(rate) - 1; }
+
+    bool is_scheduled(uint8_t pdid) const {
+        for (const Rate& r : m_rates)
+            if (std::find(r.pdids.begin(), r.pdids.end(), pdid) != r.pdids.end()) return true;
+        return false;
+    }
+
+    void arm(PeriodicRate rate) {
+        Rate& r = m_rates[index(rate)];
+        r.timer.expires_at(r.next);
+        r.timer.async_wait([this, rate, generation = r.generation, owner = m_owner](const boost::system::error_code& ec) {
+            auto alive = owner.lock();
+            if (ec || !alive) return;
+            Rate& r = m_rates[index(rate)];
+            if (generation != r.generation) return;
+            tick(r);
+            // Next deadline on the fixed grid; skip ticks we are already late for.
+            const auto now = Clock::now();
+            r.next += period(rate);
+            if (r.next < now) r.next = now + period(rate);
+            arm(rate);
+        });
+    }
+
+    void tick(const Rate& r) {
+        const auto table = m_dids.table();
+        std::vector<uint8_t> batch = {0x6A};
+        for (uint8_t pdid : r.pdids) {
+            const DidRegistry::Entry* entry = table->find(PDID_BASE | pdid);
+            if (!entry) continue;   // Removed since it was scheduled
+            if (entry->size == DidRegistry::VARIABLE) {
+                std::vector<uint8_t> single = {0x6A, pdid};
+                entry->encode(single);
+                m_send(std::move(single));
+                continue;
+            }
+            batch.push_back(pdid);
+            entry->encode(batch);
+        }
+        if (batch.size() > 1) m_send(std::move(batch));
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+/**
+ * @file response_cache.hpp
+ * @brief Prebuilt DoIP frames for responses that only change with NVRAM.
+ *
+ * Discovery scans send vehicle identification (0x0004) and $22 F189/F18C
+ * over and over. The answers depend only on NVRAM keys (VIN,
+ * FIRMWARE_VERSION, ECU_SERIAL_NUMBER), so each one is built once as a
+ * complete DoIP frame, header included, and kept as an immutable shared
+ * buffer. The session queues that buffer as it is: a hit copies one
+ * shared_ptr, with no lookup in NVRAM and no allocation.
+ *
+ * define() builds a frame at once and again every time its NVRAM key
+ * changes (NVRAMManager::watch(), which also fires after load()). A frame
+ * already being written keeps its old bytes.
+ *
+ * All members are thread-safe.
+ */
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+#include "nvram_manager.hpp"
+#include "logger.hpp"
+
+enum class CachedResponse : uint8_t {
+    VEHICLE_ANNOUNCEMENT = 0,   // 0x0005 payload: VIN
+    FW_VERSION           = 1,   // $22 F189 positive response
+    ECU_SERIAL           = 2,   // $22 F18C positive response
+    COUNT
+};
+
+class ResponseCache {
+public:
+    using Frame = std::shared_ptr<const std::vector<uint8_t>>;
+
+    /// A frame, and where in it the NVRAM value starts (for reuse in larger responses).
+    struct Entry {
+        Frame  frame;
+        size_t value_at = 0;
+    };
+    using Builder = std::function<Entry()>;
+
+    explicit ResponseCache(NVRAMManager& nvram) : m_nvram(nvram) {}
+    ResponseCache(const ResponseCache&)            = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    /// Build @p which with @p build now, and rebuild it whenever @p nvram_key changes.
+    void define(CachedResponse which, const std::string& nvram_key, Builder build) {
+        const size_t i = static_cast<size_t>(which);
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_builders[i] = std::move(build);
+        }
+        m_nvram.watch(nvram_key, [this, i] { rebuild(i); });
+        rebuild(i);
+    }
+
+    /// The current entry; its frame is nullptr if @p which was never defined.
+    Entry get(CachedResponse which) const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_entries[static_cast<size_t>(which)];
+    }
+
+    /// Frames built since start (the first build of each included).
+    uint64_t rebuilds() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_rebuilds;
+    }
+
+private:
+    static constexpr size_t COUNT = static_cast<size_t>(CachedResponse::COUNT);
+
+    NVRAMManager&                 m_nvram;
+    mutable std::mutex            m_mutex;
+    std::array<Builder, COUNT>    m_builders;
+    std::array<Entry, COUNT>      m_entries;
+    std::array<uint64_t, COUNT>   m_started{};    // Rebuilds begun, per entry
+    std::array<uint64_t, COUNT>   m_stored{};     // Rebuild whose entry is current
+    uint64_t                      m_rebuilds = 0;
+
+    void rebuild(size_t i) {
+        Builder  build;
+        uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            build  = m_builders[i];
+            ticket = ++m_started[i];
+        }
+        if (!build) return;
+        Entry entry = build();   // Reads NVRAM; no cache lock held
+        std::lock_guard<std::mutex> lk(m_mutex);
+        // A later rebuild read a newer value; do not overwrite it with this one.
+        if (ticket < m_stored[i]) return;
+        m_stored[i]  = ticket;
+        m_entries[i] = std::move(entry);
+        ++m_rebuilds;
+        LOG_DEBUG("CACHE", "Response %zu rebuilt (%zu bytes).", i, m_entries[i].frame ? m_entries[i].frame->size() : 0);
+    }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+/**
+ * @file slot_manager.hpp
+ * @brief A/B firmware slots with an atomic switch and instant rollback.
+ *
+ * Slot A is the installed executable (e.g. ./TargetECU), slot B sits next
+ * to it (./TargetECU.slot_b). An OTA download is written straight into the
+ * inactive slot; the running image is never touched.
+ *
+ * All slot state lives in NVRAM and is changed with a single save, so a
+ * switch either happens completely or not at all:
+ *
+ *   ACTIVE_SLOT           "A" or "B" (A if absent)
+ *   SLOT_A_HASH/SLOT_B_HASH
+ *                         Expected SHA-256 of each slot's image. Slot A
+ *                         falls back to FIRMWARE_HASH_GOLDEN.
+ *   FIRMWARE_HASH_GOLDEN  Always the active slot's hash (secure boot and
+ *                         delta updates read it).
+ *   SLOT_A_MERKLE/SLOT_B_MERKLE, FIRMWARE_MERKLE_GOLDEN
+ *                         The same for the Merkle root (merkle_hash.hpp),
+ *                         used by --boot-hash merkle. Empty if not known.
+ *   TRIAL_BOOT            1 after a switch until the new slot boots
+ *                         successfully; TRIAL_BOOT_ATTEMPTS counts tries
+ *                         (both U32).
+ *
+ * A slot that fails secure boot, or a trial slot that does not reach the
+ * application after MAX_TRIAL_BOOTS attempts, is rolled back to the
+ * previous slot — whose image is still on disk, so nothing is re-sent.
+ */
+
+#include <string>
+#include <optional>
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+
+#include "nvram_manager.hpp"
+
+class SlotManager {
+public:
+    static constexpr const char* SLOT_B_SUFFIX   = ".slot_b";
+    static constexpr int         MAX_TRIAL_BOOTS = 3;
+
+    explicit SlotManager(NVRAMManager& nvram) : m_nvram(nvram) {}
+
+    /**
+     * @brief Derive both slot paths from the running executable.
+     * @param running_path argv[0]; may be either slot.
+     */
+    void init(const std::string& running_path) {
+        m_running_path = running_path;
+        std::string base = running_path;
+        const std::string suffix = SLOT_B_SUFFIX;
+        if (base.size() > suffix.size()
+            && base.compare(base.size() - suffix.size(), suffix.size(), suffix) == 0)
+            base.resize(base.size() - suffix.size());
+        m_slot_a_path = base;
+        m_slot_b_path = base + suffix;
+    }
+
+    char active_slot() const {
+        auto s = m_nvram.get_string("ACTIVE_SLOT");
+        return (s && *s == "B") ? 'B' : 'A';
+    }
+
+    char inactive_slot() const { return active_slot() == 'A' ? 'B' : 'A'; }
+
+    const std::string& slot_path(char slot) const {
+        return slot == 'B' ? m_slot_b_path : m_slot_a_path;
+    }
+
+    /// Where a new image is downloaded to: the inactive slot.
+    std::string staging_path() const { return slot_path(inactive_slot()); }
+
+    /// True if @p slot is the image this process was started from.
+    bool is_running(char slot) const {
+        std::error_code ec;
+        return std::filesystem::equivalent(slot_path(slot), m_running_path, ec);
+    }
+
+    /// Expected SHA-256 (hex) of @p slot's image, if one was ever recorded.
+    std::optional<std::string> expected_hash(char slot) const {
+        auto h = m_nvram.get_string(std::string("SLOT_") + slot + "_HASH");
+        if (!h && slot == 'A') h = m_nvram.get_string("FIRMWARE_HASH_GOLDEN");
+        return h;
+    }
+
+    /// Expected Merkle root (hex) of @p slot's image, if one was recorded.
+    std::optional<std::string> expected_merkle(char slot) const {
+        auto h = m_nvram.get_string(std::string("SLOT_") + slot + "_MERKLE");
+        if ((!h || h->empty()) && slot == 'A') h = m_nvram.get_string("FIRMWARE_MERKLE_GOLDEN");
+        if (h && h->empty()) return std::nullopt;
+        return h;
+    }
+
+    /// Record the Merkle root of @p slot's image (after it passed SHA-256 secure boot).
+    bool record_merkle(char slot, const std::string& root_hex) {
+        m_nvram.set_string(std::string("SLOT_") + slot + "_MERKLE", root_hex);
+        if (slot == active_slot()) m_nvram.set_string("FIRMWARE_MERKLE_GOLDEN", root_hex);
+        return m_nvram.save();
+    }
+
+    /**
+     * @brief Make the staged image in the inactive slot the active one.
+     *
+     * Records its digest (and Merkle root, if computed) and starts a trial
+     * boot, all in one NVRAM save.
+     * @return false if the slot file or NVRAM cannot be updated.
+     */
+    bool commit_switch(const std::string& digest_hex, const std::string& merkle_hex = {}) {
+        char next = inactive_slot();
+        std::error_code ec;
+        std::filesystem::permissions(slot_path(next),
+            std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec
+                | std::filesystem::perms::others_exec,
+            std::filesystem::perm_options::add, ec);
+        if (ec) return false;
+
+        // Pin the outgoing slot's hash so a rollback can still verify it.
+        if (auto current = expected_hash(active_slot()))
+            m_nvram.set_string(std::string("SLOT_") + active_slot() + "_HASH", *current);
+        if (auto current = expected_merkle(active_slot()))
+            m_nvram.set_string(std::string("SLOT_") + active_slot() + "_MERKLE", *current);
+        m_nvram.set_string(std::string("SLOT_") + next + "_HASH", digest_hex);
+        m_nvram.set_string(std::string("SLOT_") + next + "_MERKLE", merkle_hex);   // Empty: none
+        m_nvram.set_string("ACTIVE_SLOT", std::string(1, next));
+        m_nvram.set_string("FIRMWARE_HASH_GOLDEN", digest_hex);
+        m_nvram.set_string("FIRMWARE_MERKLE_GOLDEN", merkle_hex);
+        m_nvram.set_u32("TRIAL_BOOT", 1);
+        m_nvram.set_u32("TRIAL_BOOT_ATTEMPTS", 0);
+        return m_nvram.save();
+    }
+
+    bool trial_pending() const {
+        return m_nvram.get_u32("TRIAL_BOOT").value_or(0) == 1;
+    }
+
+    /// Count one more boot of the trial slot. @return attempts so far.
+    int note_trial_attempt() {
+        uint32_t attempts = m_nvram.get_u32("TRIAL_BOOT_ATTEMPTS").value_or(0) + 1;
+        m_nvram.set_u32("TRIAL_BOOT_ATTEMPTS", attempts);
+        m_nvram.save();
+        return static_cast<int>(attempts);
+    }
+
+    /// The active slot booted into the application: it is now permanent.
+    void confirm_boot() {
+        if (!trial_pending()) return;
+        m_nvram.set_u32("TRIAL_BOOT", 0);
+        m_nvram.set_u32("TRIAL_BOOT_ATTEMPTS", 0);
+        m_nvram.save();
+    }
+
+    /**
+     * @brief Switch back to the other slot (one NVRAM save).
+     * @return The slot now active, or std::nullopt if the other slot never
+     *         held a verified image.
+     */
+    std::optional<char> rollback() {
+        char prev = inactive_slot();
+        auto hash = expected_hash(prev);
+        std::error_code ec;
+        if (!hash || !std::filesystem::exists(slot_path(prev), ec)) return std::nullopt;
+
+        m_nvram.set_string("ACTIVE_SLOT", std::string(1, prev));
+        m_nvram.set_string("FIRMWARE_HASH_GOLDEN", *hash);
+        m_nvram.set_string("FIRMWARE_MERKLE_GOLDEN", expected_merkle(prev).value_or(""));
+        m_nvram.set_u32("TRIAL_BOOT", 0);
+        m_nvram.set_u32("TRIAL_BOOT_ATTEMPTS", 0);
+        if (!m_nvram.save()) return std::nullopt;
+        return prev;
+    }
+
+private:
+    NVRAMManager& m_nvram;
+    std::string   m_running_path;
+    std::string   m_slot_a_path;
+    std::string   m_slot_b_path;
+};
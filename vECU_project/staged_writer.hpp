@@ -0,0 +1,242 @@
+#pragma once
+
+/**
+ * @file staged_writer.hpp
+ * @brief Bounded write-behind queue that keeps disk I/O off the network thread.
+ *
+ * Received chunks are handed to async_enqueue(), which returns immediately.
+ * A dedicated I/O thread drains the queue into the staging file. The
+ * completion handler of async_enqueue() is posted back to the caller's
+ * executor (the session strand) as soon as the chunk is *queued*, not
+ * written — that is the point at which the session may acknowledge it.
+ *
+ * Backpressure: the queue holds at most `max_queued_chunks` chunks. When it
+ * is full, the chunk is parked and its handler is deferred until the I/O
+ * thread frees a slot, so a slow disk throttles the sender instead of
+ * growing memory without bound.
+ *
+ * async_finish() posts its handler once every queued chunk has been written
+ * and fsync'd and the file is closed. abort() drops whatever is still
+ * queued and joins the I/O thread; it blocks for at most one write, so
+ * call it (or let the destructor run) off the network thread.
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/asio.hpp>
+
+class StagedWriter {
+public:
+    using Executor = boost::asio::any_io_executor;
+    using Handler  = std::function<void(bool ok)>;
+
+    /// A queued write: bytes [offset, data.size()) of `data` are written.
+    struct Chunk {
+        std::vector<uint8_t> data;
+        size_t               offset = 0;
+    };
+
+    explicit StagedWriter(size_t max_queued_chunks = 16)
+        : m_max_queued(max_queued_chunks > 0 ? max_queued_chunks : 1) {}
+
+    ~StagedWriter() { abort(); }
+
+    StagedWriter(const StagedWriter&)            = delete;
+    StagedWriter& operator=(const StagedWriter&) = delete;
+
+    /**
+     * @brief Create (truncate) the target file and start the I/O thread.
+     * @return false if the file cannot be opened.
+     */
+    bool open(const std::string& path) {
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (m_fd < 0) return false;
+        m_thread = std::thread([this]() { run(); });
+        return true;
+    }
+
+    /**
+     * @brief Queue a chunk for writing.
+     * @param chunk    Data to write; moved into the queue without copying.
+     * @param ex       Executor on which @p handler is posted.
+     * @param handler  Called with false if the writer has already failed.
+     */
+    void async_enqueue(Chunk chunk, Executor ex, Handler handler) {
+        bool failed;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            failed = m_failed;
+            if (!failed) {
+                if (m_queue.size() < m_max_queued && m_parked.empty()) {
+                    m_queue.push_back(std::move(chunk));
+                    m_high_water = std::max(m_high_water, m_queue.size());
+                } else {
+                    ++m_backpressure_events;
+                    m_parked.push_back({std::move(chunk), ex, std::move(handler)});
+                    return;
+                }
+            }
+        }
+        m_cv.notify_one();
+        boost::asio::post(ex, [handler, failed]() { handler(!failed); });
+    }
+
+    /**
+     * @brief Drain the queue, fsync and close the file, then post @p handler.
+     */
+    void async_finish(Executor ex, Handler handler) {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            if (m_stopping) {
+                // Aborted: the I/O thread is gone or about to be.
+                boost::asio::post(ex, [handler = std::move(handler)]() { handler(false); });
+                return;
+            }
+            m_finish_executor = ex;
+            m_finish_handler  = std::move(handler);
+        }
+        m_cv.notify_one();
+    }
+
+    /**
+     * @brief Drop queued chunks, fail parked senders and join the I/O thread.
+     *
+     * Returns once the file is no longer written to. Safe to call from
+     * several threads at once and more than once.
+     */
+    void abort() {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_stopping = true;
+            fail_locked();
+        }
+        m_cv.notify_all();
+        std::lock_guard<std::mutex> lk(m_join_mutex);
+        if (m_thread.joinable()) m_thread.join();
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+    }
+
+    /// Number of times a chunk had to wait for queue space.
+    size_t backpressure_events() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_backpressure_events;
+    }
+
+    /// Largest queue depth observed.
+    size_t high_water_mark() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        return m_high_water;
+    }
+
+private:
+    struct Parked {
+        Chunk    chunk;
+        Executor executor;
+        Handler  handler;
+    };
+
+    // -----------------------------------------------------------------------
+    // I/O thread
+    // -----------------------------------------------------------------------
+    void run() {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        for (;;) {
+            m_cv.wait(lk, [this]() {
+                return m_stopping || !m_queue.empty() || m_finish_handler;
+            });
+
+            if (!m_queue.empty()) {
+                Chunk chunk = std::move(m_queue.front());
+                m_queue.pop_front();
+                admit_parked_locked();
+
+                lk.unlock();
+                bool ok = write_all(chunk);
+                lk.lock();
+                if (!ok) fail_locked();
+                continue;
+            }
+
+            if (m_finish_handler) {
+                Handler  handler = std::move(m_finish_handler);
+                Executor ex      = m_finish_executor;
+                m_finish_handler = nullptr;
+
+                lk.unlock();
+                bool ok = ::fsync(m_fd) == 0;
+                ok = (::close(m_fd) == 0) && ok;
+                lk.lock();
+                m_fd = -1;
+                ok = ok && !m_failed;
+                // Move the handler out: it may own the last reference to
+                // this writer's owner, which must not be released here.
+                boost::asio::post(ex, [handler = std::move(handler), ok]() { handler(ok); });
+                return;
+            }
+
+            if (m_stopping) return;
+        }
+    }
+
+    /// Move parked chunks into freed queue slots and release their senders.
+    void admit_parked_locked() {
+        while (!m_parked.empty() && m_queue.size() < m_max_queued) {
+            Parked p = std::move(m_parked.front());
+            m_parked.pop_front();
+            m_queue.push_back(std::move(p.chunk));
+            boost::asio::post(p.executor, [h = std::move(p.handler)]() { h(true); });
+        }
+    }
+
+    /// After a write error: drop queued data and fail any parked senders.
+    void fail_locked() {
+        m_failed = true;
+        m_queue.clear();
+        while (!m_parked.empty()) {
+            Parked p = std::move(m_parked.front());
+            m_parked.pop_front();
+            boost::asio::post(p.executor, [h = std::move(p.handler)]() { h(false); });
+        }
+    }
+
+    bool write_all(const Chunk& chunk) {
+        const uint8_t* p   = chunk.data.data() + chunk.offset;
+        size_t         len = chunk.data.size() - chunk.offset;
+        while (len > 0) {
+            ssize_t n = ::write(m_fd, p, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p   += n;
+            len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    const size_t            m_max_queued;
+    int                     m_fd = -1;
+    std::thread             m_thread;
+    std::mutex              m_join_mutex;   // Serializes abort()
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Chunk>       m_queue;
+    std::deque<Parked>      m_parked;
+    Executor                m_finish_executor;
+    Handler                 m_finish_handler;
+    bool                    m_failed   = false;
+    bool                    m_stopping = false;
+    size_t                  m_backpressure_events = 0;
+    size_t                  m_high_water          = 0;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+/**
+ * @file stream_inflater.hpp
+ * @brief Incremental zlib decompression for compressed OTA transfers.
+ *
+ * A compressed download ($34 dataFormatIdentifier compressionMethod 0x1)
+ * carries one zlib stream split across the $36 blocks. Each block is
+ * inflated as it arrives; block boundaries need not line up with deflate
+ * block boundaries.
+ *
+ * Each call produces at most max_output bytes, whatever the compression
+ * ratio; what zlib still holds back comes out on the next call.
+ */
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <zlib.h>
+
+class StreamInflater {
+public:
+    StreamInflater() {
+        std::memset(&m_zs, 0, sizeof(m_zs));
+        m_ok = inflateInit(&m_zs) == Z_OK;
+    }
+
+    ~StreamInflater() {
+        inflateEnd(&m_zs);
+    }
+
+    StreamInflater(const StreamInflater&)            = delete;
+    StreamInflater& operator=(const StreamInflater&) = delete;
+
+    /**
+     * @brief Inflate the next piece of the compressed stream.
+     *
+     * Stops after @p max_output bytes. Compressed bytes not consumed then
+     * must be passed again on the next call; if output_pending(), call
+     * again (with @p len 0 if need be) for the rest of the output.
+     *
+     * @param data       Compressed bytes.
+     * @param len        Number of compressed bytes.
+     * @param consumed   Set to the number of compressed bytes used.
+     * @param out        Receives the decompressed bytes (replaced).
+     * @param max_output Most decompressed bytes to produce in this call.
+     * @return false on a zlib error or data after the end of the stream.
+     */
+    bool inflate(const uint8_t* data, size_t len, size_t& consumed, std::vector<uint8_t>& out, size_t max_output) {
+        out.clear();
+        consumed = 0;
+        if (!m_ok) return false;
+        if (m_done) return m_ok = (len == 0);
+
+        auto t0 = std::chrono::steady_clock::now();
+        m_zs.next_in  = const_cast<Bytef*>(data);
+        m_zs.avail_in = static_cast<uInt>(len);
+
+        // Keep going while input remains or the last call filled the output
+        // buffer completely (zlib may be holding back more output).
+        size_t produced = 0;
+        bool   more     = len > 0 || m_output_pending;
+        m_output_pending = false;
+        while (more && !m_done && produced < max_output) {
+            size_t step = std::min(OUTPUT_STEP, max_output - produced);
+            if (out.size() - produced < step) out.resize(produced + step);
+            m_zs.next_out  = out.data() + produced;
+            m_zs.avail_out = static_cast<uInt>(out.size() - produced);
+
+            int rc = ::inflate(&m_zs, Z_NO_FLUSH);
+            produced = out.size() - m_zs.avail_out;
+            if (rc == Z_STREAM_END) {
+                m_done = true;
+            } else if (rc == Z_BUF_ERROR) {
+                more = false;                      // Needs more input
+            } else if (rc != Z_OK) {
+                m_ok = false;
+            }
+            if (!m_ok) break;
+            m_output_pending = !m_done && m_zs.avail_out == 0;
+            more = more && (m_zs.avail_in > 0 || m_zs.avail_out == 0);
+        }
+        consumed = len - m_zs.avail_in;
+        // Trailing bytes after Z_STREAM_END mean a corrupt or padded stream.
+        if (m_done && m_zs.avail_in > 0) m_ok = false;
+
+        out.resize(produced);
+        m_bytes_in  += consumed;
+        m_bytes_out += produced;
+        m_seconds   += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return m_ok;
+    }
+
+    bool     ok()        const { return m_ok; }
+    bool     finished()  const { return m_done; }
+    /// The last call stopped at max_output; zlib may hold more output.
+    bool     output_pending() const { return m_output_pending; }
+    uint64_t bytes_in()  const { return m_bytes_in; }
+    uint64_t bytes_out() const { return m_bytes_out; }
+    double   seconds()   const { return m_seconds; }
+
+private:
+    static constexpr size_t OUTPUT_STEP = 64 * 1024;
+
+    z_stream m_zs;
+    bool     m_ok   = false;
+    bool     m_done = false;
+    bool     m_output_pending = false;
+    uint64_t m_bytes_in  = 0;
+    uint64_t m_bytes_out = 0;
+    double   m_seconds   = 0.0;
+};
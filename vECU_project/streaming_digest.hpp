@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+ * @file streaming_digest.hpp
+ * @brief Incremental SHA-256 over data that arrives in pieces.
+ *
+ * Wraps an OpenSSL EVP_MD_CTX so callers can feed bytes as they become
+ * available (e.g. per $36 TransferData block) and finalize once at the end,
+ * instead of re-reading the whole file from disk.
+ *
+ * The SHA-256 method is fetched once per process (sha256_method()); with
+ * EVP_sha256() OpenSSL 3 would repeat the fetch on every context init.
+ */
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+
+#include <openssl/evp.h>
+
+/// SHA-256 from the default provider, fetched on first use and kept.
+inline const EVP_MD* sha256_method() {
+    static EVP_MD* const md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    return md ? md : EVP_sha256();
+}
+
+class StreamingDigest {
+public:
+    StreamingDigest() : m_ctx(EVP_MD_CTX_new()) {
+        m_ok = m_ctx && EVP_DigestInit_ex(m_ctx, sha256_method(), nullptr) == 1;
+    }
+
+    ~StreamingDigest() {
+        if (m_ctx) EVP_MD_CTX_free(m_ctx);
+    }
+
+    StreamingDigest(const StreamingDigest&)            = delete;
+    StreamingDigest& operator=(const StreamingDigest&) = delete;
+
+    /**
+     * @brief Feed the next piece of data into the digest.
+     * @return false if the context is unusable or OpenSSL reports an error.
+     */
+    bool update(const void* data, size_t len) {
+        if (!m_ok || m_finalized) return false;
+        if (len == 0) return true;
+        m_ok = EVP_DigestUpdate(m_ctx, data, len) == 1;
+        return m_ok;
+    }
+
+    /**
+     * @brief Finalize the digest. Further update() calls are rejected.
+     * @return false if the digest could not be computed.
+     */
+    bool finalize() {
+        if (m_finalized) return m_ok;
+        m_finalized = true;
+        if (!m_ok) return false;
+
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int  md_len = 0;
+        m_ok = EVP_DigestFinal_ex(m_ctx, md, &md_len) == 1;
+        if (m_ok) m_digest.assign(md, md + md_len);
+        return m_ok;
+    }
+
+    bool ok()        const { return m_ok; }
+    bool finalized() const { return m_finalized; }
+
+    /** @brief Raw digest bytes (empty until finalize() succeeds). */
+    const std::vector<uint8_t>& digest() const { return m_digest; }
+
+    /** @brief Lowercase hex digest (empty until finalize() succeeds). */
+    std::string hex() const { return to_hex(m_digest); }
+
+    static std::string to_hex(const std::vector<uint8_t>& bytes) {
+        std::ostringstream ss;
+        for (auto b : bytes)
+            ss << std::hex << std::setw(2) << std::setfill('0') << (int)b;
+        return ss.str();
+    }
+
+    /** @brief Inverse of to_hex(); empty if @p hex is not valid hex. */
+    static std::vector<uint8_t> from_hex(const std::string& hex) {
+        auto nibble = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+        std::vector<uint8_t> out;
+        if (hex.size() % 2 != 0) return out;
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            int hi = nibble(hex[i]), lo = nibble(hex[i + 1]);
+            if (hi < 0 || lo < 0) return {};
+            out.push_back(static_cast<uint8_t>(hi << 4 | lo));
+        }
+        return out;
+    }
+
+private:
+    EVP_MD_CTX*          m_ctx;
+    bool                 m_ok        = false;
+    bool                 m_finalized = false;
+    std::vector<uint8_t> m_digest;
+};
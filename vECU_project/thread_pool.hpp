@@ -0,0 +1,141 @@
+#pragma once
+
+/**
+ * @file thread_pool.hpp
+ * @brief Fixed-size worker pool for CPU-bound ECU work (hashing, verification).
+ *
+ * The DoIP io_context threads must never run long CPU work, and secure
+ * boot wants every core for hashing a large image. ThreadPool owns a
+ * fixed set of workers draining one FIFO queue:
+ *
+ *   - post(f)             run f on a worker, fire and forget
+ *   - submit(f)           the same, with a std::future for the result
+ *   - parallel_for(n, f)  call f(0..n-1) across the workers and the
+ *                         calling thread; returns when all calls are done
+ *
+ * parallel_for() may be called from a worker itself: the caller works
+ * through the indices too and only waits for indices already started, so
+ * it completes even when every other worker is busy (or the pool has a
+ * single thread).
+ *
+ * The destructor runs the jobs still queued, then joins the workers.
+ */
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+
+class ThreadPool {
+public:
+    /// Start @p threads workers (at least one).
+    explicit ThreadPool(size_t threads) {
+        if (threads == 0) threads = 1;
+        m_workers.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+            m_workers.emplace_back([this] { worker_loop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        for (auto& t : m_workers) t.join();
+    }
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return m_workers.size(); }
+
+    /// Queue @p job for a worker.
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_cv.notify_one();
+    }
+
+    /// Queue @p f; its result (or exception) arrives through the future.
+    template <typename F>
+    auto submit(F f) -> std::future<std::invoke_result_t<F>> {
+        using R = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::move(f));
+        std::future<R> result = task->get_future();
+        post([task] { (*task)(); });
+        return result;
+    }
+
+    /**
+     * @brief Call @p body(i) for every i in [0, count), in parallel.
+     *
+     * Indices are handed out one at a time, so uneven work balances
+     * itself. @p body must not throw.
+     */
+    void parallel_for(size_t count, const std::function<void(size_t)>& body) {
+        if (count == 0) return;
+        struct Shared {
+            std::function<void(size_t)> body;
+            size_t                      count;
+            std::atomic<size_t>         next{0};
+            std::mutex                  mutex;
+            std::condition_variable     cv;
+            size_t                      done = 0;
+
+            // Take indices until none are left; the last one to finish wakes the caller.
+            void drain() {
+                size_t finished = 0;
+                for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+                    body(i);
+                    ++finished;
+                }
+                if (finished == 0) return;
+                std::lock_guard<std::mutex> lk(mutex);
+                done += finished;
+                if (done == count) cv.notify_all();
+            }
+        };
+        auto shared = std::make_shared<Shared>();
+        shared->body  = body;
+        shared->count = count;
+
+        // Helpers that start after the work is gone return immediately.
+        const size_t helpers = std::min(count - 1, size());
+        for (size_t h = 0; h < helpers; ++h) post([shared] { shared->drain(); });
+        shared->drain();
+
+        std::unique_lock<std::mutex> lk(shared->mutex);
+        shared->cv.wait(lk, [&] { return shared->done == count; });
+    }
+
+private:
+    std::vector<std::thread>          m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cv;
+    bool                              m_stopping = false;
+
+    void worker_loop() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lk(m_mutex);
+                m_cv.wait(lk, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) return;   // Stopping and drained
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            job();
+        }
+    }
+};